@@ -3,6 +3,17 @@
 //
 
 #include "oilproc.h"
+#include "oilcatalog.h"
+#include "oild.h"
+#include "oilprefetch.h"
+#include "oilsweep.h"
+#include "oilmerge.h"
+#include "oiljournal.h"
+#include "oilprofile.h"
+#include "oilhooks.h"
+
+#include <ctime>
+#include <memory>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -17,10 +28,10 @@ int main(int argc, char **argv) {
     }
     std::string home_path = oil::get_home_path<std::string>();
 #ifndef _WIN32
-    char end[] = "/Exp_V_Program_Files/Oil_Reader";
+    char figures[] = "/Exp_V_Figures/";
     char prog_files[] = "/Exp_V_Program_Files/";
 #else
-    char end[] = "\\Exp_V_Program_Files\\Oil_Reader.exe";
+    char figures[] = "\\Exp_V_Figures\\";
     char prog_files[] = "\\Exp_V_Program_Files\\";
 #endif
     std::string prog_files_path(home_path);
@@ -33,22 +44,93 @@ int main(int argc, char **argv) {
     std::string single_run_param_path = prog_files_path + "SingleRunParameters.txt";
     std::string dat_text_path = prog_files_path + "All_Runs.txt";
     bool show = false;
-    oil::make_dir(prog_files_path);
-    if (argc > 3) {
-        if (strcmp(*(argv + 3), "show") == 0) {
-            show = true;
+    oil::filter_kind filter = oil::filter_kind::none;
+    double filter_cutoff = 0;
+    size_t boot_resamples = 0;
+    const char *peaks_path = nullptr;
+    bool float_samples = false;
+    bool robust = false;
+    oil::baseline_kind baseline = oil::baseline_kind::none;
+    double baseline_window = 0;
+    auto parse_baseline = [&baseline, &baseline_window](const std::string &spec) { // <kind>:<seconds> or none
+        std::string::size_type colon = spec.find(':');
+        try {
+            baseline = oil::Baseline::kind_of(spec.substr(0, colon));
         }
-        else {
-            fprintf(stderr, "Invalid number of arguments provided (%d) and/or fourth argument not \"show\".\n", argc - 1);
-            exit(EXIT_FAILURE);
+        catch (const std::invalid_argument &exception) {
+            std::cerr << exception.what();
+            return false;
         }
-    }
-    else if(strcmp(*(argv + 1), "delete") == 0) {
+        baseline_window = colon == std::string::npos ? 0 : strtod(spec.c_str() + colon + 1, nullptr);
+        if (baseline != oil::baseline_kind::none && !(baseline_window > 0)) {
+            std::cerr << "The baseline window must be a positive time in s, as in \"baseline=median:2.5\".\n";
+            return false;
+        }
+        return true;
+    };
+    auto interval_note = [](const oil::Oil_run &run) { // what robust intervals corrected for
+        const oil::stats::interval_result &summary = run.get_interval_summary();
+        return std::to_string(summary.used) + " intervals used, " + std::to_string(summary.split) + " split, " +
+               std::to_string(summary.joined) + " joined, " + std::to_string(summary.rejected) + " rejected";
+    };
+    bool profile = false;
+    std::string profile_path; // .csv for CSV; empty for a table on stderr
+    std::unique_ptr<oil::prof::Rss_sampler> sampler;
+    auto start_profile = [&profile, &sampler]() {
+        if (profile) {
+            oil::prof::start();
+            sampler = std::make_unique<oil::prof::Rss_sampler>();
+        }
+    };
+    auto finish_profile = [&profile, &profile_path, &sampler]() {
+        if (!profile) {
+            return;
+        }
+        oil::prof::stop();
+        sampler.reset();
+        if (profile_path.empty()) {
+            fputs("\nMemory profile:\n", stderr);
+            oil::prof::report(stderr);
+            return;
+        }
+        FILE *out = fopen(profile_path.c_str(), "w");
+        if (out == nullptr) {
+            std::cerr << "The memory profile could not be written to " << profile_path << ".\n";
+            return;
+        }
+        oil::prof::report(out, oil::io::ends_with(profile_path, ".csv"));
+        fclose(out);
+    };
+    oil::make_dir(prog_files_path);
+    std::string catalog_path = prog_files_path + "Catalog.dat";
+    std::string socket_path = prog_files_path + "oild.sock";
+    oil::Catalog catalog;
+    bool catalog_loaded = false;
+    auto load_catalog = [&catalog, &catalog_loaded, &catalog_path, &home_path]() {
+        catalog.load(catalog_path);
+        catalog_loaded = true;
+        if (catalog.directories().empty()) { // Downloads is catalogued by default
+            struct stat dl = {};
+#ifndef _WIN32
+            std::string downloads = home_path + "/Downloads";
+#else
+            std::string downloads = home_path + "\\Downloads";
+#endif
+            if (stat(downloads.c_str(), &dl) == 0 && S_ISDIR(dl.st_mode)) {
+                catalog.add_dir(downloads);
+            }
+        }
+    };
+    if(strcmp(*(argv + 1), "delete") == 0) {
         if (argc == 2) {
             int retval = oil::del(dat_file_path);
             if (retval == 1) {
                 std::cerr << "Data file non-existent or not in expected location.\n";
             }
+            oil::del(oil::Calibration::sidecar_path(dat_file_path.c_str()));
+            oil::del(oil::Aggregates::sidecar_path(dat_file_path.c_str()));
+            oil::del(oil::Name_table::sidecar_path(dat_file_path.c_str()));
+            oil::del(oil::Archive<oil::Oil_run::record>::sidecar_path(dat_file_path.c_str()));
             return retval;
         }
         else {
@@ -59,87 +141,811 @@ int main(int argc, char **argv) {
                 std::cerr << "Data file non-existent or not in expected location.\n";
                 return 1;
             }
+            catch (const std::exception &exception) {
+                std::cerr << exception.what() << '\n';
+                return 1;
+            }
             return 0;
         }
     }
     else if(strcmp(*(argv + 1), "gentext") == 0) {
-        int gen_ret = oil::Oil_run::gen_text(dat_file_path.c_str(), dat_text_path.c_str());
+        oil::report_format format = oil::report_format::text;
+        bool open = false;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(*(argv + i), "csv") == 0) {
+                format = oil::report_format::csv;
+                dat_text_path = prog_files_path + "All_Runs.csv";
+            }
+            else if (strcmp(*(argv + i), "md") == 0) {
+                format = oil::report_format::markdown;
+                dat_text_path = prog_files_path + "All_Runs.md";
+            }
+            else if (strcmp(*(argv + i), "open") == 0) {
+                open = true;
+            }
+            else if (strcmp(*(argv + i), "txt") != 0) {
+                std::cerr << "Usage: gentext [txt/csv/md] [open]\n";
+                return 1;
+            }
+        }
+        int gen_ret = oil::Oil_run::gen_text(dat_file_path.c_str(), dat_text_path.c_str(), open, format);
         if (gen_ret == 1) {
             std::cerr << "No .dat file found at the expected path: " << dat_file_path << '\n';
             std::cerr << "Run the program first to generate the .dat file.\n";
         }
         return gen_ret;
     }
+    else if(strcmp(*(argv + 1), "calibrate") == 0) {
+        try {
+            oil::Calibration cal = oil::Oil_run::calibrate(dat_file_path.c_str(), argc == 3 ? *(argv + 2) : "",
+                                                           def_graph_vars_path.c_str());
+            std::cout << "MT vs l fit over " << cal.count() << " runs:\n"
+                      << "Gradient = " << cal.slope() << " +/- " << cal.slope_err() << " kg s m^-1\n"
+                      << "Intercept = " << cal.intercept() << " +/- " << cal.intercept_err() << " kg s\n"
+                      << "Graph variables written to: " << def_graph_vars_path << std::endl;
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "summary") == 0) {
+        try {
+            oil::Aggregates agg;
+            agg.sync<oil::Oil_run::record>(dat_file_path.c_str());
+            if (agg.count() == 0) {
+                std::cerr << "No runs found in: " << dat_file_path << '\n';
+                return 1;
+            }
+            for (const oil::Aggregates::summary &s : agg.summaries(argc == 3 ? *(argv + 2) : "")) {
+                std::cout << s.oil << ": " << s.runs << (s.runs == 1 ? " run" : " runs") << '\n';
+                if (s.visc_runs > 0) {
+                    std::cout << "    Viscosity = " << s.viscosity << " +/- " << s.visc_err
+                              << oil::Oil_run::visc_units() << " (spread " << s.spread << " over " << s.visc_runs
+                              << ")\n";
+                }
+                std::cout << "    Latest time period = " << s.latest_T << " +/- " << s.latest_T_err << " s\n";
+            }
+            agg.save(dat_file_path.c_str());
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "catalog") == 0) {
+        try {
+            load_catalog();
+            std::string action = argc > 2 ? *(argv + 2) : "list";
+            if ((action == "add" || action == "remove" || action == "mark" || action == "unmark") && argc != 4) {
+                std::cerr << "Usage: catalog [list/all/add <directory>/remove <directory>/mark <capture>/"
+                             "unmark <capture>]\n";
+                return 1;
+            }
+            if (action == "add") {
+                std::string dir = fs::absolute(*(argv + 3)).lexically_normal().string();
+                if (!catalog.add_dir(dir)) {
+                    std::cout << "Directory already catalogued: " << dir << '\n';
+                }
+            }
+            else if (action == "remove") {
+                std::string dir = fs::absolute(*(argv + 3)).lexically_normal().string();
+                if (!catalog.remove_dir(dir)) {
+                    std::cerr << "Directory not catalogued: " << dir << '\n';
+                    return 1;
+                }
+            }
+            catalog.rescan(true); // the listing shows sizes and times, so also re-check captures rewritten in place
+            if (action == "mark" || action == "unmark") {
+                std::string file = fs::absolute(*(argv + 3)).lexically_normal().string();
+                if (!catalog.mark(file, action == "mark" ? oil::Catalog::processed : oil::Catalog::unprocessed)) {
+                    std::cerr << "Capture not catalogued: " << file << '\n';
+                    return 1;
+                }
+            }
+            else if (action == "list" || action == "all") {
+                std::string listing;
+                size_t shown = 0;
+                for (const oil::Catalog::file_entry &file : catalog.all_files()) {
+                    if (action == "list" && file.state == oil::Catalog::processed) {
+                        continue;
+                    }
+                    listing.append(file.state == oil::Catalog::processed ? "done  " :
+                                   file.state == oil::Catalog::quarantined ? "fail  " : "todo  ");
+                    listing.append(std::to_string(file.num_samples));
+                    listing.append(" samples  ");
+                    listing.append(catalog.path_of(file));
+                    listing.push_back('\n');
+                    ++shown;
+                }
+                std::cout << listing << shown << (action == "list" ? " unprocessed" : "") << " captures in "
+                          << catalog.directories().size() << " directories." << std::endl;
+            }
+            else if (action != "add" && action != "remove") {
+                std::cerr << "Unknown catalog action: " << action << '\n';
+                return 1;
+            }
+            catalog.save();
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "oild") == 0) {
+#ifndef _WIN32
+        oil::Daemon daemon(socket_path, dat_file_path, constants, def_graph_vars_path, single_run_param_path);
+        try {
+            std::cout << "Starting the daemon on: " << socket_path << std::endl;
+            daemon.run(argc > 2 && oil::is_numeric(*(argv + 2)) ? (unsigned) strtoul(*(argv + 2), nullptr, 10) : 0);
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+#else
+        std::cerr << "The daemon is not available on Windows.\n";
+        return 1;
+#endif
+    }
+    else if(strcmp(*(argv + 1), "client") == 0) {
+#ifndef _WIN32
+        if (argc < 3) {
+            std::cerr << "Usage: client <analyse/query/list/reload/stop> [arguments...]\n";
+            return 1;
+        }
+        std::vector<std::string> words(argv + 2, argv + argc);
+        if (words.size() > 1 && (words[0] == "analyse" || words[0] == "analyze")) {
+            words[1] = fs::absolute(words[1]).lexically_normal().string(); // the daemon has its own cwd
+        }
+        std::string reply = oil::Daemon::request(socket_path, words);
+        if (reply.empty()) {
+            std::cerr << "No daemon is listening on: " << socket_path << "\nStart one with \"oild\".\n";
+            return 1;
+        }
+        std::cout << reply;
+        return reply.compare(0, 3, "ERR") == 0 ? 1 : 0;
+#else
+        std::cerr << "The daemon is not available on Windows.\n";
+        return 1;
+#endif
+    }
     else if(strcmp(*(argv + 1), "gensample") == 0) {
         return oil::generate_sample_texts(constants.c_str(), def_graph_vars_path.c_str(),
                                           single_run_param_path.c_str());
     }
+    else if(strcmp(*(argv + 1), "convert") == 0) {
+        if (argc < 4 || argc > 5 || !oil::is_numeric(*(argv + 3))) {
+            std::cerr << "Usage: convert <capture> <frequency> [f32/i16]\n";
+            return 1;
+        }
+        oil::io::sample_format format = oil::io::sample_format::float32;
+        if (argc == 5) {
+            std::string fmt(*(argv + 4));
+            oil::string_upper(fmt);
+            if (fmt == "I16" || fmt == "INT16") {
+                format = oil::io::sample_format::int16;
+            }
+            else if (fmt != "F32" && fmt != "FLOAT32") {
+                std::cerr << "The sample format must be either \"f32\" or \"i16\".\n";
+                return 1;
+            }
+        }
+        std::string in_path(*(argv + 2));
+        std::string out_path = oil::io::strip_capture_ext(in_path);
+        out_path.append(".expv");
+        try {
+            uint64_t num = oil::io::convert_capture(in_path.c_str(), out_path.c_str(), (double) strtol(*(argv + 3),
+                                                    nullptr, 10), format);
+            std::cout << num << " samples written to: " << out_path << std::endl;
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "merge") == 0) {
+        // merge [policy] <stores...> [out=<path>]: into the local store unless out= is given
+        oil::merge_policy policy = oil::merge_policy::newest_store;
+        std::vector<std::string> stores;
+        std::string out_path;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg(*(argv + i));
+            if (i == 2 && (arg == "newest-store" || arg == "both" || arg == "ow" || arg == "app" || arg == "dn")) {
+                policy = oil::Merge<oil::Oil_run::record>::policy_of(arg);
+            }
+            else if (arg.rfind("out=", 0) == 0) {
+                out_path = arg.substr(4);
+            }
+            else {
+                stores.push_back(arg);
+            }
+        }
+        if (stores.empty()) {
+            std::cerr << "Usage: merge [newest-store/both/ow/app/dn] <stores...> [out=<path>]\n";
+            return 1;
+        }
+        struct stat local = {};
+        if (out_path.empty()) {
+            out_path = dat_file_path;
+            if (stat(dat_file_path.c_str(), &local) == 0) {
+                stores.insert(stores.begin(), dat_file_path);
+            }
+        }
+        try {
+            auto start = std::chrono::steady_clock::now();
+            oil::Merge<oil::Oil_run::record>::merge_result res =
+                    oil::Merge<oil::Oil_run::record>::merge(stores, out_path.c_str(), policy);
+            oil::Aggregates agg; // the sidecars follow the new order of the runs
+            agg.rebuild<oil::Oil_run::record>(out_path.c_str());
+            agg.save();
+            oil::Calibration cal;
+            if (cal.load_for(out_path.c_str())) {
+                cal.rebuild<oil::Oil_run::record>(out_path.c_str());
+                cal.save();
+            }
+            std::cout << res.read << " runs read from " << stores.size() << " stores, " << res.written
+                      << " written to: " << out_path << " ("
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s)"
+                      << std::endl;
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what();
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "archive") == 0) {
+        // archive [all/restore]: seals all but the newest segment's worth of runs, or all of them
+        typedef oil::Archive<oil::Oil_run::record> archive;
+        if (argc > 3 || (argc == 3 && strcmp(*(argv + 2), "all") != 0 && strcmp(*(argv + 2), "restore") != 0)) {
+            std::cerr << "Usage: archive [all/restore]\n";
+            return 1;
+        }
+        struct stat info = {};
+        if (stat(dat_file_path.c_str(), &info) == -1) {
+            std::cerr << "Data file non-existent or not in expected location.\n";
+            return 1;
+        }
+        try {
+            oil::Name_table names; // converts a store written by an older version before it is sealed
+            names.open<oil::Oil_run::record>(dat_file_path.c_str());
+            if (argc == 3 && strcmp(*(argv + 2), "restore") == 0) {
+                std::cout << archive::restore(dat_file_path.c_str()) << " runs restored to: " << dat_file_path
+                          << std::endl;
+                return 0;
+            }
+            size_t sealed = archive::seal(dat_file_path.c_str(), argc == 3 ? 0 : archive::segment_runs);
+            struct stat seg = {};
+            stat(archive::sidecar_path(dat_file_path.c_str()).c_str(), &seg);
+            uint64_t archived = archive::count(dat_file_path.c_str());
+            std::cout << sealed << " runs sealed; " << archived << " archived runs take " << seg.st_size
+                      << " bytes (" << archived*sizeof(oil::Oil_run::record) << " as a .dat file)" << std::endl;
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what();
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "sweep") == 0) {
+        const char *usage = "Usage: sweep <capture> <frequency[,frequency...]> [skip=<samples>[,...]] "
+                            "[filter=<[kind:]cutoff/none>[,...]] [hyst=<SDs>[,...]] "
+                            "[baseline=<mean/median/minmax>:<seconds>/none[,...]] [float] [csv]\n";
+        if (argc < 4) {
+            std::cerr << usage;
+            return 1;
+        }
+        auto split = [](const char *list) { // comma-separated values
+            std::vector<std::string> values;
+            std::string item;
+            for (const char *ptr = list; ; ++ptr) {
+                if (*ptr == ',' || *ptr == '\0') {
+                    values.push_back(item);
+                    item.clear();
+                    if (*ptr == '\0') {
+                        break;
+                    }
+                }
+                else {
+                    item.push_back(*ptr);
+                }
+            }
+            return values;
+        };
+        std::vector<double> freqs, hysteresis = {0};
+        std::vector<size_t> skips = {0};
+        std::vector<std::pair<oil::filter_kind, double>> filters = {{oil::filter_kind::none, 0}};
+        std::vector<std::pair<oil::baseline_kind, double>> baselines = {{oil::baseline_kind::none, 0}};
+        bool csv = false;
+        try {
+            for (const std::string &value : split(*(argv + 3))) {
+                freqs.push_back(std::stod(value));
+                if (!(freqs.back() > 0)) {
+                    throw std::invalid_argument("The frequencies must be positive.\n");
+                }
+            }
+            for (int i = 4; i < argc; ++i) {
+                if (strncmp(*(argv + i), "skip=", 5) == 0) {
+                    skips.clear();
+                    for (const std::string &value : split(*(argv + i) + 5)) {
+                        if (!oil::is_numeric(value)) {
+                            throw std::invalid_argument("skip takes whole numbers of samples.\n");
+                        }
+                        skips.push_back(std::stoul(value));
+                    }
+                }
+                else if (strncmp(*(argv + i), "filter=", 7) == 0) {
+                    filters.clear();
+                    for (const std::string &spec : split(*(argv + i) + 7)) {
+                        if (spec == "none") {
+                            filters.emplace_back(oil::filter_kind::none, 0);
+                            continue;
+                        }
+                        std::string::size_type colon = spec.find(':');
+                        oil::filter_kind kind = oil::Prefilter::kind_of(colon == std::string::npos ? "auto" :
+                                                                        spec.substr(0, colon));
+                        double cutoff = std::stod(spec.substr(colon == std::string::npos ? 0 : colon + 1));
+                        oil::Prefilter check(kind, cutoff); // throws for a cutoff that is not positive
+                        filters.emplace_back(kind, cutoff);
+                    }
+                }
+                else if (strncmp(*(argv + i), "hyst=", 5) == 0) {
+                    hysteresis.clear();
+                    for (const std::string &value : split(*(argv + i) + 5)) {
+                        hysteresis.push_back(std::stod(value));
+                    }
+                }
+                else if (strncmp(*(argv + i), "baseline=", 9) == 0) {
+                    baselines.clear();
+                    for (const std::string &spec : split(*(argv + i) + 9)) {
+                        if (!parse_baseline(spec)) {
+                            std::cerr << usage;
+                            return 1;
+                        }
+                        baselines.emplace_back(baseline, baseline_window);
+                    }
+                }
+                else if (strcmp(*(argv + i), "float") == 0) {
+                    float_samples = true;
+                }
+                else if (strcmp(*(argv + i), "csv") == 0) {
+                    csv = true;
+                }
+                else {
+                    std::cerr << usage;
+                    return 1;
+                }
+            }
+        }
+        catch (const std::exception &exception) { // std::stod() and std::stoul() throw for what is not a number
+            std::cerr << "Invalid sweep values: " << exception.what() << '\n' << usage;
+            return 1;
+        }
+        try {
+            oil::Sweep sweep(*(argv + 2), freqs.front());
+            sweep.use_float_samples(float_samples);
+            std::vector<oil::Sweep::result> results = sweep.run(oil::Sweep::grid(freqs, skips, filters, hysteresis,
+                                                                                   baselines));
+            if (!csv) {
+                printf("%zu samples in %s, %zu settings:\n\n", sweep.samples(), *(argv + 2), results.size());
+            }
+            oil::Sweep::print(stdout, results, csv);
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+    else if(strcmp(*(argv + 1), "batch") == 0) {
+        // batch <frequency> [ow/app/dn] [float] [captures...], then batch resume [retry], batch status or batch clear
+        typedef oil::Journal<oil::Oil_run::record> journal_type;
+        const char *usage = "Usage: batch <frequency> [ow/app/dn] [float] [captures...] | batch resume [retry] | "
+                            "batch status | batch clear\n";
+        std::string journal_path = prog_files_path + "Batch.journal";
+        journal_type journal;
+        std::string action = argc > 2 ? *(argv + 2) : "";
+        if (action == "clear") { // before the journal is read, so that a corrupt one can be cleared too
+            std::remove(journal_path.c_str());
+            return 0;
+        }
+        bool have_journal;
+        try {
+            have_journal = journal.load(journal_path);
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        if (action == "status") {
+            if (!have_journal) {
+                std::cout << "No batch has been started.\n";
+                return 0;
+            }
+            for (const journal_type::job &job : journal.all_jobs()) {
+                if (job.state != journal_type::committed) {
+                    std::cout << journal_type::name_of(job.state) << "  " << job.path
+                              << (job.reason.empty() ? "" : ": ") << job.reason << '\n';
+                }
+            }
+            std::cout << journal.all_jobs().size() << " captures at " << journal.frequency() << " Hz ("
+                      << journal.mode() << (journal.float_samples() ? ", float" : "") << "): "
+                      << journal.count(journal_type::committed) << " committed, " << journal.count(journal_type::failed)
+                      << " failed, " << journal.pending().size() << " left." << std::endl;
+            return 0;
+        }
+        bool resume = action == "resume";
+        double freq;
+        std::string mode = "DN";
+        bool from_catalog;
+        if (resume) {
+            if (!have_journal) {
+                std::cerr << "There is no batch to resume.\n";
+                return 1;
+            }
+            if (argc > 3 && strcmp(*(argv + 3), "retry") == 0) {
+                std::cout << journal.requeue_failed() << " failed captures queued again." << std::endl;
+            }
+            else if (argc > 3) {
+                std::cerr << usage;
+                return 1;
+            }
+            freq = journal.frequency();
+            mode = journal.mode();
+            from_catalog = journal.from_catalog();
+            float_samples = journal.float_samples();
+            if (from_catalog) {
+                load_catalog();
+            }
+        }
+        else {
+            if (argc < 3 || !oil::is_numeric(*(argv + 2))) {
+                std::cerr << usage;
+                return 1;
+            }
+            if (have_journal && !journal.pending().empty()) {
+                std::cerr << "The last batch did not finish (" << journal.pending().size() << " captures left). "
+                          << "Run \"batch resume\" to finish it or \"batch clear\" to abandon it.\n";
+                return 1;
+            }
+            freq = (double) strtol(*(argv + 2), nullptr, 10);
+            int first = 3;
+            if (argc > 3) {
+                std::string arg(*(argv + 3));
+                oil::string_upper(arg);
+                if (arg == "OW" || arg == "APP" || arg == "DN") {
+                    mode = arg;
+                    ++first;
+                }
+            }
+            if (argc > first && strcmp(*(argv + first), "float") == 0) {
+                float_samples = true;
+                ++first;
+            }
+            std::vector<std::string> captures;
+            for (int i = first; i < argc; ++i) { // absolute, so that the batch can be resumed from anywhere
+                captures.push_back(fs::absolute(*(argv + i)).lexically_normal().string());
+            }
+            from_catalog = captures.empty(); // the whole backlog of unprocessed captures, oldest first
+            if (from_catalog) {
+                load_catalog();
+                catalog.rescan();
+                for (const oil::Catalog::file_entry *file : catalog.backlog()) {
+                    captures.push_back(catalog.path_of(*file));
+                }
+                catalog.save();
+                if (captures.empty()) {
+                    std::cerr << "No unprocessed captures found in the catalogued directories.\n";
+                    return 1;
+                }
+            }
+            try {
+                journal.start(journal_path, freq, mode, from_catalog, float_samples, captures);
+            }
+            catch (const std::exception &exception) {
+                std::cerr << exception.what() << '\n';
+                return 1;
+            }
+        }
+        oil::Oil_run base;
+        struct stat single_info = {};
+        bool single = stat(single_run_param_path.c_str(), &single_info) == 0;
+        try {
+            base.set_constants_path(constants);
+            base.read_constants();
+            base.read_graph_vars(def_graph_vars_path.c_str());
+            if (single) {
+                base.read_single_run_parameters(single_run_param_path.c_str());
+            }
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            return 1;
+        }
+        base.use_float_samples(float_samples);
+        int failures = 0;
+        size_t committed = 0;
+        auto commit = [&](size_t index, oil::Oil_run &run) {
+            const std::string &path = journal.all_jobs()[index].path;
+            if (run.write_data(dat_file_path.c_str(), mode.c_str()) == 3) {
+                std::cout << "    not written: a run named " << run[0] << " already exists" << std::endl;
+                journal.mark_committed(index, "not written: a run of this name already exists");
+            }
+            else {
+                journal.mark_committed(index);
+            }
+            ++committed;
+            if (from_catalog) {
+                catalog.mark(path, oil::Catalog::processed);
+            }
+        };
+        auto fail = [&](size_t index, const char *stage, const char *reason) {
+            const std::string &path = journal.all_jobs()[index].path;
+            std::cerr << path << ": " << reason << '\n';
+            journal.mark_failed(index, std::string(stage) + ": " + reason);
+            ++failures;
+            if (from_catalog) { // left out of the backlog until the capture changes
+                catalog.mark(path, oil::Catalog::quarantined);
+            }
+        };
+        try {
+            std::vector<size_t> to_read;
+            for (size_t index : journal.pending()) {
+                const journal_type::job &job = journal.all_jobs()[index];
+                if (job.state != journal_type::analysed) {
+                    to_read.push_back(index);
+                    continue;
+                }
+                // analysed before the batch was interrupted, so only (perhaps) left to commit
+                std::string name = oil::io::capture_stem(job.path);
+                try {
+                    if (journal_type::in_store(dat_file_path.c_str(), name, job.result)) {
+                        journal.mark_committed(index, "written before the batch was interrupted");
+                        ++committed;
+                        if (from_catalog) {
+                            catalog.mark(job.path, oil::Catalog::processed);
+                        }
+                        continue;
+                    }
+                    oil::Oil_run run = base;
+                    run.set_name(name);
+                    job.result >> run;
+                    commit(index, run);
+                }
+                catch (const journal_type::JournalWriteError &) {
+                    throw;
+                }
+                catch (const std::exception &exception) {
+                    fail(index, "committing", exception.what());
+                }
+            }
+            std::vector<std::string> paths;
+            for (size_t index : to_read) {
+                paths.push_back(journal.all_jobs()[index].path);
+            }
+            oil::Arena buffers(16 << 20, true); // reused by every capture, backed by huge pages where available
+            oil::io::Prefetcher prefetcher(paths); // the next few captures are read while this one is analysed
+            oil::io::Prefetcher::capture cap;
+            for (size_t next = 0; prefetcher.next(cap); ++next) {
+                size_t index = to_read[next];
+                const char *stage = "parsing";
+                try {
+                    oil::Oil_run run = base;
+                    run.set_name(oil::io::capture_stem(cap.path));
+                    run.use_arena(&buffers);
+                    if (cap.error == 0) {
+                        run.use_capture_bytes(cap.bytes.data(), cap.bytes.size());
+                    }
+                    double *T = run.get_T(cap.path.c_str(), -1, freq);
+                    journal.mark_parsed(index);
+                    stage = "analysing";
+                    std::cout << run[0] << ": T = " << *T << " +/- " << *(T + 1) << " s";
+                    free(T);
+                    double *visc = single ? run.calc_visc_from_T() : run.calc_visc_from_grad();
+                    std::cout << ", viscosity = " << *visc << " +/- " << *(visc + 1) << oil::Oil_run::visc_units()
+                              << std::endl;
+                    free(visc);
+                    journal.mark_analysed(index, run.get_data_struct_cp());
+                    stage = "committing";
+                    commit(index, run);
+                }
+                catch (const journal_type::JournalWriteError &) {
+                    throw;
+                }
+                catch (const std::exception &exception) {
+                    fail(index, stage, exception.what());
+                }
+            }
+        }
+        catch (const std::exception &exception) { // the journal could not be written, so the batch cannot go on
+            std::cerr << exception.what() << '\n';
+            if (from_catalog) {
+                catalog.save();
+            }
+            return 1;
+        }
+        if (from_catalog) {
+            catalog.save();
+        }
+        if (failures > 0) {
+            std::cerr << committed << " captures committed, " << failures << " failed (see \"batch status\").\n";
+        }
+        return failures == 0 ? 0 : 1;
+    }
+    else if(strcmp(*(argv + 1), "stream") == 0) {
+        // stream <frequency> [-/<fifo>] [name=<run name>] [ow/app/dn] [float] [robust] [baseline=<kind>:<s>]
+        // [profile[=<path>]]: a capture piped in as it is taken
+        const char *usage = "Usage: stream <frequency> [-/<fifo>] [name=<run name>] [ow/app/dn] [float] [robust] "
+                            "[baseline=<mean/median/minmax>:<seconds>] [profile[=<path>]]\n";
+        if (argc < 3 || !oil::is_numeric(*(argv + 2))) {
+            std::cerr << usage;
+            return 1;
+        }
+        double freq = (double) strtol(*(argv + 2), nullptr, 10);
+        std::string source = "-";
+        std::string name;
+        std::string mode = "DN";
+        for (int i = 3; i < argc; ++i) {
+            std::string arg(*(argv + i));
+            std::string upper(arg);
+            oil::string_upper(upper);
+            if (arg.rfind("name=", 0) == 0 && arg.size() > 5) {
+                name = arg.substr(5);
+            }
+            else if (upper == "OW" || upper == "APP" || upper == "DN") {
+                mode = upper;
+            }
+            else if (arg == "float") {
+                float_samples = true;
+            }
+            else if (arg == "robust") {
+                robust = true;
+            }
+            else if (arg == "profile" || arg.rfind("profile=", 0) == 0) {
+                profile = true;
+                profile_path = arg.size() > 8 ? arg.substr(8) : "";
+            }
+            else if (arg.rfind("baseline=", 0) == 0) {
+                if (!parse_baseline(arg.substr(9))) {
+                    return 1;
+                }
+            }
+            else if (i == 3 && (arg == "-" || oil::io::is_stream(arg.c_str()))) {
+                source = arg;
+            }
+            else {
+                std::cerr << usage;
+                return 1;
+            }
+        }
+        if (name.empty()) { // named after when it was taken
+            char stamp[32];
+            std::time_t now = std::time(nullptr);
+            std::strftime(stamp, sizeof(stamp), "stream_%Y%m%d_%H%M%S", std::localtime(&now));
+            name = stamp;
+        }
+        start_profile();
+        try {
+            oil::Oil_run run;
+            run.set_name(name);
+            run.set_constants_path(constants);
+            run.read_constants();
+            run.read_graph_vars(def_graph_vars_path.c_str());
+            struct stat single_info = {};
+            bool single = stat(single_run_param_path.c_str(), &single_info) == 0;
+            if (single) {
+                run.read_single_run_parameters(single_run_param_path.c_str());
+            }
+            run.use_float_samples(float_samples);
+            run.use_robust_intervals(robust);
+            run.set_baseline(baseline, baseline_window);
+            double *T = run.get_T(source.c_str(), -1, freq);
+            std::cout << run[0] << ": T = " << *T << " +/- " << *(T + 1) << " s";
+            if (robust) {
+                std::cout << " (" << interval_note(run) << ")";
+            }
+            free(T);
+            double *visc = single ? run.calc_visc_from_T() : run.calc_visc_from_grad();
+            std::cout << ", viscosity = " << *visc << " +/- " << *(visc + 1) << oil::Oil_run::visc_units()
+                      << std::endl;
+            free(visc);
+            if (run.write_data(dat_file_path.c_str(), mode.c_str()) == 3) {
+                std::cout << "    not written: a run named " << run[0] << " already exists" << std::endl;
+            }
+        }
+        catch (const std::exception &exception) {
+            std::cerr << exception.what() << '\n';
+            finish_profile();
+            return 1;
+        }
+        finish_profile();
+        return 0;
+    }
+    if (argc > 3) {
+        for (int i = 3; i < argc; ++i) {
+            if (strcmp(*(argv + i), "show") == 0) {
+                show = true;
+            }
+            else if (strcmp(*(argv + i), "boot") == 0) {
+                boot_resamples = 10000;
+            }
+            else if (strncmp(*(argv + i), "boot=", 5) == 0 && oil::is_numeric(*(argv + i) + 5) &&
+                     *(*(argv + i) + 5) != 0) {
+                boot_resamples = strtoul(*(argv + i) + 5, nullptr, 10);
+            }
+            else if (strncmp(*(argv + i), "filter=", 7) == 0) { // filter=<cutoff> or filter=<kind>:<cutoff>
+                std::string spec(*(argv + i) + 7);
+                std::string::size_type colon = spec.find(':');
+                try {
+                    filter = oil::Prefilter::kind_of(colon == std::string::npos ? "auto" : spec.substr(0, colon));
+                }
+                catch (const std::invalid_argument &exception) {
+                    std::cerr << exception.what();
+                    exit(EXIT_FAILURE);
+                }
+                filter_cutoff = strtod(spec.c_str() + (colon == std::string::npos ? 0 : colon + 1), nullptr);
+                if (filter != oil::filter_kind::none && !(filter_cutoff > 0)) {
+                    fprintf(stderr, "The filter cutoff must be a positive frequency in Hz.\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if (strncmp(*(argv + i), "peaks=", 6) == 0 && *(*(argv + i) + 6) != 0) { // .csv, or binary
+                peaks_path = *(argv + i) + 6;
+            }
+            else if (strcmp(*(argv + i), "float") == 0) {
+                float_samples = true;
+            }
+            else if (strcmp(*(argv + i), "robust") == 0) {
+                robust = true;
+            }
+            else if (strcmp(*(argv + i), "profile") == 0 || strncmp(*(argv + i), "profile=", 8) == 0) {
+                profile = true;
+                profile_path = *(*(argv + i) + 7) == '=' ? *(argv + i) + 8 : "";
+            }
+            else if (strncmp(*(argv + i), "baseline=", 9) == 0) { // baseline=<mean/median/minmax>:<seconds>
+                if (!parse_baseline(*(argv + i) + 9)) {
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else {
+                fprintf(stderr, "Invalid argument provided: \"%s\". Only \"show\", \"boot[=resamples]\", "
+                                "\"filter=[auto/ma/fir/iir/poly:]<cutoff>\", \"peaks=<path>\", \"float\", "
+                                "\"robust\", \"baseline=<mean/median/minmax>:<seconds>\" and "
+                                "\"profile[=<path>]\" may follow the frequency.\n", *(argv + i));
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
     char *freq_c = *(argv + 2);
     if (!oil::is_numeric(freq_c)) {
         fprintf(stderr, "The frequency that was input, %s, is not numeric.\n", freq_c);
         exit(EXIT_FAILURE);
     }
     unsigned long int freq = strtol(freq_c, nullptr, 10);
+    start_profile();
     struct stat buff = {};
     char *file_path;
     std::string latest_file;
     if (strcmp(*(argv + 1), "auto") == 0) {
-        std::string downloads(home_path);
-#ifndef _WIN32
-        downloads.append("/Downloads");
-#else
-        downloads.append("\\Downloads");
-#endif
-        if (stat(downloads.c_str(), &buff) == -1) {
-            fprintf(stderr, "\"Downloads\" folder does not exist. Please run program again and specify full "
-                            "file path.\n");
+        load_catalog();
+        if (catalog.directories().empty()) {
+            fprintf(stderr, "\"Downloads\" folder does not exist and no capture directories have been catalogued. "
+                            "Please run program again and specify full file path.\n");
             exit(EXIT_FAILURE);
         }
-        struct dirent *entry;
-        DIR *dir = opendir(downloads.c_str());
-        if (readdir(dir) == nullptr) {
-            fprintf(stderr, "Downloads directory empty. Program exiting...\n");
+        catalog.rescan();
+        latest_file = catalog.newest_unprocessed();
+        catalog.save();
+        if (latest_file.empty()) {
+            fprintf(stderr, "No unprocessed captures found in the catalogued directories. Program exiting...\n");
             exit(EXIT_FAILURE);
         }
-        readdir(dir); // the two initial calls to readdir() read the "." and ".." directories
-        entry = readdir(dir);
-        latest_file = entry->d_name;
-        fs::file_time_type time;
-        fs::file_time_type new_time;
-        std::string not1 = ".";
-        std::string not2 = "..";
-        std::string new_file;
-        std::string full_latest_file;
-        std::string full_new_file;
-        while ((entry = readdir(dir)) != nullptr) {
-            new_file = entry->d_name;
-            size_t size = new_file.size();
-            if (new_file.rfind(".csv", size - 4) != std::string::npos && new_file != not1 && new_file != not2) {
-                if (latest_file.rfind(".csv", latest_file.size() - 4) ==  std::string::npos) {
-                    latest_file = new_file;
-                }
-                full_latest_file.clear();
-                full_latest_file.append(downloads);
-#ifndef _WIN32
-                full_latest_file.append("/");
-#else
-                full_latest_file.append("\\");
-#endif
-                full_new_file = full_latest_file;
-                full_latest_file.append(latest_file);
-                full_new_file.append(new_file);
-                time = fs::last_write_time(full_latest_file);
-                new_time = fs::last_write_time(full_new_file);
-                if (time <= new_time) {
-                    latest_file = std::string(new_file);
-                }
-            }
-        }
-#ifndef _WIN32
-        latest_file.insert(0, home_path + "/Downloads/");
-#else
-        latest_file.insert(0, home_path + "\\Downloads\\");
-#endif
         file_path = (char *) malloc(latest_file.size() + 1);
         memset(file_path, 0, latest_file.size() + 1);
         strcpy(file_path, latest_file.c_str());
@@ -166,8 +972,8 @@ int main(int argc, char **argv) {
         }
         latest_file = file_path;
     }
-    if (latest_file.rfind(".csv", latest_file.size() - 4) == std::string::npos) {
-        fprintf(stderr, "The file given/found is not a .csv file. Program aborting.\n");
+    if (!oil::io::is_capture_path(latest_file)) {
+        fprintf(stderr, "The file given/found is not a .csv, .csv.gz or .csv.zst file. Program aborting.\n");
         return 1;
     }
     free(file_path);
@@ -177,14 +983,7 @@ int main(int argc, char **argv) {
     std::cin >> name;
     oil::clear_cin();
     if (name == "file" || name == "FILE") {
-        std::string::size_type dot_pos = latest_file.rfind('.');
-        std::string::size_type slash_pos;
-#ifndef _WIN32
-        slash_pos = latest_file.rfind('/');
-#else
-        slash_pos = latest_file.rfind('\\');
-#endif
-        name = latest_file.substr(slash_pos + 1, dot_pos - slash_pos - 1);
+        name = oil::io::capture_stem(latest_file);
     }
     run.set_name(name);
     std::string answer;
@@ -254,17 +1053,36 @@ int main(int argc, char **argv) {
             run.read_single_run_parameters(single_run_param_path.c_str());
         }
     }
-    std::string csv_file_path = prog_files_path + run[0] + ".csv";
+    std::string figure_path = home_path + figures;
+    run.set_prefilter(filter, filter_cutoff);
+    run.set_baseline(baseline, baseline_window);
+    run.use_float_samples(float_samples);
+    run.use_robust_intervals(robust);
     double *T;
     if (show) {
-        T = run.get_T(latest_file.c_str(), 9, (double) freq, csv_file_path.c_str());
+        oil::make_dir(figure_path);
+        figure_path.append(run[0]);
+        figure_path.append(".png");
+        T = run.get_T(latest_file.c_str(), -1, (double) freq, figure_path.c_str(), boot_resamples);
+        std::cout << "\nFigure saved to: " << figure_path << std::endl;
     }
     else {
-        T = run.get_T(latest_file.c_str(), 9, (double) freq);
+        T = run.get_T(latest_file.c_str(), -1, (double) freq, nullptr, boot_resamples);
     }
     std::cout << "\nMaxima times and voltages:\n" << std::endl;
     run.display_V_t_map();
+    if (peaks_path != nullptr) {
+        run.get_peaks().write(peaks_path);
+        std::cout << "\nPeak table written to: " << peaks_path << std::endl;
+    }
     std::cout << "\nAverage time period: " << *T << " +/- " << *(T + 1) << " seconds\n" << std::endl;
+    if (robust) {
+        std::cout << "Robust intervals: " << interval_note(run) << "\n" << std::endl;
+    }
+    if (boot_resamples > 0) {
+        std::cout << "95% block-bootstrap confidence interval for the time period (" << boot_resamples
+                  << " resamples): [" << *(T + 2) << ", " << *(T + 3) << "] seconds\n" << std::endl;
+    }
     free(T);
     double *visc_g = run.calc_visc_from_grad();
     std::cout << "The viscosity calculated from the gradient of the graph is: " << *visc_g << " +/- " << *(visc_g + 1)
@@ -289,24 +1107,12 @@ int main(int argc, char **argv) {
         oil::string_upper(option);
     }
     run.write_data(dat_file_path.c_str(), option.c_str());
-    if (show) {
-        std::string cmd;
-        cmd.append(home_path); cmd.append(end); cmd.append(" "); cmd.append(csv_file_path); cmd.append(" remove");
-        std::string test_str(home_path);
-        test_str.append(end);
-        struct stat test = {};
-        if (stat(test_str.c_str(), &test) == -1) {
-#ifndef _WIN32
-            fprintf(stderr, "\nThe \"Oil_Reader\" file is either non existent, or not where it needs to be: \n%s\n\n",
-                    test_str.c_str());
-#else
-            fprintf(stderr, "\nThe \"Oil_Reader.exe\" file is either non existent, or not where it needs to be: "
-                            "\n%s\n\n", test_str.c_str());
-#endif
-            exit(EXIT_FAILURE);
-        }
-        std::cout << "\nOil_Reader program found. Plotting graph...\n" << std::endl;
-        system(cmd.c_str());
+    if (!catalog_loaded) {
+        load_catalog();
+    }
+    if (catalog.mark(fs::absolute(latest_file).lexically_normal().string(), oil::Catalog::processed)) {
+        catalog.save();
     }
+    finish_profile();
     return 0;
 }
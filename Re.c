@@ -1,28 +1,13 @@
-#ifndef _USE_MATH_DEFINES
-#define _USE_MATH_DEFINES
-#endif
-
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <sys/stat.h>
 #include <errno.h>
-#include <math.h>
+
+#include "libexpv.h" /* build: see libexpv.h */
 
 #ifndef errno
 extern int errno;
 #endif
 
-#ifdef _WIN32
-#include <shlobj.h>
-#else
-#include <unistd.h>
-#include <pwd.h>
-#endif
-
-#define DAT_SIZE 192
-#define NAME_LEN 32
-
 static inline int isdigit_g(char ch) {
     return ch <= 57 && ch >= 48;
 }
@@ -46,43 +31,6 @@ int is_numeric(const char *str) {
     return 1;
 }
 
-char *get_home_path() {
-#ifdef _WIN32
-    char *home_path_c = (char *) malloc(MAX_PATH);
-        HRESULT result = SHGetFolderPathA(NULL, CSIDL_PROFILE, NULL, SHGFP_TYPE_CURRENT, home_path_c);
-        if (result != S_OK) {
-            return nullptr;
-        }
-        home_path_c = (char *) realloc(home_path_c, strlen_c(home_path_c) + 1);
-        return home_path_c;
-#else
-    struct passwd *pwd;
-    uid_t uid = getuid();
-    pwd = getpwuid(uid);
-    char *home_path_c = pwd->pw_dir;
-    char *retval;
-    retval = (char *) malloc(sizeof(char) * strlen(home_path_c) + 1);
-    memset(retval, '\0', strlen(home_path_c) + 1);
-    strcpy(retval, home_path_c);
-    return retval;
-#endif
-}
-
-double *calc_Re(double rho, double rho_err, double a, double a_err, double b, double b_err, double eta, double eta_err,
-               double T, double T_err) {
-    double Re = (rho*M_PI*b*(a - b))/(2*eta*T);
-    double a_minus_b_err = sqrt(a_err*a_err + b_err*b_err);
-    double Re_err = Re*sqrt(pow(rho_err/rho, 2) + pow(b_err/b, 2) + pow(a_minus_b_err/(a - b), 2) + pow(eta_err/eta, 2)
-                            + pow(T_err/T, 2));
-    double *retval = (double *) malloc(2*sizeof(double));
-    if (retval == NULL) {
-        return retval;
-    }
-    *retval = Re;
-    *(retval + 1) = Re_err;
-    return retval;
-}
-
 int main(int argc, char **argv) {
     if (argc != 2) {
         errno = EINVAL;
@@ -102,69 +50,36 @@ int main(int argc, char **argv) {
         fprintf(stderr, "The inputted density could not be converted to a decimal number (a double).\n");
         return 1;
     }
-    char *rest;
-#ifdef _WIN32
-    rest = "\\Exp_V_Program_Files\\All_Runs.dat";
-#else
-    rest = "/Exp_V_Program_Files/All_Runs.dat";
-#endif
-    char *dat_path = get_home_path();
-    dat_path = (char *) realloc(dat_path, strlen(dat_path) + strlen(rest) + 1);
-    strcat(dat_path, rest);
-    struct stat buff;
-    if (stat(dat_path, &buff) == -1 || S_ISDIR(buff.st_mode)) {
+    expv_store *store = expv_store_open(NULL);
+    if (store == NULL) {
         errno = EIO;
         perror("An error occurred");
-        fprintf(stderr, "Either the .dat file does not exist, is not in the right place, or is a directory.\n");
+        fprintf(stderr, "%s\n", expv_last_error());
         return 1;
     }
-    if (buff.st_size == 0) {
+    size_t num_structs;
+    const expv_record *runs = expv_store_records(store, &num_structs);
+    if (num_structs == 0) {
         errno = EINVAL;
         perror("An error occurred");
         fprintf(stderr, "The .dat file is empty.\n");
+        expv_store_close(store);
         return 1;
     }
-    if (buff.st_size % DAT_SIZE) {
-        perror("An error occurred");
-        fprintf(stderr, "The .dat size does not contain an integer multiple of Oil_run structs.\n");
-        return 1;
-    }
-    size_t num_structs = buff.st_size / DAT_SIZE;
-    long int offset;
-    char name[32];
-    double a;
-    double a_err;
-    double b;
-    double b_err;
-    double T;
-    double T_err;
-    double visc;
-    double v_err;
-    double *Re = NULL;
-    FILE *fp = fopen(dat_path, "r+");
-    for (int i = 0; i < num_structs; ++i) {
-        offset = i*DAT_SIZE;
-        fseek(fp, offset, SEEK_SET);
-        fread(name, 32, 1, fp);
-        fread(&a, sizeof(double), 1, fp);
-        fread(&a_err, sizeof(double), 1, fp);
-        fread(&b, sizeof(double), 1, fp);
-        fread(&b_err, sizeof(double), 1, fp);
-        fseek(fp, 10*sizeof(double), SEEK_CUR);
-        fread(&T, sizeof(double), 1, fp);
-        fread(&T_err, sizeof(double), 1, fp);
-        fseek(fp, 2*sizeof(double), SEEK_CUR);
-        fread(&visc, sizeof(double), 1, fp);
-        fread(&v_err, sizeof(double), 1, fp);
-        Re = calc_Re(rho, 0, a, a_err, b, b_err, visc, v_err, T, T_err);
-        if (Re == NULL) {
-            return 1;
+    double Re;
+    double Re_err;
+    for (size_t i = 0; i < num_structs; ++i) {
+        const char *name = expv_store_name(store, runs[i].name_id);
+        if (name == NULL) {
+            name = "?";
+        }
+        if (expv_reynolds(runs + i, rho, 0, &Re, &Re_err) == -1) {
+            fprintf(stderr, "\nFor the Oil run with name: %s, %s\n", name, expv_last_error());
+            continue;
         }
-        printf("\nFor the Oil run with name: %s, Reynolds number is: %lf +/- %lf\n", name, *Re, *(Re + 1));
-        free(Re);
+        printf("\nFor the Oil run with name: %s, Reynolds number is: %lf +/- %lf\n", name, Re, Re_err);
     }
     printf("\n");
-    fclose(fp);
-    free(dat_path);
+    expv_store_close(store);
     return 0;
 }
@@ -11,6 +11,41 @@ class FileFormatError(Exception):
     """Raised when one or more lines of the csv file do not match the expected format."""
 
 
+def is_number(text):
+    try:
+        float(text)
+    except ValueError:
+        return False
+    return True
+
+
+def save_figure(fig, name):
+    exp_v = f"{home}/Exp_V_Figures"
+    if not os.path.exists(exp_v):
+        os.mkdir(exp_v)
+    fig.savefig(f"{exp_v}/{name}.jpeg", dpi=200)
+    print(f"\nFigure saved to: {exp_v}/{name}.jpeg\n")
+
+
+def plot_capture(capture, freq):
+    """Analyses a capture through libexpv and plots its samples and maxima, with no intermediate .csv file."""
+    import expv
+    run = expv.Run()
+    T, T_err = run.analyse(capture, freq)
+    times, volts = run.samples()
+    max_times, max_volts = run.maxima()
+    name = os.path.basename(capture).split(".")[0]
+    fig = plt.figure(num="Data", figsize=(8, 4.5), dpi=170)
+    axes = plt.axes()
+    axes.plot(times, volts)
+    axes.plot(max_times, max_volts, "o", markersize=3)
+    axes.set_title(f"Data for {name} (T = {T:.4g} +/- {T_err:.2g} s)")
+    axes.set_xlabel("Time (s)")
+    axes.set_ylabel("Voltage (V)")
+    plt.show()
+    save_figure(fig, name)
+
+
 def main():
     argc = len(sys.argv)
     if argc < 2:
@@ -18,6 +53,9 @@ def main():
     elif argc > 3:
         raise ValueError("Too many arguments provided.")
     remove = False
+    if argc == 3 and is_number(sys.argv[2]):
+        plot_capture(sys.argv[1], float(sys.argv[2]))
+        return
     if argc == 3:
         if sys.argv[2] != "remove":
             raise ValueError("If a 3rd command-line argument is provided, it can only be \"remove\" (for removing the "
@@ -43,13 +81,9 @@ def main():
     axes.set_xlabel("Time (s)")
     axes.set_ylabel("Voltage (V)")
     plt.show()
-    exp_v = f"{home}/Exp_V_Figures"
-    if not os.path.exists(exp_v):
-        os.mkdir(exp_v)
-    fig.savefig(f"{exp_v}/{name}.jpeg", dpi=200)
+    save_figure(fig, name)
     if remove:
         os.remove(path=file)
-    print(f"\nFigure saved to: {exp_v}/{name}.jpeg\n")
 
 
 if __name__ == "__main__":
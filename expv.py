@@ -0,0 +1,210 @@
+"""ctypes bindings to libexpv (see libexpv.h for how to build it).
+
+The sample, maxima and record arrays are numpy views of the library's own buffers, not copies: those of a Run are
+replaced by its next analyse(), and those of a Store stay valid while the Store is open.
+"""
+import ctypes
+import os.path
+import numpy as np
+
+_dir = os.path.dirname(os.path.abspath(__file__))
+_lib = ctypes.CDLL(os.environ.get("EXPV_LIB", os.path.join(_dir, "libexpv.so")))
+
+_c_double_p = ctypes.POINTER(ctypes.c_double)
+
+RECORD_FIELDS = ["a", "a_err", "b", "b_err", "drum", "drum_err", "MT_v_l_slope", "MT_v_l_slope_err", "intercept",
+                 "intercept_err", "k", "k_err", "mass", "mass_err", "T", "T_err", "submergence", "sub_err",
+                 "viscosity", "visc_err"]
+record_dtype = np.dtype([("name_id", "<u4"), ("reserved", "<u4")] + [(field, "<f8") for field in RECORD_FIELDS])
+
+
+class ExpvRecord(ctypes.Structure):
+    _fields_ = [("name_id", ctypes.c_uint32), ("reserved", ctypes.c_uint32)] + \
+               [(field, ctypes.c_double) for field in RECORD_FIELDS]
+
+
+assert ctypes.sizeof(ExpvRecord) == record_dtype.itemsize == 168
+
+_lib.expv_abi_version.restype = ctypes.c_int
+_lib.expv_last_error.restype = ctypes.c_char_p
+_lib.expv_run_new.restype = ctypes.c_void_p
+_lib.expv_run_free.argtypes = [ctypes.c_void_p]
+_lib.expv_run_set_prefilter.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_double]
+_lib.expv_run_use_float_samples.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.expv_run_analyse.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_double, _c_double_p,
+                                  _c_double_p]
+for _func in (_lib.expv_run_samples, _lib.expv_run_maxima):
+    _func.argtypes = [ctypes.c_void_p, ctypes.POINTER(_c_double_p), ctypes.POINTER(_c_double_p)]
+    _func.restype = ctypes.c_size_t
+_c_uint64_p = ctypes.POINTER(ctypes.c_uint64)
+_lib.expv_run_peaks.argtypes = [ctypes.c_void_p, ctypes.POINTER(_c_uint64_p)] + [ctypes.POINTER(_c_double_p)]*4
+_lib.expv_run_peaks.restype = ctypes.c_size_t
+_lib.expv_run_write_peaks.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.expv_store_open.argtypes = [ctypes.c_char_p]
+_lib.expv_store_open.restype = ctypes.c_void_p
+_lib.expv_store_close.argtypes = [ctypes.c_void_p]
+_lib.expv_store_records.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)]
+_lib.expv_store_records.restype = ctypes.c_void_p
+_lib.expv_store_name.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+_lib.expv_store_name.restype = ctypes.c_char_p
+_lib.expv_store_find.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.expv_store_find.restype = ctypes.c_int64
+_lib.expv_store_write.argtypes = [ctypes.c_char_p, ctypes.POINTER(ExpvRecord), ctypes.c_char_p, ctypes.c_char_p]
+_lib.expv_store_delete.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+_lib.expv_reynolds.argtypes = [ctypes.POINTER(ExpvRecord), ctypes.c_double, ctypes.c_double, _c_double_p, _c_double_p]
+
+if _lib.expv_abi_version() != 2:
+    raise ImportError("libexpv has an unexpected ABI version.")
+
+
+class ExpvError(Exception):
+    """Raised when a libexpv call fails, with the library's reason."""
+
+
+def _check(result):
+    if result == -1 or result is None:
+        raise ExpvError(_lib.expv_last_error().decode())
+    return result
+
+
+def _path(path):
+    return None if path is None else os.fsencode(path)
+
+
+def _view(ptr, n, owner):
+    if n == 0:
+        return np.empty(0, dtype=np.uint64 if ptr._type_ is ctypes.c_uint64 else np.float64)
+    arr = np.ctypeslib.as_array(ptr, shape=(n,))
+    arr.flags.writeable = False
+    return _Owned(arr, owner)
+
+
+class _Owned(np.ndarray):
+    """Read-only view that keeps the object owning its memory alive."""
+
+    def __new__(cls, arr, owner):
+        obj = arr.view(cls)
+        obj._owner = owner
+        return obj
+
+    def __array_finalize__(self, obj):
+        self._owner = getattr(obj, "_owner", None)
+
+
+class Run:
+    """Analysis of one capture at a time, as Oil_run::get_T() does it."""
+
+    def __init__(self):
+        self._handle = _check(_lib.expv_run_new())
+
+    def set_prefilter(self, kind, cutoff_hz):
+        _check(_lib.expv_run_set_prefilter(self._handle, kind.encode(), cutoff_hz))
+
+    def use_float_samples(self, on=True):
+        """Keeps the voltages as float while they are filtered and searched."""
+        _check(_lib.expv_run_use_float_samples(self._handle, int(on)))
+
+    def analyse(self, capture_path, freq, skip_lines=-1):
+        """Returns (T, T_err)."""
+        T, T_err = ctypes.c_double(), ctypes.c_double()
+        _check(_lib.expv_run_analyse(self._handle, _path(capture_path), skip_lines, freq, ctypes.byref(T),
+                                     ctypes.byref(T_err)))
+        return T.value, T_err.value
+
+    def _arrays(self, func):
+        times, volts = _c_double_p(), _c_double_p()
+        n = func(self._handle, ctypes.byref(times), ctypes.byref(volts))
+        return _view(times, n, self), _view(volts, n, self)
+
+    def samples(self):
+        """(times, volts) of the last capture analysed, after any pre-filter."""
+        return self._arrays(_lib.expv_run_samples)
+
+    def maxima(self):
+        """(times, volts) of the maxima used for T."""
+        return self._arrays(_lib.expv_run_maxima)
+
+    def peaks(self):
+        """The peak table of the last capture analysed, as a dict of arrays (see oilpeaks.h)."""
+        indices = _c_uint64_p()
+        columns = [_c_double_p() for _ in range(4)]
+        n = _lib.expv_run_peaks(self._handle, ctypes.byref(indices), *(ctypes.byref(col) for col in columns))
+        table = {"index": _view(indices, n, self)}
+        for name, col in zip(("time", "amplitude", "width", "prominence"), columns):
+            table[name] = _view(col, n, self)
+        return table
+
+    def write_peaks(self, path):
+        """Writes the peak table as CSV to a .csv path, and in its binary format otherwise."""
+        _check(_lib.expv_run_write_peaks(self._handle, os.fsencode(path)))
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            _lib.expv_run_free(self._handle)
+            self._handle = None
+
+
+class Store:
+    """Read-only view of a .dat file (~/Exp_V_Program_Files/All_Runs.dat by default) as a record_dtype array.
+
+    Runs carry a name_id rather than their name; name() and names() look names up in the store's name file.
+    The runs of a store with an archive (see "archive") are the archived runs followed by those of the .dat file.
+    """
+
+    def __init__(self, dat_path=None):
+        self._handle = _check(_lib.expv_store_open(_path(dat_path)))
+        count = ctypes.c_size_t()
+        ptr = _lib.expv_store_records(self._handle, ctypes.byref(count))
+        if count.value == 0:
+            self.records = np.empty(0, dtype=record_dtype)
+        else:
+            buffer = (ctypes.c_char*(count.value*record_dtype.itemsize)).from_address(ptr)
+            arr = np.frombuffer(buffer, dtype=record_dtype)
+            arr.flags.writeable = False  # mapped read-only
+            self.records = _Owned(arr, self)
+
+    def name(self, name_id):
+        return _check(_lib.expv_store_name(self._handle, int(name_id))).decode()
+
+    def names(self):
+        """The name of every record, in order."""
+        return [self.name(name_id) for name_id in self.records["name_id"]]
+
+    def find(self, name):
+        """The name_id of a name, or None if no run of the store has ever had it."""
+        name_id = _lib.expv_store_find(self._handle, name.encode())
+        return None if name_id == -1 else name_id
+
+    def close(self):
+        if getattr(self, "_handle", None):
+            _lib.expv_store_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+def write_run(record, name, mode="dn", dat_path=None):
+    """Adds a run (an ExpvRecord, or one element of a record_dtype array, whose name_id is ignored) to the store."""
+    if not isinstance(record, ExpvRecord):
+        record = ExpvRecord.from_buffer_copy(np.asarray(record, dtype=record_dtype).tobytes())
+    return _check(_lib.expv_store_write(_path(dat_path), ctypes.byref(record), name.encode(), mode.encode()))
+
+
+def delete_run(name, dat_path=None):
+    return _check(_lib.expv_store_delete(_path(dat_path), name.encode()))
+
+
+def reynolds(record, rho, rho_err=0.0):
+    """Returns (Re, Re_err) for a run."""
+    if not isinstance(record, ExpvRecord):
+        record = ExpvRecord.from_buffer_copy(np.asarray(record, dtype=record_dtype).tobytes())
+    Re, Re_err = ctypes.c_double(), ctypes.c_double()
+    _check(_lib.expv_reynolds(ctypes.byref(record), rho, rho_err, ctypes.byref(Re), ctypes.byref(Re_err)))
+    return Re.value, Re_err.value
@@ -0,0 +1,85 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+// Checks that get_T() gives the same T and T_err with the voltages kept as float (use_float_samples()) as with double,
+// for every prefilter, on a synthetic capture: a sine with a slow drift and Gaussian noise, written out as a scope
+// would write it. Build and run from the repository root:
+//     g++ -std=c++17 -O2 -pthread -o float_check float_check.cpp && ./float_check
+// It prints a line per filter and exits with 1 if any of them disagrees by more than the tolerances below.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <string>
+#include <filesystem>
+
+#include "oilproc.h"
+
+namespace {
+    constexpr double sample_rate = 1000; // Hz
+    constexpr double duration = 30; // s
+    constexpr double period = 1.7; // s
+    constexpr double cutoff = 20; // Hz, for the filters that take one
+    // relative: T is a mean over the intervals, so one maximum moved by a sample moves it by well under this
+    constexpr double T_tolerance = 1e-6;
+    constexpr double T_err_tolerance = 1e-3;
+
+    // in the layout of the sample captures: 10 header lines (9 skipped), then index, CH1, CH2
+    void write_capture(const std::string &path) {
+        FILE *fp = fopen(path.c_str(), "w");
+        if (fp == nullptr) {
+            throw std::invalid_argument("The synthetic capture could not be written.\n");
+        }
+        for (int i = 0; i < 10; ++i) {
+            fputs("X,CH1,CH2,Start,Increment,\n", fp);
+        }
+        std::mt19937_64 gen(46);
+        std::normal_distribution<double> noise(0, 0.001);
+        auto samples = (long) (duration*sample_rate);
+        for (long i = 0; i < samples; ++i) {
+            double t = (double) i/sample_rate;
+            double v = 1.5 + std::sin(2*M_PI*t/period) + 0.01*t + noise(gen);
+            fprintf(fp, "%ld,0.1,%.6f,\n", i, v);
+        }
+        fclose(fp);
+    }
+
+    double relative(double a, double b) {
+        return std::fabs(a - b)/std::max(std::fabs(a), std::fabs(b));
+    }
+}
+
+int main() {
+    std::string path = (std::filesystem::temp_directory_path() / "float_check.csv").string();
+    const oil::filter_kind kinds[] = {oil::filter_kind::none, oil::filter_kind::automatic,
+                                      oil::filter_kind::moving_average, oil::filter_kind::fir,
+                                      oil::filter_kind::iir, oil::filter_kind::polyphase};
+    const char *names[] = {"none", "automatic", "moving average", "fir", "iir", "polyphase"};
+    bool failed = false;
+    try {
+        write_capture(path);
+        for (size_t k = 0; k < sizeof(kinds)/sizeof(kinds[0]); ++k) {
+            double T[2][2];
+            for (int single = 0; single < 2; ++single) {
+                oil::Oil_run run;
+                run.set_prefilter(kinds[k], kinds[k] == oil::filter_kind::none ? 0 : cutoff);
+                run.use_float_samples(single == 1);
+                double *result = run.get_T(path.c_str(), 9, sample_rate);
+                T[single][0] = result[0];
+                T[single][1] = result[1];
+                free(result);
+            }
+            bool ok = relative(T[0][0], T[1][0]) <= T_tolerance && relative(T[0][1], T[1][1]) <= T_err_tolerance;
+            failed = failed || !ok;
+            printf("%-15s double T = %.9f +/- %.9f s, float T = %.9f +/- %.9f s  %s\n", names[k], T[0][0], T[0][1],
+                   T[1][0], T[1][1], ok ? "ok" : "FAILED");
+        }
+    }
+    catch (const std::exception &exception) {
+        fprintf(stderr, "%s\n", exception.what());
+        failed = true;
+    }
+    std::remove(path.c_str());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#include "libexpv.h"
+#include "oilproc.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+static_assert(sizeof(expv_record) == sizeof(oil::Oil_run::record), "expv_record must match the .dat layout.");
+
+struct expv_run {
+    oil::Oil_run run;
+};
+
+struct expv_store {
+    const expv_record *records = nullptr;
+    size_t count = 0;
+    oil::Name_table names;
+    bool mapped = false;
+    size_t mapped_bytes = 0; // header included
+    std::vector<expv_record> copy; // if not mapped, as for a store with an archive
+};
+
+namespace {
+    thread_local std::string last_error;
+
+    // runs func, turning any exception into a failure return with its message kept for expv_last_error()
+    template <typename RET, typename FUNC>
+    RET guarded(RET failure, FUNC func) {
+        try {
+            last_error.clear();
+            return func();
+        }
+        catch (const std::exception &e) {
+            last_error = e.what();
+        }
+        catch (...) {
+            last_error = "Unknown error.";
+        }
+        return failure;
+    }
+
+    std::string dat_path_or_default(const char *dat_path) {
+        if (dat_path != nullptr) {
+            return dat_path;
+        }
+#ifndef _WIN32
+        return oil::get_home_path<std::string>() + "/Exp_V_Program_Files/All_Runs.dat";
+#else
+        return oil::get_home_path<std::string>() + "\\Exp_V_Program_Files\\All_Runs.dat";
+#endif
+    }
+}
+
+extern "C" {
+
+EXPV_API int expv_abi_version(void) {
+    return EXPV_ABI_VERSION;
+}
+
+EXPV_API const char *expv_last_error(void) {
+    return last_error.c_str();
+}
+
+EXPV_API expv_run *expv_run_new(void) {
+    return guarded<expv_run *>(nullptr, [] {
+        auto *run = new expv_run;
+        run->run.keep_samples();
+        return run;
+    });
+}
+
+EXPV_API void expv_run_free(expv_run *run) {
+    delete run;
+}
+
+EXPV_API int expv_run_set_prefilter(expv_run *run, const char *kind, double cutoff_hz) {
+    return guarded(-1, [=] {
+        run->run.set_prefilter(oil::Prefilter::kind_of(kind), cutoff_hz);
+        return 0;
+    });
+}
+
+EXPV_API int expv_run_use_float_samples(expv_run *run, int on) {
+    run->run.use_float_samples(on != 0);
+    last_error.clear();
+    return 0;
+}
+
+EXPV_API int expv_run_analyse(expv_run *run, const char *capture_path, int skip_lines, double freq, double *T,
+                              double *T_err) {
+    return guarded(-1, [=] {
+        double *both = run->run.get_T(capture_path, skip_lines, freq);
+        *T = both[0];
+        *T_err = both[1];
+        free(both);
+        return 0;
+    });
+}
+
+EXPV_API size_t expv_run_samples(const expv_run *run, const double **times, const double **volts) {
+    *times = run->run.get_sample_times().data();
+    *volts = run->run.get_sample_volts().data();
+    return run->run.get_sample_times().size();
+}
+
+EXPV_API size_t expv_run_maxima(const expv_run *run, const double **times, const double **volts) {
+    return expv_run_peaks(run, nullptr, times, volts, nullptr, nullptr);
+}
+
+EXPV_API size_t expv_run_peaks(const expv_run *run, const uint64_t **indices, const double **times,
+                               const double **amplitudes, const double **widths, const double **prominences) {
+    return guarded<size_t>(0, [=] {
+        const oil::Peak_table &peaks = run->run.get_peaks();
+        if (indices != nullptr) {
+            *indices = peaks.indices().data();
+        }
+        if (times != nullptr) {
+            *times = peaks.times().data();
+        }
+        if (amplitudes != nullptr) {
+            *amplitudes = peaks.amplitudes().data();
+        }
+        if (widths != nullptr) {
+            *widths = peaks.widths().data();
+        }
+        if (prominences != nullptr) {
+            *prominences = peaks.prominences().data();
+        }
+        return peaks.size();
+    });
+}
+
+EXPV_API int expv_run_write_peaks(const expv_run *run, const char *path) {
+    return guarded(-1, [=] {
+        run->run.get_peaks().write(path);
+        return 0;
+    });
+}
+
+EXPV_API expv_store *expv_store_open(const char *dat_path) {
+    return guarded<expv_store *>(nullptr, [=] {
+        std::string path = dat_path_or_default(dat_path);
+        struct stat info = {};
+        if (stat(path.c_str(), &info) == -1 || S_ISDIR(info.st_mode)) {
+            throw std::invalid_argument("No .dat file at " + path + ".");
+        }
+        oil::Name_table names;
+        names.load<oil::Oil_run::record>(path.c_str()); // never converts: a store is only read here
+        auto *store = new expv_store;
+        store->names = std::move(names);
+        store->count = oil::Dat_file<oil::Oil_run::record>::count(path.c_str());
+        bool archived = oil::Archive<oil::Oil_run::record>::exists(path.c_str());
+        if (store->count == 0 && !archived) {
+            return store;
+        }
+#ifndef _WIN32
+        if (!archived) {
+            int fd = open(path.c_str(), O_RDONLY);
+            void *mem = fd == -1 ? MAP_FAILED : mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (fd != -1) {
+                ::close(fd);
+            }
+            if (mem == MAP_FAILED) {
+                delete store;
+                throw std::runtime_error(std::string("The .dat file could not be mapped: ") + strerror(errno));
+            }
+            size_t header = oil::Dat_file<oil::Oil_run::record>::header_bytes;
+            store->records = (const expv_record *) ((const char *) mem + header);
+            store->mapped = true;
+            store->mapped_bytes = info.st_size;
+            return store;
+        }
+#endif
+        try {
+            for (const oil::Oil_run::record &rec : oil::Archive<oil::Oil_run::record>::read(path.c_str())) {
+                store->copy.emplace_back();
+                std::memcpy(&store->copy.back(), &rec, sizeof(rec));
+            }
+            for (const oil::Oil_run::record &rec : oil::Dat_file<oil::Oil_run::record>::read(path.c_str())) {
+                store->copy.emplace_back();
+                std::memcpy(&store->copy.back(), &rec, sizeof(rec));
+            }
+        }
+        catch (...) {
+            delete store;
+            throw;
+        }
+        store->records = store->copy.data();
+        store->count = store->copy.size();
+        return store;
+    });
+}
+
+EXPV_API void expv_store_close(expv_store *store) {
+    if (store == nullptr) {
+        return;
+    }
+#ifndef _WIN32
+    if (store->mapped) {
+        size_t header = oil::Dat_file<oil::Oil_run::record>::header_bytes;
+        munmap((void *) ((const char *) store->records - header), store->mapped_bytes);
+    }
+#endif
+    delete store;
+}
+
+EXPV_API const expv_record *expv_store_records(const expv_store *store, size_t *count) {
+    *count = store->count;
+    return store->records;
+}
+
+EXPV_API const char *expv_store_name(const expv_store *store, uint32_t name_id) {
+    if (name_id >= store->names.size()) {
+        last_error = "The store has no name with that id.";
+        return nullptr;
+    }
+    last_error.clear();
+    return store->names.name(name_id).c_str();
+}
+
+EXPV_API int64_t expv_store_find(const expv_store *store, const char *name) {
+    uint32_t id = store->names.find(name);
+    return id == oil::Name_table::none ? -1 : (int64_t) id;
+}
+
+EXPV_API int expv_store_write(const char *dat_path, const expv_record *record, const char *name, const char *mode) {
+    return guarded(-1, [=] {
+        oil::Oil_run run;
+        oil::Oil_run::record rec;
+        std::memcpy(&rec, record, sizeof(rec));
+        rec >> run;
+        run.set_name(name);
+        return run.write_data(dat_path_or_default(dat_path).c_str(), mode);
+    });
+}
+
+EXPV_API int expv_store_delete(const char *dat_path, const char *name) {
+    return guarded(-1, [=] {
+        return oil::Oil_run::delete_run(dat_path_or_default(dat_path).c_str(), name);
+    });
+}
+
+EXPV_API int expv_reynolds(const expv_record *record, double rho, double rho_err, double *Re, double *Re_err) {
+    const expv_record &r = *record;
+    if (r.viscosity == 0 || r.T == 0 || r.b == 0 || r.a == r.b) {
+        last_error = "The run has no viscosity or time period, or its radii are invalid.";
+        return -1;
+    }
+    *Re = (rho*M_PI*r.b*(r.a - r.b))/(2*r.viscosity*r.T);
+    double a_minus_b_err = std::sqrt(r.a_err*r.a_err + r.b_err*r.b_err);
+    *Re_err = *Re*std::sqrt(std::pow(rho_err/rho, 2) + std::pow(r.b_err/r.b, 2) +
+                            std::pow(a_minus_b_err/(r.a - r.b), 2) + std::pow(r.visc_err/r.viscosity, 2) +
+                            std::pow(r.T_err/r.T, 2));
+    last_error.clear();
+    return 0;
+}
+
+}
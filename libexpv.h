@@ -0,0 +1,103 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+// C interface to the analysis and the run store, built as a shared library from libexpv.cpp:
+//     g++ -std=c++17 -O2 -fPIC -shared -pthread -o libexpv.so libexpv.cpp
+//     gcc -O2 -o Re Re.c -L. -lexpv -Wl,-rpath,'$ORIGIN'
+// (add -DOIL_USE_ZLIB -lz and/or -DOIL_USE_ZSTD -lzstd to the first line for compressed captures). Functions fail by
+// returning -1 or NULL, with the reason in expv_last_error(); nothing here throws.
+
+#ifndef LIBEXPV_H
+#define LIBEXPV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define EXPV_API __declspec(dllexport)
+#else
+#define EXPV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EXPV_ABI_VERSION 2
+
+/* one run as stored in a .dat file (168 bytes); its name is in the name file of the store, see expv_store_name() */
+typedef struct expv_record {
+    uint32_t name_id;
+    uint32_t reserved;
+    double a;
+    double a_err;
+    double b;
+    double b_err;
+    double drum;
+    double drum_err;
+    double MT_v_l_slope;
+    double MT_v_l_slope_err;
+    double intercept;
+    double intercept_err;
+    double k;
+    double k_err;
+    double mass;
+    double mass_err;
+    double T;
+    double T_err;
+    double submergence;
+    double sub_err;
+    double viscosity;
+    double visc_err;
+} expv_record;
+
+typedef struct expv_run expv_run;
+typedef struct expv_store expv_store;
+
+EXPV_API int expv_abi_version(void);
+/* message of the last failure on the calling thread ("" if none) */
+EXPV_API const char *expv_last_error(void);
+
+/* Capture analysis. The sample and maxima arrays belong to the run and stay valid until its next analysis or until
+ * it is freed, so bindings can wrap them without copying. skip_lines as for Oil_run::get_T(). */
+EXPV_API expv_run *expv_run_new(void);
+EXPV_API void expv_run_free(expv_run *run);
+EXPV_API int expv_run_set_prefilter(expv_run *run, const char *kind, double cutoff_hz);
+/* non-zero keeps the voltages as float while they are filtered and searched, as the "float" argument does */
+EXPV_API int expv_run_use_float_samples(expv_run *run, int on);
+EXPV_API int expv_run_analyse(expv_run *run, const char *capture_path, int skip_lines, double freq, double *T,
+                              double *T_err);
+EXPV_API size_t expv_run_samples(const expv_run *run, const double **times, const double **volts);
+EXPV_API size_t expv_run_maxima(const expv_run *run, const double **times, const double **volts);
+/* the whole peak table (see oilpeaks.h); any of the pointers may be NULL */
+EXPV_API size_t expv_run_peaks(const expv_run *run, const uint64_t **indices, const double **times,
+                               const double **amplitudes, const double **widths, const double **prominences);
+/* CSV for a .csv path, the binary peak table format otherwise */
+EXPV_API int expv_run_write_peaks(const expv_run *run, const char *path);
+
+/* Run store. A NULL dat_path means ~/Exp_V_Program_Files/All_Runs.dat. The records of an open store are the file
+ * mapped read-only (or, if it has an archive, the archived runs decoded and followed by those of the file), valid
+ * until it is closed; so are the names. A store written by an older version of the program is an error here: it is
+ * only converted when a run is next written to it. */
+EXPV_API expv_store *expv_store_open(const char *dat_path);
+EXPV_API void expv_store_close(expv_store *store);
+EXPV_API const expv_record *expv_store_records(const expv_store *store, size_t *count);
+/* the name of a record's name_id, or NULL */
+EXPV_API const char *expv_store_name(const expv_store *store, uint32_t name_id);
+/* the name_id of a name, or -1 if no run of the store has ever had it */
+EXPV_API int64_t expv_store_find(const expv_store *store, const char *name);
+/* name is the run's name (record->name_id is ignored); mode is "ow", "app" or "dn". Returns what
+ * Oil_run::write_data() does (0 new file, 1 appended, 2 overwritten, 3 left as it was) or -1, as for "ow" of a run
+ * that has been archived */
+EXPV_API int expv_store_write(const char *dat_path, const expv_record *record, const char *name, const char *mode);
+EXPV_API int expv_store_delete(const char *dat_path, const char *name);
+
+/* Reynolds number of the flow in a run, for an oil of density rho: {Re, Re_err} */
+EXPV_API int expv_reynolds(const expv_record *record, double rho, double rho_err, double *Re, double *Re_err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,268 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILAGG_H
+#define OILAGG_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "oilnames.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    // Per-oil summaries of a .dat file (run count, weighted mean viscosity and its spread, latest time period) kept as
+    // running sums in an ".agg" file next to it. Runs are grouped by the part of their name before the first '_', so
+    // "castor_1", "castor_2", ... all count towards "castor".
+    class Aggregates {
+    private:
+        class AggregateFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The aggregate file is corrupt or was not written by this program.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'A', 'G', 'G', '1'};
+        static constexpr size_t max_key_size = 32;
+        typedef struct {
+            char magic[8];
+            uint64_t records;
+            uint64_t groups;
+        } header;
+        typedef struct {
+            char key[max_key_size];
+            uint64_t count;
+            uint64_t n_visc; // runs with a viscosity
+            uint64_t n_err; // ... of which had an error on it
+            double Sw; // sum of weights
+            double Swv;
+            double Swvv;
+            uint64_t latest; // index in the .dat file of the last run of this oil
+            double latest_T;
+            double latest_T_err;
+        } group;
+        std::map<std::string, group> groups;
+        uint64_t records = 0;
+        std::string path;
+        template <typename REC>
+        static bool point(const REC &rec, double &v, double &w) {
+            if (rec.viscosity <= 0) {
+                return false;
+            }
+            v = rec.viscosity;
+            w = rec.visc_err > 0 ? 1/(rec.visc_err*rec.visc_err) : 1; // runs without errors are weighted equally
+            return true;
+        }
+    public:
+        struct summary {
+            std::string oil;
+            uint64_t runs;
+            uint64_t visc_runs;
+            double viscosity;
+            double visc_err; // 1/sqrt(sum of weights) if every run had an error, otherwise spread/sqrt(n)
+            double spread; // weighted standard deviation of the viscosities
+            double latest_T;
+            double latest_T_err;
+        };
+        static std::string key_of(const char *run_name) {
+            const char *end = std::strchr(run_name, '_');
+            std::string key = end == nullptr ? std::string(run_name) : std::string(run_name, end - run_name);
+            if (key.size() > max_key_size - 1) {
+                key.resize(max_key_size - 1);
+            }
+            return key;
+        }
+        static std::string sidecar_path(const char *dat_path) {
+            std::string agg_path(dat_path);
+            if (agg_path.size() >= 4 && agg_path.compare(agg_path.size() - 4, 4, ".dat") == 0) {
+                agg_path.erase(agg_path.size() - 4);
+            }
+            agg_path.append(".agg");
+            return agg_path;
+        }
+        [[nodiscard]] uint64_t count() const {
+            return records;
+        }
+        void clear() {
+            groups.clear();
+            records = 0;
+        }
+        // returns false (and leaves this object untouched) if there is no aggregate file for the .dat file
+        bool load_for(const char *dat_path) {
+            std::string agg_path = sidecar_path(dat_path);
+            std::ifstream in(agg_path, std::fstream::in | std::fstream::binary);
+            if (!in.good()) {
+                return false;
+            }
+            header head{};
+            in.read((char *) &head, sizeof(header));
+            if (in.gcount() != sizeof(header) || std::memcmp(head.magic, magic, sizeof(magic)) != 0) {
+                throw AggregateFileError();
+            }
+            std::map<std::string, group> read;
+            group g{};
+            for (uint64_t i = 0; i < head.groups; ++i) {
+                in.read((char *) &g, sizeof(group));
+                if (in.gcount() != sizeof(group) || g.key[max_key_size - 1] != '\0') {
+                    throw AggregateFileError();
+                }
+                read.emplace(g.key, g);
+            }
+            groups.swap(read);
+            records = head.records;
+            path = agg_path;
+            return true;
+        }
+        // loads the aggregates of a .dat file, rebuilding them if they are missing or out of step with the file
+        template <typename REC>
+        void sync(const char *dat_path) {
+            bool loaded;
+            try {
+                loaded = load_for(dat_path);
+            }
+            catch (const AggregateFileError &) {
+                loaded = false;
+            }
+            if (!loaded || records != Archive<REC>::count(dat_path) + Dat_file<REC>::count(dat_path)) {
+                rebuild<REC>(dat_path);
+            }
+        }
+        void save(const char *dat_path = nullptr) {
+            if (dat_path != nullptr) {
+                path = sidecar_path(dat_path);
+            }
+            if (path.empty()) {
+                throw std::invalid_argument("No .dat file has been associated with these aggregates.\n");
+            }
+            std::ofstream out(path, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+            if (!out.good()) {
+                throw std::invalid_argument("The aggregate file could not be written.\n");
+            }
+            header head{};
+            std::memcpy(head.magic, magic, sizeof(magic));
+            head.records = records;
+            head.groups = groups.size();
+            out.write((char *) &head, sizeof(header));
+            for (const auto &[key, g] : groups) {
+                out.write((const char *) &g, sizeof(group));
+            }
+        }
+        // index is the position of the run in the .dat file
+        template <typename REC>
+        void add(const REC &rec, const std::string &name, uint64_t index) {
+            std::string key = key_of(name.c_str());
+            auto it = groups.find(key);
+            if (it == groups.end()) {
+                group g{};
+                std::strcpy(g.key, key.c_str());
+                it = groups.emplace(key, g).first;
+            }
+            group &g = it->second;
+            double v, w;
+            if (point(rec, v, w)) {
+                g.Sw += w;
+                g.Swv += w*v;
+                g.Swvv += w*v*v;
+                ++g.n_visc;
+                g.n_err += rec.visc_err > 0;
+            }
+            if (g.count++ == 0 || index >= g.latest) {
+                g.latest = index;
+                g.latest_T = rec.T;
+                g.latest_T_err = rec.T_err;
+            }
+            ++records;
+        }
+        // does not touch the latest run of the oil, see place()
+        template <typename REC>
+        void remove(const REC &rec, const std::string &name) {
+            auto it = groups.find(key_of(name.c_str()));
+            if (it == groups.end()) {
+                return;
+            }
+            group &g = it->second;
+            double v, w;
+            if (point(rec, v, w) && g.n_visc > 0) {
+                g.Sw -= w;
+                g.Swv -= w*v;
+                g.Swvv -= w*v*v;
+                g.n_err -= rec.visc_err > 0 && g.n_err > 0;
+                if (--g.n_visc == 0) {
+                    g.Sw = g.Swv = g.Swvv = 0; // wipe out any rounding left over
+                }
+            }
+            --records;
+            if (--g.count == 0) {
+                groups.erase(it);
+            }
+        }
+        // after runs have been taken out of the .dat file, the positions of the remaining ones are fed back in through
+        // place() following a call to reset_latest()
+        void reset_latest() {
+            for (auto &[key, g] : groups) {
+                g.latest = 0;
+                g.latest_T = g.latest_T_err = 0;
+            }
+        }
+        template <typename REC>
+        void place(const REC &rec, const std::string &name, uint64_t index) {
+            auto it = groups.find(key_of(name.c_str()));
+            if (it != groups.end() && index >= it->second.latest) {
+                it->second.latest = index;
+                it->second.latest_T = rec.T;
+                it->second.latest_T_err = rec.T_err;
+            }
+        }
+        template <typename REC>
+        void rebuild(const char *dat_path) {
+            clear();
+            path = sidecar_path(dat_path);
+            Name_table names;
+            names.load<REC>(dat_path);
+            FILE *fp = Dat_file<REC>::open_runs(dat_path);
+            if (fp == nullptr) {
+                return; // nothing has been written yet
+            }
+            uint64_t i = 0;
+            Archive<REC>::for_each_segment(dat_path, [this, &names, &i](const std::vector<REC> &runs) {
+                for (const REC &rec : runs) {
+                    add(rec, names.name(rec.name_id), i++);
+                }
+            });
+            REC rec;
+            for (; fread(&rec, sizeof(REC), 1, fp) == 1; ++i) {
+                add(rec, names.name(rec.name_id), i);
+            }
+            fclose(fp);
+        }
+        [[nodiscard]] std::vector<summary> summaries(const char *prefix = "") const {
+            std::vector<summary> out;
+            size_t prefix_len = std::strlen(prefix);
+            for (auto it = groups.lower_bound(prefix); it != groups.end(); ++it) {
+                if (it->first.compare(0, prefix_len, prefix) != 0) {
+                    break;
+                }
+                const group &g = it->second;
+                summary s{it->first, g.count, g.n_visc, 0, 0, 0, g.latest_T, g.latest_T_err};
+                if (g.n_visc > 0) {
+                    s.viscosity = g.Swv / g.Sw;
+                    s.spread = std::sqrt(std::max(0.0, g.Swvv / g.Sw - s.viscosity*s.viscosity));
+                    s.visc_err = g.n_err == g.n_visc ? 1/std::sqrt(g.Sw) : s.spread / std::sqrt((double) g.n_visc);
+                }
+                out.push_back(s);
+            }
+            return out;
+        }
+    };
+}
+#endif
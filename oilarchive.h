@@ -0,0 +1,514 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILARCHIVE_H
+#define OILARCHIVE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "oildat.h"
+
+namespace oil {
+
+    // Old runs of a .dat file, moved out of it into sealed, read-only segments of up to segment_runs runs each in an
+    // ".seg" file next to it. A segment is stored column by column (the name ids, then each double of the record),
+    // and each column in whichever of these is smallest:
+    //     constant    one value for the whole segment
+    //     dictionary  up to 256 distinct values and a byte per run, for constants that change now and again
+    //     xor         each value XORed with the one before, with the leading and trailing zero bits left out
+    //     delta       the differences between successive values as zigzag varints, for the name ids
+    //     raw         the values as they are
+    // The archived runs come before those in the .dat file, so the position of a run in the store is unchanged by
+    // sealing. Once an .seg file exists, write_data() keeps sealing the oldest runs whenever the .dat file holds twice
+    // segment_runs of them.
+    // Segments are only ever appended to the .seg file, and the header of the .dat file holds how long the .seg file
+    // was when the .dat file was written (Dat_file::archive_bytes()). Sealing appends the new segments first and then
+    // replaces the .dat file, which is what commits them: anything past that length is left over from a seal that did
+    // not finish, and is ignored by readers and cut off by recover() before anything is written.
+    template <typename REC>
+    class Archive {
+    private:
+        class SegmentFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The archive file is corrupt or was not written by this program.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'S', 'E', 'G', '1'};
+        static constexpr size_t values = (sizeof(REC) - offsetof(REC, a)) / sizeof(double);
+        static constexpr size_t columns = values + 1;
+        enum encoding : uint8_t {raw = 0, constant = 1, dictionary = 2, xor_bits = 3, delta = 4};
+        typedef struct {
+            char magic[8];
+            uint32_t runs;
+            uint32_t columns;
+            uint64_t bytes; // of the column table and the columns that follow
+        } header;
+        typedef struct {
+            uint8_t encoding;
+            uint8_t pad[3];
+            uint32_t bytes;
+        } column_info;
+        class Bit_writer {
+        private:
+            std::string &out;
+            uint64_t acc = 0;
+            unsigned n = 0;
+        public:
+            explicit Bit_writer(std::string &dest) : out(dest) {}
+            void put(uint64_t bits, unsigned count) { // count <= 64
+                if (count > 32) {
+                    put(bits >> 32, count - 32);
+                    bits &= 0xffffffff;
+                    count = 32;
+                }
+                acc = acc << count | (bits & ((uint64_t(1) << count) - 1));
+                n += count;
+                while (n >= 8) {
+                    n -= 8;
+                    out.push_back((char) (acc >> n));
+                }
+            }
+            void flush() {
+                if (n > 0) {
+                    out.push_back((char) (acc << (8 - n)));
+                    n = 0;
+                }
+            }
+        };
+        class Bit_reader {
+        private:
+            const uint8_t *p;
+            const uint8_t *end;
+            uint64_t acc = 0;
+            unsigned n = 0;
+        public:
+            Bit_reader(const uint8_t *first, const uint8_t *last) : p(first), end(last) {}
+            uint64_t get(unsigned count) { // count <= 64; zeros past the end
+                if (count > 32) {
+                    uint64_t high = get(count - 32);
+                    return high << 32 | get(32);
+                }
+                while (n < count) {
+                    acc = acc << 8 | (p < end ? *p++ : 0);
+                    n += 8;
+                }
+                n -= count;
+                return acc >> n & ((uint64_t(1) << count) - 1);
+            }
+        };
+        static uint64_t word_of(const REC &rec, size_t col) {
+            if (col == 0) {
+                return rec.name_id;
+            }
+            uint64_t word;
+            std::memcpy(&word, (const char *) &rec + offsetof(REC, a) + (col - 1)*sizeof(double), sizeof(word));
+            return word;
+        }
+        static void set_word(REC &rec, size_t col, uint64_t word) {
+            if (col == 0) {
+                rec.name_id = (uint32_t) word;
+                return;
+            }
+            std::memcpy((char *) &rec + offsetof(REC, a) + (col - 1)*sizeof(double), &word, sizeof(word));
+        }
+        static bool encode_dictionary(const std::vector<uint64_t> &words, std::string &out) {
+            std::unordered_map<uint64_t, uint8_t> codes;
+            std::vector<uint64_t> dict;
+            std::string indices;
+            indices.reserve(words.size());
+            for (uint64_t word : words) {
+                auto it = codes.find(word);
+                if (it == codes.end()) {
+                    if (dict.size() == 256) {
+                        return false;
+                    }
+                    it = codes.emplace(word, (uint8_t) dict.size()).first;
+                    dict.push_back(word);
+                }
+                indices.push_back((char) it->second);
+            }
+            auto size = (uint16_t) dict.size();
+            out.append((const char *) &size, sizeof(size));
+            out.append((const char *) dict.data(), dict.size()*sizeof(uint64_t));
+            out.append(indices);
+            return true;
+        }
+        // Gorilla-style: '0' for a repeat, '10' and the meaningful bits if they fit the window of the last value
+        // that had its own, '11', 5 bits of leading zeros, 6 bits of length - 1 and the meaningful bits otherwise
+        static void encode_xor(const std::vector<uint64_t> &words, std::string &out) {
+            Bit_writer bits(out);
+            bits.put(words[0], 64);
+            unsigned lead = 65, trail = 0;
+            for (size_t i = 1; i < words.size(); ++i) {
+                uint64_t x = words[i] ^ words[i - 1];
+                if (x == 0) {
+                    bits.put(0, 1);
+                    continue;
+                }
+                auto x_lead = (unsigned) std::min(__builtin_clzll(x), 31);
+                auto x_trail = (unsigned) __builtin_ctzll(x);
+                if (lead <= 64 && x_lead >= lead && x_trail >= trail) {
+                    bits.put(2, 2);
+                    bits.put(x >> trail, 64 - lead - trail);
+                    continue;
+                }
+                lead = x_lead;
+                trail = x_trail;
+                bits.put(3, 2);
+                bits.put(lead, 5);
+                bits.put(63 - lead - trail, 6);
+                bits.put(x >> trail, 64 - lead - trail);
+            }
+            bits.flush();
+        }
+        static void encode_delta(const std::vector<uint64_t> &words, std::string &out) {
+            uint64_t prev = 0;
+            for (uint64_t word : words) {
+                auto d = (int64_t) (word - prev);
+                uint64_t zigzag = (uint64_t) d << 1 ^ (uint64_t) (d >> 63);
+                prev = word;
+                while (zigzag >= 0x80) {
+                    out.push_back((char) (zigzag | 0x80));
+                    zigzag >>= 7;
+                }
+                out.push_back((char) zigzag);
+            }
+        }
+        static encoding encode_column(const std::vector<uint64_t> &words, std::string &out) {
+            if (std::all_of(words.begin(), words.end(), [&words](uint64_t word) { return word == words[0]; })) {
+                out.append((const char *) &words[0], sizeof(uint64_t));
+                return constant;
+            }
+            std::string best((const char *) words.data(), words.size()*sizeof(uint64_t)), other;
+            encoding best_encoding = raw;
+            auto consider = [&best, &other, &best_encoding](encoding enc) {
+                if (other.size() < best.size()) {
+                    best.swap(other);
+                    best_encoding = enc;
+                }
+                other.clear();
+            };
+            if (encode_dictionary(words, other)) {
+                consider(dictionary);
+            }
+            other.clear();
+            encode_xor(words, other);
+            consider(xor_bits);
+            encode_delta(words, other);
+            consider(delta);
+            out.append(best);
+            return best_encoding;
+        }
+        static void decode_column(encoding enc, const uint8_t *p, size_t size, uint64_t *words, size_t n) {
+            const uint8_t *end = p + size;
+            switch (enc) {
+                case raw:
+                    if (size != n*sizeof(uint64_t)) {
+                        throw SegmentFileError();
+                    }
+                    std::memcpy(words, p, size);
+                    return;
+                case constant: {
+                    if (size != sizeof(uint64_t)) {
+                        throw SegmentFileError();
+                    }
+                    uint64_t word;
+                    std::memcpy(&word, p, sizeof(word));
+                    std::fill(words, words + n, word);
+                    return;
+                }
+                case dictionary: {
+                    uint16_t dict_size;
+                    if (size < sizeof(dict_size)) {
+                        throw SegmentFileError();
+                    }
+                    std::memcpy(&dict_size, p, sizeof(dict_size));
+                    if (dict_size == 0 || size != sizeof(dict_size) + dict_size*sizeof(uint64_t) + n) {
+                        throw SegmentFileError();
+                    }
+                    uint64_t dict[256];
+                    std::memcpy(dict, p + sizeof(dict_size), dict_size*sizeof(uint64_t));
+                    const uint8_t *indices = p + sizeof(dict_size) + dict_size*sizeof(uint64_t);
+                    for (size_t i = 0; i < n; ++i) {
+                        if (indices[i] >= dict_size) {
+                            throw SegmentFileError();
+                        }
+                        words[i] = dict[indices[i]];
+                    }
+                    return;
+                }
+                case xor_bits: {
+                    Bit_reader bits(p, end);
+                    uint64_t prev = bits.get(64);
+                    words[0] = prev;
+                    unsigned lead = 0, trail = 0;
+                    for (size_t i = 1; i < n; ++i) {
+                        if (bits.get(1) != 0) {
+                            if (bits.get(1) != 0) {
+                                lead = (unsigned) bits.get(5);
+                                unsigned len = (unsigned) bits.get(6) + 1;
+                                if (lead + len > 64) {
+                                    throw SegmentFileError();
+                                }
+                                trail = 64 - lead - len;
+                            }
+                            prev ^= bits.get(64 - lead - trail) << trail;
+                        }
+                        words[i] = prev;
+                    }
+                    return;
+                }
+                case delta: {
+                    uint64_t prev = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        uint64_t zigzag = 0;
+                        for (unsigned shift = 0;; shift += 7) {
+                            if (p == end || shift > 63) {
+                                throw SegmentFileError();
+                            }
+                            zigzag |= (uint64_t) (*p & 0x7f) << shift;
+                            if ((*p++ & 0x80) == 0) {
+                                break;
+                            }
+                        }
+                        prev += zigzag >> 1 ^ (uint64_t) -(int64_t) (zigzag & 1);
+                        words[i] = prev;
+                    }
+                    return;
+                }
+            }
+            throw SegmentFileError();
+        }
+        static void write_segment(FILE *fp, const REC *runs, size_t n) {
+            std::string body(columns*sizeof(column_info), '\0');
+            std::vector<uint64_t> words(n);
+            for (size_t col = 0; col < columns; ++col) {
+                for (size_t i = 0; i < n; ++i) {
+                    words[i] = word_of(runs[i], col);
+                }
+                size_t before = body.size();
+                column_info info{};
+                info.encoding = encode_column(words, body);
+                info.bytes = (uint32_t) (body.size() - before);
+                std::memcpy(&body[col*sizeof(column_info)], &info, sizeof(info));
+            }
+            header head{};
+            std::memcpy(head.magic, magic, sizeof(magic));
+            head.runs = (uint32_t) n;
+            head.columns = (uint32_t) columns;
+            head.bytes = body.size();
+            if (fwrite(&head, sizeof(head), 1, fp) != 1 || fwrite(body.data(), 1, body.size(), fp) != body.size()) {
+                throw std::invalid_argument("The archive file could not be written.\n");
+            }
+        }
+        // the columns wanted (all if only_col is columns) of the segment whose body is in body
+        static void decode_segment(const header &head, const std::string &body, std::vector<REC> &runs,
+                                   size_t only_col = columns) {
+            if (head.columns != columns || body.size() < columns*sizeof(column_info)) {
+                throw SegmentFileError();
+            }
+            runs.assign(head.runs, REC{});
+            std::vector<uint64_t> words(head.runs);
+            const auto *p = (const uint8_t *) body.data() + columns*sizeof(column_info);
+            const auto *end = (const uint8_t *) body.data() + body.size();
+            for (size_t col = 0; col < columns; ++col) {
+                column_info info{};
+                std::memcpy(&info, body.data() + col*sizeof(column_info), sizeof(info));
+                if (info.bytes > (size_t) (end - p)) {
+                    throw SegmentFileError();
+                }
+                if (only_col == columns || only_col == col) {
+                    decode_column((encoding) info.encoding, p, info.bytes, words.data(), head.runs);
+                    for (size_t i = 0; i < head.runs; ++i) {
+                        set_word(runs[i], col, words[i]);
+                    }
+                }
+                p += info.bytes;
+            }
+        }
+        // calls func(runs) for each segment in turn, decoding only_col or every column
+        template <typename FUNC>
+        static uint64_t scan(const char *dat_path, FUNC func, size_t only_col) {
+            uint64_t limit = committed_bytes(dat_path);
+            FILE *fp = fopen(sidecar_path(dat_path).c_str(), "rb");
+            if (fp == nullptr) {
+                return 0;
+            }
+            uint64_t total = 0;
+            uint64_t at = 0;
+            header head{};
+            std::string body;
+            std::vector<REC> runs;
+            try {
+                while (at < limit && fread(&head, sizeof(head), 1, fp) == 1) {
+                    if (std::memcmp(head.magic, magic, sizeof(magic)) != 0 || head.runs == 0) {
+                        throw SegmentFileError();
+                    }
+                    body.resize(head.bytes);
+                    if (fread(body.data(), 1, body.size(), fp) != body.size()) {
+                        throw SegmentFileError();
+                    }
+                    decode_segment(head, body, runs, only_col);
+                    func((const std::vector<REC> &) runs);
+                    total += head.runs;
+                    at += sizeof(head) + head.bytes;
+                }
+                if (at < limit && limit != Dat_file<REC>::any_archive) {
+                    throw SegmentFileError(); // runs the .dat file counts on are missing
+                }
+            }
+            catch (...) {
+                fclose(fp);
+                throw;
+            }
+            fclose(fp);
+            return total;
+        }
+        static std::vector<REC> read_live(const char *dat_path) {
+            return Dat_file<REC>::read(dat_path);
+        }
+        // the bytes of the .seg file that hold committed segments, any_archive if the .dat file does not say
+        static uint64_t committed_bytes(const char *dat_path) {
+            return Dat_file<REC>::archive_bytes(dat_path);
+        }
+        static void write_live(const char *dat_path, const REC *runs, size_t n, uint64_t archive) {
+            if (!Dat_file<REC>::write(dat_path, runs, n, archive)) {
+                throw std::invalid_argument("The .dat file could not be written.\n");
+            }
+        }
+    public:
+        static constexpr size_t segment_runs = 8192;
+        static std::string sidecar_path(const char *dat_path) {
+            std::string seg_path(dat_path);
+            if (seg_path.size() >= 4 && seg_path.compare(seg_path.size() - 4, 4, ".dat") == 0) {
+                seg_path.erase(seg_path.size() - 4);
+            }
+            seg_path.append(".seg");
+            return seg_path;
+        }
+        static bool exists(const char *dat_path) {
+            struct stat info = {};
+            return stat(sidecar_path(dat_path).c_str(), &info) == 0;
+        }
+        // the size of the .seg file, 0 if there is none
+        static uint64_t bytes(const char *dat_path) {
+            struct stat info = {};
+            return stat(sidecar_path(dat_path).c_str(), &info) == 0 ? (uint64_t) info.st_size : 0;
+        }
+        // the number of archived runs, from the segment headers alone
+        static uint64_t count(const char *dat_path) {
+            uint64_t limit = committed_bytes(dat_path);
+            FILE *fp = fopen(sidecar_path(dat_path).c_str(), "rb");
+            if (fp == nullptr) {
+                return 0;
+            }
+            uint64_t total = 0;
+            uint64_t at = 0;
+            header head{};
+            while (at < limit && fread(&head, sizeof(head), 1, fp) == 1 &&
+                   std::memcmp(head.magic, magic, sizeof(magic)) == 0 && fseek(fp, (long) head.bytes, SEEK_CUR) == 0) {
+                total += head.runs;
+                at += sizeof(head) + head.bytes;
+            }
+            fclose(fp);
+            return total;
+        }
+        // Cuts off what a seal, restore or merge that did not finish left past the committed end of the .seg file.
+        // Called before a store is written to; readers just ignore it.
+        static void recover(const char *dat_path) {
+            uint64_t limit = committed_bytes(dat_path);
+            uint64_t size = bytes(dat_path);
+            if (limit == Dat_file<REC>::any_archive || size == limit || !exists(dat_path)) {
+                return;
+            }
+            if (size < limit) {
+                throw SegmentFileError();
+            }
+            std::error_code err;
+            std::filesystem::resize_file(sidecar_path(dat_path), limit, err);
+            if (err) {
+                throw std::invalid_argument("The archive file could not be written.\n");
+            }
+        }
+        // calls func(runs) with the runs of each segment in turn, oldest first; returns the number of archived runs
+        template <typename FUNC>
+        static uint64_t for_each_segment(const char *dat_path, FUNC func) {
+            return scan(dat_path, func, columns);
+        }
+        // every archived run
+        static std::vector<REC> read(const char *dat_path) {
+            std::vector<REC> all;
+            for_each_segment(dat_path, [&all](const std::vector<REC> &runs) {
+                all.insert(all.end(), runs.begin(), runs.end());
+            });
+            return all;
+        }
+        // the name ids of the archived runs, decoding nothing else
+        static std::vector<uint32_t> name_ids(const char *dat_path) {
+            std::vector<uint32_t> ids;
+            scan(dat_path, [&ids](const std::vector<REC> &runs) {
+                for (const REC &rec : runs) {
+                    ids.push_back(rec.name_id);
+                }
+            }, 0);
+            return ids;
+        }
+        // Moves all but the newest keep runs of the .dat file into new segments, creating the .seg file (and so
+        // turning on sealing by write_data()) if need be. Returns the number of runs sealed.
+        static size_t seal(const char *dat_path, size_t keep) {
+            recover(dat_path);
+            std::vector<REC> live = read_live(dat_path);
+            size_t sealed = live.size() > keep ? live.size() - keep : 0;
+            FILE *fp = fopen(sidecar_path(dat_path).c_str(), "ab");
+            if (fp == nullptr) {
+                throw std::invalid_argument("The archive file could not be written.\n");
+            }
+            try {
+                for (size_t first = 0; first < sealed; first += segment_runs) {
+                    write_segment(fp, live.data() + first, std::min(segment_runs, sealed - first));
+                }
+            }
+            catch (...) {
+                fclose(fp);
+                throw;
+            }
+            if (fclose(fp) != 0) {
+                throw std::invalid_argument("The archive file could not be written.\n");
+            }
+            if (sealed > 0) { // commits the new segments
+                write_live(dat_path, live.data() + sealed, live.size() - sealed, bytes(dat_path));
+            }
+            return sealed;
+        }
+        // seals whole segments of the oldest runs once the .dat file holds twice segment_runs, if there is an archive
+        static size_t seal_if_due(const char *dat_path, uint64_t live_runs) {
+            if (live_runs < 2*segment_runs || !exists(dat_path)) {
+                return 0;
+            }
+            return seal(dat_path, live_runs - (live_runs / segment_runs - 1)*segment_runs);
+        }
+        // moves every archived run back into the .dat file and removes the .seg file; returns how many were moved
+        static size_t restore(const char *dat_path) {
+            std::vector<REC> all = read(dat_path);
+            std::vector<REC> live = read_live(dat_path);
+            size_t restored = all.size();
+            all.insert(all.end(), live.begin(), live.end());
+            write_live(dat_path, all.data(), all.size(), 0); // from here on the .seg file is ignored
+            std::remove(sidecar_path(dat_path).c_str());
+            return restored;
+        }
+    };
+}
+#endif
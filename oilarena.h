@@ -0,0 +1,180 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILARENA_H
+#define OILARENA_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "oilprofile.h"
+
+namespace oil {
+
+    // Bump allocator for the buffers of one capture analysis at a time. Nothing is freed individually: reset() rewinds
+    // the arena for the next capture and keeps its memory, so once it has grown to the size of the largest capture seen
+    // the analysis makes no more system allocations. With huge_pages, the blocks are 2 MiB aligned and marked for
+    // transparent huge pages where the platform supports it.
+    class Arena {
+    private:
+        static constexpr size_t huge_page_size = 2 << 20;
+        struct block {
+            char *base;
+            size_t size;
+            size_t used;
+        };
+        std::vector<block> blocks;
+        size_t current = 0; // blocks before this one are full
+        size_t block_size;
+        bool huge;
+        size_t mapped = 0; // number of blocks ever obtained from the system
+        static size_t round_up(size_t value, size_t to) {
+            return (value + to - 1) / to * to;
+        }
+        block get_block(size_t size) {
+            size = round_up(size, huge ? huge_page_size : 4096);
+            char *base = nullptr;
+#ifndef _WIN32
+            size_t extra = huge ? huge_page_size : 0; // so that the block can be aligned to a huge page
+            void *mem = mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            base = (char *) mem;
+            if (huge) {
+                char *aligned = (char *) round_up((uintptr_t) base, huge_page_size);
+                if (aligned != base) {
+                    munmap(base, aligned - base);
+                }
+                munmap(aligned + size, extra - (aligned - base));
+                base = aligned;
+#ifdef MADV_HUGEPAGE
+                madvise(base, size, MADV_HUGEPAGE);
+#endif
+            }
+#ifdef OIL_PROFILE_ALLOCATIONS
+            prof::note_allocation(base, size); // mapped, so the allocator hooks do not see it
+#endif
+#else
+            base = (char *) malloc(size);
+            if (base == nullptr) {
+                throw std::bad_alloc();
+            }
+#endif
+            ++mapped;
+            return {base, size, 0};
+        }
+        static void put_block(const block &blk) {
+#ifndef _WIN32
+#ifdef OIL_PROFILE_ALLOCATIONS
+            prof::note_free(blk.base, blk.size);
+#endif
+            munmap(blk.base, blk.size);
+#else
+            free(blk.base);
+#endif
+        }
+    public:
+        explicit Arena(size_t initial_size = 16 << 20, bool huge_pages = false)
+                : block_size(std::max<size_t>(initial_size, 4096)), huge(huge_pages) {}
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        void *allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+            for (; current < blocks.size(); ++current) {
+                block &blk = blocks[current];
+                size_t start = round_up((uintptr_t) blk.base + blk.used, align) - (uintptr_t) blk.base;
+                if (start + bytes <= blk.size) {
+                    blk.used = start + bytes;
+                    return blk.base + start;
+                }
+            }
+            blocks.push_back(get_block(std::max(block_size, bytes + align)));
+            block &blk = blocks.back();
+            size_t start = round_up((uintptr_t) blk.base, align) - (uintptr_t) blk.base;
+            blk.used = start + bytes;
+            return blk.base + start;
+        }
+        // invalidates everything allocated so far; if the last capture needed more than one block, they are merged into
+        // one block big enough for all of it, so that the next capture of the same size fits in a single block
+        void reset() {
+            if (blocks.size() > 1) {
+                size_t total = 0;
+                for (const block &blk : blocks) {
+                    total += blk.size;
+                    put_block(blk);
+                }
+                blocks.clear();
+                blocks.push_back(get_block(total));
+                block_size = std::max(block_size, total);
+            }
+            for (block &blk : blocks) {
+                blk.used = 0;
+            }
+            current = 0;
+        }
+        [[nodiscard]] size_t used() const {
+            size_t total = 0;
+            for (const block &blk : blocks) {
+                total += blk.used;
+            }
+            return total;
+        }
+        [[nodiscard]] size_t capacity() const {
+            size_t total = 0;
+            for (const block &blk : blocks) {
+                total += blk.size;
+            }
+            return total;
+        }
+        [[nodiscard]] size_t system_allocations() const {
+            return mapped;
+        }
+        ~Arena() {
+            for (const block &blk : blocks) {
+                put_block(blk);
+            }
+        }
+    };
+
+    // STL allocator drawing from an Arena, or from the heap if it was given none; deallocate() is a no-op for arena
+    // memory, which is only reclaimed by Arena::reset()
+    template <typename T>
+    class Arena_allocator {
+    public:
+        typedef T value_type;
+        Arena *arena = nullptr;
+        Arena_allocator() noexcept = default;
+        explicit Arena_allocator(Arena *source) noexcept : arena(source) {}
+        template <typename U>
+        Arena_allocator(const Arena_allocator<U> &other) noexcept : arena(other.arena) {} // NOLINT: rebinding
+        T *allocate(size_t n) {
+            if (arena != nullptr) {
+                return (T *) arena->allocate(n*sizeof(T), alignof(T));
+            }
+            return (T *) ::operator new(n*sizeof(T));
+        }
+        void deallocate(T *ptr, size_t) noexcept {
+            if (arena == nullptr) {
+                ::operator delete(ptr);
+            }
+        }
+        template <typename U>
+        bool operator==(const Arena_allocator<U> &other) const noexcept {
+            return arena == other.arena;
+        }
+        template <typename U>
+        bool operator!=(const Arena_allocator<U> &other) const noexcept {
+            return arena != other.arena;
+        }
+    };
+}
+#endif
@@ -0,0 +1,187 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILBASELINE_H
+#define OILBASELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+
+namespace oil {
+
+    enum class baseline_kind {none, mean, median, midrange};
+
+    // Rolling baseline of the voltages, for a threshold that follows slow drift rather than sitting at the mean of
+    // the whole capture. The window is centred on the sample it is for (and shrinks at the ends of the capture), and
+    // samples are pushed one at a time up to half a window ahead of the one whose baseline is asked for, so that it
+    // runs in the same pass as the peak search. The mean and the midrange ((min + max)/2, from monotonic deques)
+    // cost O(1) per sample whatever the window; the median keeps the window in two heaps, at O(log window).
+    class Baseline {
+    private:
+        typedef std::pair<double, uint64_t> entry; // voltage and sample index, so that every entry is distinct
+        baseline_kind kind;
+        uint64_t half;
+        uint64_t pushed = 0;
+        uint64_t start = 0; // first sample still in the window
+        double sum = 0; // mean
+        // midrange: indices whose voltages only rise (min) or fall (max) from front to back
+        std::deque<entry> mins;
+        std::deque<entry> maxes;
+        // median: lo holds the lower half (and the median itself when the count is odd), hi the upper half; entries
+        // that have left the window are only removed once they reach the top of their heap
+        std::priority_queue<entry> lo;
+        std::priority_queue<entry, std::vector<entry>, std::greater<>> hi;
+        size_t lo_count = 0; // entries of lo still in the window
+        size_t hi_count = 0;
+        void prune() {
+            while (!lo.empty() && lo.top().second < start) {
+                lo.pop();
+            }
+            while (!hi.empty() && hi.top().second < start) {
+                hi.pop();
+            }
+        }
+        void rebalance() {
+            prune();
+            if (lo_count > hi_count + 1) {
+                hi.push(lo.top());
+                lo.pop();
+                --lo_count;
+                ++hi_count;
+            }
+            else if (hi_count > lo_count) {
+                lo.push(hi.top());
+                hi.pop();
+                --hi_count;
+                ++lo_count;
+            }
+            prune();
+        }
+        void expire(double voltage, uint64_t index) {
+            if (kind == baseline_kind::mean) {
+                sum -= voltage;
+            }
+            else if (kind == baseline_kind::median) {
+                if (!lo.empty() && entry(voltage, index) <= lo.top()) {
+                    --lo_count;
+                }
+                else {
+                    --hi_count;
+                }
+            }
+        }
+    public:
+        // window is in samples; baseline_kind::none gives no baseline at all (see active())
+        Baseline(baseline_kind baseline, size_t window_samples) : kind(baseline), half(window_samples/2) {
+            if (baseline != baseline_kind::none && window_samples < 2) {
+                throw std::invalid_argument("The baseline window must be at least two samples long.\n");
+            }
+        }
+        static baseline_kind kind_of(const std::string &name) {
+            if (name == "mean") {
+                return baseline_kind::mean;
+            }
+            if (name == "median") {
+                return baseline_kind::median;
+            }
+            if (name == "minmax") {
+                return baseline_kind::midrange;
+            }
+            if (name == "none") {
+                return baseline_kind::none;
+            }
+            throw std::invalid_argument("The baseline must be one of mean, median, minmax or none.\n");
+        }
+        static const char *name_of(baseline_kind baseline) {
+            switch (baseline) {
+                case baseline_kind::mean:
+                    return "mean";
+                case baseline_kind::median:
+                    return "median";
+                case baseline_kind::midrange:
+                    return "minmax";
+                default:
+                    return "none";
+            }
+        }
+        [[nodiscard]] bool active() const {
+            return kind != baseline_kind::none;
+        }
+        // samples that must have been pushed before the baseline of sample i can be had
+        [[nodiscard]] uint64_t needed(uint64_t i) const {
+            return i + half + 1;
+        }
+        void push(double voltage) {
+            uint64_t index = pushed++;
+            switch (kind) {
+                case baseline_kind::mean:
+                    sum += voltage;
+                    break;
+                case baseline_kind::midrange:
+                    while (!mins.empty() && mins.back().first >= voltage) {
+                        mins.pop_back();
+                    }
+                    mins.emplace_back(voltage, index);
+                    while (!maxes.empty() && maxes.back().first <= voltage) {
+                        maxes.pop_back();
+                    }
+                    maxes.emplace_back(voltage, index);
+                    break;
+                case baseline_kind::median:
+                    if (lo.empty() || entry(voltage, index) <= lo.top()) {
+                        lo.emplace(voltage, index);
+                        ++lo_count;
+                    }
+                    else {
+                        hi.emplace(voltage, index);
+                        ++hi_count;
+                    }
+                    rebalance();
+                    break;
+                default:
+                    break;
+            }
+        }
+        // The baseline of sample i, once needed(i) samples (or all of them) have been pushed. i must not decrease
+        // from one call to the next, and older samples than the window of i are dropped. get_old(k) returns the
+        // voltage of sample k, for the mean and median to take it back out.
+        template <typename GET>
+        double at(uint64_t i, GET get_old) {
+            uint64_t first = i > half ? i - half : 0;
+            while (start < first) {
+                if (kind == baseline_kind::mean || kind == baseline_kind::median) {
+                    expire(get_old(start), start);
+                }
+                ++start;
+                if (kind == baseline_kind::median) {
+                    rebalance(); // so the tops are in the window for the next one to be compared with
+                }
+            }
+            switch (kind) {
+                case baseline_kind::mean:
+                    return sum/(double) (pushed - start);
+                case baseline_kind::midrange:
+                    while (mins.front().second < start) {
+                        mins.pop_front();
+                    }
+                    while (maxes.front().second < start) {
+                        maxes.pop_front();
+                    }
+                    return (mins.front().first + maxes.front().first)/2;
+                case baseline_kind::median:
+                    return lo_count > hi_count ? lo.top().first : (lo.top().first + hi.top().first)/2;
+                default:
+                    return 0;
+            }
+        }
+    };
+}
+#endif
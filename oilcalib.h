@@ -0,0 +1,262 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILCALIB_H
+#define OILCALIB_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "oilnames.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    // Weighted least-squares fit of MT against l (submergence) kept as running sums, so that runs can be added to or
+    // taken out of the fit in O(1). The sums live in a ".cal" file next to the .dat file they were built from, with the
+    // path of the GraphVariables.txt the fit was written to, which save() rewrites whenever the fit has changed.
+    class Calibration {
+    private:
+        class TooFewPointsError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "At least two runs with distinct submergences are needed for the MT vs l fit.";
+            }
+        };
+        class CalibrationFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The calibration file is corrupt or was not written by this program.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'C', 'A', 'L', '2'};
+        static constexpr char magic_v1[8] = {'E', 'X', 'P', 'V', 'C', 'A', 'L', '1'}; // no graph variables path
+        static constexpr size_t max_prefix_size = 32;
+        typedef struct {
+            char magic[8];
+            char prefix[max_prefix_size];
+            uint64_t count;
+            double S; // sum of weights
+            double Sx;
+            double Sy;
+            double Sxx;
+            double Sxy;
+        } sums;
+        sums s{};
+        sums saved{}; // as last loaded or saved, to tell whether the fit has changed
+        std::string path;
+        std::string graph_vars; // empty if the fit is not kept in a GraphVariables.txt
+        void apply(double x, double y, double w, double sign) {
+            s.S += sign*w;
+            s.Sx += sign*w*x;
+            s.Sy += sign*w*y;
+            s.Sxx += sign*w*x*x;
+            s.Sxy += sign*w*x*y;
+        }
+        // runs only count towards the fit if their single run parameters (mass and submergence) were read in
+        template <typename REC>
+        bool point(const REC &rec, const std::string &name, double &x, double &y, double &w) const {
+            if (rec.mass <= 0 || rec.submergence <= 0 || rec.T <= 0) {
+                return false;
+            }
+            if (name.compare(0, std::strlen(s.prefix), s.prefix) != 0) {
+                return false;
+            }
+            x = rec.submergence;
+            y = rec.mass*rec.T;
+            double y_err = std::sqrt(std::pow(rec.mass_err*rec.T, 2) + std::pow(rec.mass*rec.T_err, 2));
+            w = y_err > 0 ? 1/(y_err*y_err) : 1; // runs without errors are weighted equally
+            return true;
+        }
+        [[nodiscard]] double delta() const {
+            double d = s.S*s.Sxx - s.Sx*s.Sx;
+            if (s.count < 2 || d <= 0) {
+                throw TooFewPointsError();
+            }
+            return d;
+        }
+    public:
+        Calibration() {
+            std::memcpy(s.magic, magic, sizeof(magic));
+        }
+        explicit Calibration(const char *prefix) : Calibration() {
+            set_prefix(prefix);
+        }
+        static std::string sidecar_path(const char *dat_path) {
+            std::string cal_path(dat_path);
+            if (cal_path.size() >= 4 && cal_path.compare(cal_path.size() - 4, 4, ".dat") == 0) {
+                cal_path.erase(cal_path.size() - 4);
+            }
+            cal_path.append(".cal");
+            return cal_path;
+        }
+        void set_prefix(const char *prefix) {
+            if (prefix == nullptr) {
+                prefix = "";
+            }
+            if (std::strlen(prefix) > max_prefix_size - 1) {
+                throw std::invalid_argument("The run name prefix for the calibration cannot be above 31 characters.\n");
+            }
+            std::memset(s.prefix, '\0', max_prefix_size);
+            std::strcpy(s.prefix, prefix);
+        }
+        [[nodiscard]] const char *prefix() const {
+            return s.prefix;
+        }
+        [[nodiscard]] uint64_t count() const {
+            return s.count;
+        }
+        void clear() {
+            std::memset(&s.count, 0, sizeof(sums) - offsetof(sums, count));
+        }
+        // returns false (and leaves this object untouched) if the .dat file is not being tracked
+        bool load_for(const char *dat_path) {
+            std::string cal_path = sidecar_path(dat_path);
+            std::ifstream in(cal_path, std::fstream::in | std::fstream::binary);
+            if (!in.good()) {
+                return false;
+            }
+            sums read{};
+            in.read((char *) &read, sizeof(sums));
+            if (in.gcount() != sizeof(sums) || (std::memcmp(read.magic, magic, sizeof(magic)) != 0 &&
+                                                std::memcmp(read.magic, magic_v1, sizeof(magic)) != 0)) {
+                throw CalibrationFileError();
+            }
+            std::string read_graph_vars;
+            if (std::memcmp(read.magic, magic, sizeof(magic)) == 0) {
+                uint32_t len = 0;
+                in.read((char *) &len, sizeof(len));
+                read_graph_vars.resize(in.gcount() == sizeof(len) ? len : 0);
+                in.read(read_graph_vars.data(), len);
+                if (in.gcount() != (std::streamsize) len || read_graph_vars.size() != len) {
+                    throw CalibrationFileError();
+                }
+            }
+            std::memcpy(read.magic, magic, sizeof(magic)); // written back as the current version
+            s = read;
+            saved = read;
+            path = cal_path;
+            graph_vars = read_graph_vars;
+            return true;
+        }
+        void save(const char *dat_path = nullptr) {
+            if (dat_path != nullptr) {
+                path = sidecar_path(dat_path);
+            }
+            if (path.empty()) {
+                throw std::invalid_argument("No .dat file has been associated with this calibration.\n");
+            }
+            std::ofstream out(path, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+            if (!out.good()) {
+                throw std::invalid_argument("The calibration file could not be written.\n");
+            }
+            out.write((char *) &s, sizeof(sums));
+            auto len = (uint32_t) graph_vars.size();
+            out.write((char *) &len, sizeof(len));
+            out.write(graph_vars.data(), len);
+            out.close();
+            bool changed = std::memcmp(&s.count, &saved.count, sizeof(sums) - offsetof(sums, count)) != 0;
+            saved = s;
+            // too few runs leave the last fit in place
+            if (changed && !graph_vars.empty() && s.count >= 2 && s.S*s.Sxx - s.Sx*s.Sx > 0 &&
+                write_graph_vars(graph_vars.c_str()) != 0) {
+                throw std::invalid_argument("The graph variables file could not be written.\n");
+            }
+        }
+        // where save() keeps the fit written; nullptr or "" for nowhere
+        void set_graph_vars_path(const char *graph_vars_path) {
+            graph_vars = graph_vars_path != nullptr ? graph_vars_path : "";
+        }
+        [[nodiscard]] const std::string &graph_vars_path() const {
+            return graph_vars;
+        }
+        template <typename REC>
+        bool add(const REC &rec, const std::string &name) {
+            double x, y, w;
+            if (!point(rec, name, x, y, w)) {
+                return false;
+            }
+            apply(x, y, w, 1);
+            ++s.count;
+            return true;
+        }
+        template <typename REC>
+        bool remove(const REC &rec, const std::string &name) {
+            double x, y, w;
+            if (s.count == 0 || !point(rec, name, x, y, w)) {
+                return false;
+            }
+            apply(x, y, w, -1);
+            if (--s.count == 0) {
+                clear(); // wipe out any rounding left over
+            }
+            return true;
+        }
+        template <typename REC>
+        void rebuild(const char *dat_path) {
+            clear();
+            Name_table names;
+            names.load<REC>(dat_path);
+            FILE *fp = Dat_file<REC>::open_runs(dat_path);
+            if (fp == nullptr) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            Archive<REC>::for_each_segment(dat_path, [this, &names](const std::vector<REC> &runs) {
+                for (const REC &rec : runs) {
+                    add(rec, names.name(rec.name_id));
+                }
+            });
+            REC rec;
+            while (fread(&rec, sizeof(REC), 1, fp) == 1) {
+                add(rec, names.name(rec.name_id));
+            }
+            fclose(fp);
+            path = sidecar_path(dat_path);
+        }
+        [[nodiscard]] double slope() const {
+            return (s.S*s.Sxy - s.Sx*s.Sy) / delta();
+        }
+        [[nodiscard]] double slope_err() const {
+            return std::sqrt(s.S / delta());
+        }
+        [[nodiscard]] double intercept() const {
+            return (s.Sxx*s.Sy - s.Sx*s.Sxy) / delta();
+        }
+        [[nodiscard]] double intercept_err() const {
+            return std::sqrt(s.Sxx / delta());
+        }
+        // Written in the same layout as the sample GraphVariables.txt, so that read_graph_vars() accepts it, and
+        // renamed into place so that a reader (such as the daemon) never sees half of it.
+        int write_graph_vars(const char *graph_vars_path) const {
+            double m = slope(), m_err = slope_err(), c = intercept(), c_err = intercept_err();
+            std::string tmp_path = std::string(graph_vars_path) + ".tmp";
+            FILE *fp = fopen(tmp_path.c_str(), "w+");
+            if (fp == nullptr) {
+                return 1;
+            }
+            fprintf(fp, "MT vs l gradient = %.12f\t\t# kg s m^-1\n"
+                        "Gradient error = %.12f\t\t# kg s m^-1\n"
+                        "MT vs l intercept = %.12f\t# kg s\n"
+                        "Intercept error = %.12f\t# kg s", m, m_err, c, c_err);
+            if (fclose(fp) != 0) {
+                std::remove(tmp_path.c_str());
+                return 1;
+            }
+#ifdef _WIN32
+            std::remove(graph_vars_path); // Windows will not rename over an existing file
+#endif
+            if (std::rename(tmp_path.c_str(), graph_vars_path) != 0) {
+                std::remove(tmp_path.c_str());
+                return 1;
+            }
+            return 0;
+        }
+    };
+}
+#endif
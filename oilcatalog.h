@@ -0,0 +1,444 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILCATALOG_H
+#define OILCATALOG_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "oilio.h"
+
+namespace oil {
+
+    // Persistent record of the captures found in a set of directories. A rescan skips a directory whose
+    // mtime/ctime/inode has not changed without looking at its files, as no capture can have been added, removed or
+    // renamed in it; a file rewritten in place under the same name is only noticed by a deep rescan. A directory
+    // that has changed is re-read, and only a file whose size/mtime/inode has changed is re-hashed. Files are kept
+    // sorted by mtime, so finding the newest unprocessed capture is a short walk from the end.
+    class Catalog {
+    public:
+        enum status : uint8_t {unprocessed = 0, processed = 1, quarantined = 2}; // quarantined: failed in a batch
+        struct file_entry {
+            uint32_t dir_id;
+            uint8_t state;
+            uint64_t size;
+            int64_t mtime_ns;
+            uint64_t dev;
+            uint64_t ino;
+            uint64_t hash;
+            uint64_t num_samples;
+            std::string name;
+        };
+        struct dir_entry {
+            std::string path;
+            uint64_t dev;
+            uint64_t ino;
+            int64_t mtime_ns;
+            int64_t ctime_ns; // also catches an mtime set back, as by rsync -t
+        };
+    private:
+        class CatalogFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The catalog file is corrupt or was not written by this program.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'C', 'T', 'G', '2'};
+        static constexpr char magic_v1[8] = {'E', 'X', 'P', 'V', 'C', 'T', 'G', '1'}; // directories without ctime
+        static constexpr int header_lines = 10; // CSV lines before the first sample (get_T() is called with 9)
+        std::string path;
+        std::vector<dir_entry> dirs;
+        std::vector<file_entry> files;
+        std::unordered_map<std::string, size_t> lookup; // full path -> index into files
+        std::vector<std::vector<size_t>> by_dir; // dir_id -> indices into files
+        bool dirty = false;
+#ifndef _WIN32
+        static constexpr char sep = '/';
+#else
+        static constexpr char sep = '\\';
+#endif
+        static int64_t mtime_of(const struct stat &info) {
+#if defined(__APPLE__)
+            return (int64_t) info.st_mtimespec.tv_sec*1000000000 + info.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+            return (int64_t) info.st_mtim.tv_sec*1000000000 + info.st_mtim.tv_nsec;
+#else
+            return (int64_t) info.st_mtime*1000000000;
+#endif
+        }
+        static int64_t ctime_of(const struct stat &info) {
+#if defined(__APPLE__)
+            return (int64_t) info.st_ctimespec.tv_sec*1000000000 + info.st_ctimespec.tv_nsec;
+#elif !defined(_WIN32)
+            return (int64_t) info.st_ctim.tv_sec*1000000000 + info.st_ctim.tv_nsec;
+#else
+            return (int64_t) info.st_ctime*1000000000;
+#endif
+        }
+        [[nodiscard]] std::string full_path(const file_entry &file) const {
+            std::string full(dirs[file.dir_id].path);
+            full.push_back(sep);
+            full.append(file.name);
+            return full;
+        }
+        // 64-bit content hash, eight bytes at a time; while at it, counts the newlines for the sample count
+        static uint64_t hash_file(const char *file_path, uint64_t &newlines) {
+            FILE *fp = fopen(file_path, "rb");
+            if (fp == nullptr) {
+                return 0;
+            }
+            std::vector<char> buffer(1 << 20);
+            uint64_t h = 0x9e3779b97f4a7c15ULL;
+            newlines = 0;
+            size_t got;
+            while ((got = fread(buffer.data(), 1, buffer.size(), fp)) > 0) {
+                size_t words = got / 8;
+                const char *ptr = buffer.data();
+                for (size_t i = 0; i < words; ++i, ptr += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, ptr, 8);
+                    h = (h ^ word)*0xff51afd7ed558ccdULL;
+                    h ^= h >> 32;
+                }
+                for (size_t i = words*8; i < got; ++i) {
+                    h = (h ^ (unsigned char) buffer[i])*0xc4ceb9fe1a85ec53ULL;
+                }
+                const char *nl = buffer.data();
+                const char *end = buffer.data() + got;
+                while ((nl = (const char *) std::memchr(nl, '\n', end - nl)) != nullptr) {
+                    ++newlines;
+                    ++nl;
+                }
+            }
+            fclose(fp);
+            return h ^ (h >> 29);
+        }
+        static uint64_t count_samples(const char *file_path, uint64_t newlines) {
+            if (io::is_binary_capture(file_path)) {
+                io::Binary_capture bin(file_path);
+                return bin.header().num_samples;
+            }
+            if (io::detect_compression(file_path) != io::compression::none) {
+                newlines = 0;
+                io::Capture_reader reader(file_path);
+                char buffer[512];
+                while (reader.gets(buffer, 512) != nullptr) {
+                    newlines += std::strchr(buffer, '\n') != nullptr;
+                }
+            }
+            return newlines > header_lines ? newlines - header_lines : 0;
+        }
+        bool index_entry(file_entry &file, const struct stat &info, bool force) {
+            bool changed = force || file.size != (uint64_t) info.st_size || file.mtime_ns != mtime_of(info) ||
+                           file.ino != (uint64_t) info.st_ino || file.dev != (uint64_t) info.st_dev;
+            if (!changed) {
+                return false;
+            }
+            file.size = info.st_size;
+            file.mtime_ns = mtime_of(info);
+            file.dev = info.st_dev;
+            file.ino = info.st_ino;
+            std::string full = full_path(file);
+            uint64_t newlines = 0;
+            uint64_t new_hash = hash_file(full.c_str(), newlines);
+            if (new_hash != file.hash) {
+                file.state = unprocessed; // new content, so it has not been analysed
+            }
+            file.hash = new_hash;
+            try {
+                file.num_samples = count_samples(full.c_str(), newlines);
+            }
+            catch (const std::exception &) {
+                file.num_samples = 0; // still catalogued, get_T() will report what is wrong with it
+            }
+            dirty = true;
+            return true;
+        }
+        void rebuild_lookup() {
+            std::sort(files.begin(), files.end(), [](const file_entry &a, const file_entry &b) {
+                return a.mtime_ns < b.mtime_ns;
+            });
+            lookup.clear();
+            lookup.reserve(files.size());
+            by_dir.assign(dirs.size(), {});
+            for (size_t i = 0; i < files.size(); ++i) {
+                lookup.emplace(full_path(files[i]), i);
+                by_dir[files[i].dir_id].push_back(i);
+            }
+        }
+        static void write_str(FILE *fp, const std::string &str) {
+            auto len = (uint32_t) str.size();
+            fwrite(&len, sizeof(len), 1, fp);
+            fwrite(str.data(), 1, len, fp);
+        }
+        static bool read_str(FILE *fp, std::string &str) {
+            uint32_t len;
+            if (fread(&len, sizeof(len), 1, fp) != 1 || len > 4096) {
+                return false;
+            }
+            str.resize(len);
+            return fread(str.data(), 1, len, fp) == len;
+        }
+        template <typename T>
+        static bool read_pod(FILE *fp, T &value) {
+            return fread(&value, sizeof(T), 1, fp) == 1;
+        }
+        template <typename T>
+        static void write_pod(FILE *fp, const T &value) {
+            fwrite(&value, sizeof(T), 1, fp);
+        }
+    public:
+        Catalog() = default;
+        explicit Catalog(const std::string &catalog_path) {
+            load(catalog_path);
+        }
+        // a missing catalog file just means an empty catalog
+        void load(const std::string &catalog_path) {
+            path = catalog_path;
+            dirs.clear();
+            files.clear();
+            FILE *fp = fopen(path.c_str(), "rb");
+            if (fp == nullptr) {
+                rebuild_lookup();
+                return;
+            }
+            char read_magic[8];
+            uint32_t num_dirs = 0;
+            uint64_t num_files = 0;
+            bool ok = fread(read_magic, 1, 8, fp) == 8;
+            bool v1 = ok && std::memcmp(read_magic, magic_v1, 8) == 0;
+            ok = ok && (v1 || std::memcmp(read_magic, magic, 8) == 0) && read_pod(fp, num_dirs) &&
+                 read_pod(fp, num_files);
+            for (uint32_t i = 0; ok && i < num_dirs; ++i) {
+                dir_entry dir{};
+                ok = read_str(fp, dir.path) && read_pod(fp, dir.dev) && read_pod(fp, dir.ino) &&
+                     read_pod(fp, dir.mtime_ns);
+                dir.ctime_ns = -1; // a v1 catalog: each directory is read once more, then skipped
+                ok = ok && (v1 || read_pod(fp, dir.ctime_ns));
+                dirs.push_back(std::move(dir));
+            }
+            files.reserve(num_files);
+            for (uint64_t i = 0; ok && i < num_files; ++i) {
+                file_entry file{};
+                ok = read_pod(fp, file.dir_id) && read_pod(fp, file.state) && read_pod(fp, file.size) &&
+                     read_pod(fp, file.mtime_ns) && read_pod(fp, file.dev) && read_pod(fp, file.ino) &&
+                     read_pod(fp, file.hash) && read_pod(fp, file.num_samples) && read_str(fp, file.name) &&
+                     file.dir_id < num_dirs;
+                files.push_back(std::move(file));
+            }
+            fclose(fp);
+            if (!ok) {
+                throw CatalogFileError();
+            }
+            rebuild_lookup();
+            dirty = false;
+        }
+        void save() {
+            if (!dirty) {
+                return;
+            }
+            std::string tmp_path = path + ".tmp";
+            FILE *fp = fopen(tmp_path.c_str(), "wb");
+            if (fp == nullptr) {
+                throw std::invalid_argument("The catalog file could not be written.\n");
+            }
+            fwrite(magic, 1, 8, fp);
+            write_pod(fp, (uint32_t) dirs.size());
+            write_pod(fp, (uint64_t) files.size());
+            for (const dir_entry &dir : dirs) {
+                write_str(fp, dir.path);
+                write_pod(fp, dir.dev);
+                write_pod(fp, dir.ino);
+                write_pod(fp, dir.mtime_ns);
+                write_pod(fp, dir.ctime_ns);
+            }
+            for (const file_entry &file : files) {
+                write_pod(fp, file.dir_id);
+                write_pod(fp, file.state);
+                write_pod(fp, file.size);
+                write_pod(fp, file.mtime_ns);
+                write_pod(fp, file.dev);
+                write_pod(fp, file.ino);
+                write_pod(fp, file.hash);
+                write_pod(fp, file.num_samples);
+                write_str(fp, file.name);
+            }
+            if (fclose(fp) != 0 || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                throw std::invalid_argument("The catalog file could not be written.\n");
+            }
+            dirty = false;
+        }
+        bool add_dir(std::string dir_path) {
+            while (dir_path.size() > 1 && dir_path.back() == sep) {
+                dir_path.pop_back();
+            }
+            struct stat info = {};
+            if (stat(dir_path.c_str(), &info) == -1 || !S_ISDIR(info.st_mode)) {
+                throw std::invalid_argument("The path provided is not a directory.\n");
+            }
+            for (const dir_entry &dir : dirs) {
+                if (dir.path == dir_path) {
+                    return false;
+                }
+            }
+            dirs.push_back({dir_path, 0, 0, -1, -1}); // mtime of -1 forces a full first scan
+            by_dir.emplace_back();
+            dirty = true;
+            return true;
+        }
+        bool remove_dir(const std::string &dir_path) {
+            auto it = std::find_if(dirs.begin(), dirs.end(), [&dir_path](const dir_entry &dir) {
+                return dir.path == dir_path;
+            });
+            if (it == dirs.end()) {
+                return false;
+            }
+            auto id = (uint32_t) (it - dirs.begin());
+            files.erase(std::remove_if(files.begin(), files.end(), [id](const file_entry &file) {
+                return file.dir_id == id;
+            }), files.end());
+            for (file_entry &file : files) {
+                file.dir_id -= file.dir_id > id;
+            }
+            dirs.erase(it);
+            rebuild_lookup();
+            dirty = true;
+            return true;
+        }
+        // Returns the number of files that were added or re-indexed. A deep rescan also checks the files of the
+        // directories that have not changed, for captures rewritten in place.
+        size_t rescan(bool deep = false) {
+            size_t changes = 0;
+            bool removed = false;
+            std::vector<bool> seen(files.size(), false);
+            std::vector<file_entry> added;
+            for (uint32_t id = 0; id < dirs.size(); ++id) {
+                dir_entry &dir = dirs[id];
+                struct stat info = {};
+                if (stat(dir.path.c_str(), &info) == -1 || !S_ISDIR(info.st_mode)) {
+                    continue; // e.g. an unmounted share: keep what was known about it
+                }
+                if (dir.mtime_ns == mtime_of(info) && dir.ctime_ns == ctime_of(info) &&
+                    dir.ino == (uint64_t) info.st_ino && dir.dev == (uint64_t) info.st_dev) {
+                    // no entries were added, removed or renamed
+                    for (size_t k = 0; deep && k < by_dir[id].size(); ++k) {
+                        struct stat file_info = {};
+                        if (stat(full_path(files[by_dir[id][k]]).c_str(), &file_info) == 0) {
+                            changes += index_entry(files[by_dir[id][k]], file_info, false);
+                        }
+                    }
+                    continue;
+                }
+                DIR *dp = opendir(dir.path.c_str());
+                if (dp == nullptr) {
+                    continue;
+                }
+                struct dirent *entry;
+                std::string full;
+                while ((entry = readdir(dp)) != nullptr) {
+                    std::string name(entry->d_name);
+                    if (!io::is_capture_path(name)) {
+                        continue;
+                    }
+                    full = dir.path;
+                    full.push_back(sep);
+                    full.append(name);
+                    struct stat file_info = {};
+                    if (stat(full.c_str(), &file_info) == -1 || S_ISDIR(file_info.st_mode)) {
+                        continue;
+                    }
+                    auto found = lookup.find(full);
+                    if (found != lookup.end()) {
+                        seen[found->second] = true;
+                        changes += index_entry(files[found->second], file_info, false);
+                    }
+                    else {
+                        file_entry file{id, unprocessed, 0, 0, 0, 0, 0, 0, name};
+                        index_entry(file, file_info, true);
+                        added.push_back(std::move(file));
+                        ++changes;
+                    }
+                }
+                closedir(dp);
+                dir.mtime_ns = mtime_of(info);
+                dir.ctime_ns = ctime_of(info);
+                dir.ino = info.st_ino;
+                dir.dev = info.st_dev;
+                dirty = true;
+                // anything that was in this directory but was not seen has been deleted or renamed
+                for (size_t i : by_dir[id]) {
+                    if (!seen[i]) {
+                        files[i].dir_id = UINT32_MAX;
+                        removed = true;
+                    }
+                }
+            }
+            if (removed) {
+                files.erase(std::remove_if(files.begin(), files.end(), [](const file_entry &file) {
+                    return file.dir_id == UINT32_MAX;
+                }), files.end());
+            }
+            for (file_entry &file : added) {
+                files.push_back(std::move(file));
+            }
+            if (changes > 0 || removed) {
+                rebuild_lookup();
+                dirty = true;
+            }
+            return changes;
+        }
+        [[nodiscard]] const file_entry *find(const std::string &file_path) const {
+            auto found = lookup.find(file_path);
+            return found == lookup.end() ? nullptr : &files[found->second];
+        }
+        bool mark(const std::string &file_path, status state) {
+            auto found = lookup.find(file_path);
+            if (found == lookup.end()) {
+                return false;
+            }
+            if (files[found->second].state != state) {
+                files[found->second].state = state;
+                dirty = true;
+            }
+            return true;
+        }
+        // empty if every catalogued capture has been processed
+        [[nodiscard]] std::string newest_unprocessed() const {
+            for (auto it = files.rbegin(); it != files.rend(); ++it) {
+                if (it->state == unprocessed) {
+                    return full_path(*it);
+                }
+            }
+            return {};
+        }
+        // oldest first
+        [[nodiscard]] std::vector<const file_entry *> backlog() const {
+            std::vector<const file_entry *> pending;
+            for (const file_entry &file : files) {
+                if (file.state == unprocessed) {
+                    pending.push_back(&file);
+                }
+            }
+            return pending;
+        }
+        [[nodiscard]] const std::vector<file_entry> &all_files() const {
+            return files;
+        }
+        [[nodiscard]] const std::vector<dir_entry> &directories() const {
+            return dirs;
+        }
+        [[nodiscard]] std::string path_of(const file_entry &file) const {
+            return full_path(file);
+        }
+    };
+}
+#endif
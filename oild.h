@@ -0,0 +1,437 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILD_H
+#define OILD_H
+
+#ifndef _WIN32
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <csignal>
+
+#include "oilproc.h"
+
+namespace oil {
+
+    // Analysis daemon: keeps the constants, graph variables, single run parameters and an index of the .dat file in
+    // memory, and serves requests from Daemon::request() over a Unix domain socket with a pool of worker threads.
+    //
+    // A request is one line of tab-separated words, answered with "OK ..." or "ERR ..." lines before the connection
+    // is closed:
+    //     analyse <capture> <frequency> <name> [ow/app/dn] [single] [float]
+    //     query <name>
+    //     list
+    //     reload
+    //     stop
+    class Daemon {
+    private:
+        typedef Oil_run::record record;
+        std::string socket_path;
+        std::string dat_path;
+        std::string constants_path;
+        std::string graph_vars_path;
+        std::string single_path;
+        Oil_run base; // constants and graph variables read in
+        Oil_run base_single; // ... and the single run parameters, if they exist
+        bool have_single = false;
+        std::atomic<int64_t> config_stamp{0};
+        std::shared_mutex config_mtx;
+        std::vector<record> runs; // mirror of the archive and the .dat file
+        Name_table names; // ... and of its name file
+        std::unordered_multimap<std::string, size_t> index; // run name -> position in runs
+        std::mutex store_mtx;
+        int64_t store_stamp = 0;
+        std::deque<int> pending; // accepted connections waiting for a worker
+        std::mutex queue_mtx;
+        std::condition_variable queue_cv;
+        std::vector<std::thread> workers;
+        std::atomic<bool> running{false};
+        std::atomic<int> listen_fd{-1}; // -1 once it is closed; stop() may read it from any thread
+        static int64_t stamp_of(const std::string &path) {
+            struct stat info = {};
+            if (stat(path.c_str(), &info) == -1) {
+                return 0;
+            }
+#ifdef __APPLE__
+            return (int64_t) info.st_mtimespec.tv_sec*1000000000 + info.st_mtimespec.tv_nsec;
+#else
+            return (int64_t) info.st_mtim.tv_sec*1000000000 + info.st_mtim.tv_nsec;
+#endif
+        }
+        [[nodiscard]] int64_t config_stamps() const {
+            return stamp_of(constants_path) ^ (stamp_of(graph_vars_path) << 1) ^ (stamp_of(single_path) << 2);
+        }
+        void load_config() {
+            Oil_run fresh;
+            fresh.set_constants_path(constants_path);
+            fresh.read_constants();
+            fresh.read_graph_vars(graph_vars_path.c_str());
+            Oil_run fresh_single = fresh;
+            struct stat info = {};
+            bool single = stat(single_path.c_str(), &info) == 0;
+            if (single) {
+                fresh_single.read_single_run_parameters(single_path.c_str());
+            }
+            std::unique_lock<std::shared_mutex> lock(config_mtx);
+            base = fresh;
+            base_single = fresh_single;
+            have_single = single;
+            config_stamp = config_stamps();
+        }
+        void load_store() {
+            names.open<record>(dat_path.c_str());
+            runs = Archive<record>::read(dat_path.c_str());
+            std::vector<record> live = Dat_file<record>::read(dat_path.c_str());
+            runs.insert(runs.end(), live.begin(), live.end());
+            reindex();
+            store_stamp = stamp_of(dat_path);
+        }
+        void refresh_store() { // e.g. after "delete" was run on the .dat file behind the daemon's back
+            if (stamp_of(dat_path) != store_stamp) {
+                load_store();
+            }
+        }
+        void reindex() {
+            index.clear();
+            index.reserve(runs.size());
+            for (size_t i = 0; i < runs.size(); ++i) {
+                index.emplace(names.name(runs[i].name_id), i);
+            }
+        }
+        // mirrors what write_data() did to the file
+        void store_written(const record &rec, int written) {
+            if (Archive<record>::exists(dat_path.c_str())) { // write_data() leaves archived runs alone, and may seal
+                load_store();
+                return;
+            }
+            names.load_for(dat_path.c_str()); // write_data() may have added the name
+            const std::string &name = names.name(rec.name_id);
+            if (written == 2) {
+                auto range = index.equal_range(name);
+                for (auto it = range.first; it != range.second; ++it) {
+                    runs[it->second] = rec;
+                }
+            }
+            else if (written == 0 || written == 1) {
+                if (written == 0) {
+                    runs.clear();
+                    index.clear();
+                }
+                index.emplace(name, runs.size());
+                runs.push_back(rec);
+            }
+        }
+        static std::vector<std::string> split(const std::string &line) {
+            std::vector<std::string> words;
+            std::string::size_type start = 0, tab;
+            while ((tab = line.find('\t', start)) != std::string::npos) {
+                words.push_back(line.substr(start, tab - start));
+                start = tab + 1;
+            }
+            words.push_back(line.substr(start));
+            return words;
+        }
+        [[nodiscard]] std::string describe(const record &rec) const {
+            char line[160];
+            snprintf(line, sizeof(line), "\tT=%.9g\tT_err=%.9g\tvisc=%.9g\tvisc_err=%.9g\n", rec.T, rec.T_err,
+                     rec.viscosity, rec.visc_err);
+            return names.name(rec.name_id) + line;
+        }
+        std::string analyse(const std::vector<std::string> &words) {
+            const char *usage = "ERR usage: analyse <capture> <frequency> <name> [ow/app/dn] [single] [float]\n";
+            if (words.size() < 4 || !is_numeric(words[2])) {
+                return usage;
+            }
+            std::string mode = "OW";
+            bool single = false;
+            bool float_samples = false;
+            for (size_t i = 4; i < words.size(); ++i) {
+                std::string upper(words[i]);
+                string_upper(upper);
+                if (i == 4 && (upper == "OW" || upper == "APP" || upper == "DN")) {
+                    mode = upper;
+                }
+                else if (words[i] == "single" && !single) {
+                    single = true;
+                }
+                else if (words[i] == "float" && !float_samples) {
+                    float_samples = true;
+                }
+                else {
+                    return usage;
+                }
+            }
+            if (config_stamps() != config_stamp) {
+                load_config(); // the files were edited since they were last read
+            }
+            Oil_run run;
+            {
+                std::shared_lock<std::shared_mutex> lock(config_mtx);
+                if (single && !have_single) {
+                    return "ERR no single run parameters file at: " + single_path + "\n";
+                }
+                run = single ? base_single : base;
+            }
+            static thread_local Arena buffers; // one per worker, so repeated analyses stop allocating
+            run.set_name(words[3]);
+            run.use_arena(&buffers);
+            run.use_float_samples(float_samples);
+            double *T = run.get_T(words[1].c_str(), -1, (double) strtol(words[2].c_str(), nullptr, 10));
+            std::string reply;
+            char line[128];
+            snprintf(line, sizeof(line), "OK\tT=%.9g\tT_err=%.9g\n", *T, *(T + 1));
+            reply.append(line);
+            free(T);
+            double *visc = run.calc_visc_from_grad();
+            snprintf(line, sizeof(line), "OK\tvisc_grad=%.9g\tvisc_grad_err=%.9g\n", *visc, *(visc + 1));
+            reply.append(line);
+            free(visc);
+            if (single) {
+                visc = run.calc_visc_from_T();
+                snprintf(line, sizeof(line), "OK\tvisc_single=%.9g\tvisc_single_err=%.9g\n", *visc, *(visc + 1));
+                reply.append(line);
+                free(visc);
+            }
+            std::lock_guard<std::mutex> lock(store_mtx);
+            refresh_store();
+            int written = run.write_data(dat_path.c_str(), mode.c_str());
+            store_written(run.get_data_struct_cp(), written);
+            store_stamp = stamp_of(dat_path);
+            return reply;
+        }
+        std::string handle(const std::string &line) {
+            std::vector<std::string> words = split(line);
+            const std::string &cmd = words[0];
+            try {
+                if (cmd == "analyse" || cmd == "analyze") {
+                    return analyse(words);
+                }
+                if (cmd == "query" && words.size() == 2) {
+                    std::string reply;
+                    std::lock_guard<std::mutex> lock(store_mtx);
+                    refresh_store();
+                    auto range = index.equal_range(words[1]);
+                    for (auto it = range.first; it != range.second; ++it) {
+                        reply.append("OK\t" + describe(runs[it->second]));
+                    }
+                    return reply.empty() ? "ERR no run named: " + words[1] + "\n" : reply;
+                }
+                if (cmd == "list") {
+                    std::string reply;
+                    std::lock_guard<std::mutex> lock(store_mtx);
+                    refresh_store();
+                    for (const record &rec : runs) {
+                        reply.append("OK\t" + describe(rec));
+                    }
+                    return reply.empty() ? "OK\n" : reply;
+                }
+                if (cmd == "reload") {
+                    load_config();
+                    std::lock_guard<std::mutex> lock(store_mtx);
+                    load_store();
+                    return "OK\treloaded\n";
+                }
+                if (cmd == "stop") {
+                    stop();
+                    return "OK\tstopping\n";
+                }
+            }
+            catch (const std::exception &exception) {
+                std::string reply = std::string("ERR ") + exception.what();
+                if (reply.back() != '\n') {
+                    reply.push_back('\n');
+                }
+                return reply;
+            }
+            return "ERR unknown request: " + cmd + "\n";
+        }
+        static bool read_line(int fd, std::string &line) {
+            char buffer[4096];
+            ssize_t got;
+            while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+                line.append(buffer, got);
+                std::string::size_type nl = line.find('\n');
+                if (nl != std::string::npos) {
+                    line.erase(nl);
+                    return true;
+                }
+                if (line.size() > 65536) {
+                    return false;
+                }
+            }
+            return !line.empty();
+        }
+        static void write_all(int fd, const std::string &data) {
+            size_t done = 0;
+            while (done < data.size()) {
+                ssize_t put = write(fd, data.data() + done, data.size() - done);
+                if (put <= 0) {
+                    return;
+                }
+                done += (size_t) put;
+            }
+        }
+        void serve() {
+            while (true) {
+                int fd;
+                {
+                    std::unique_lock<std::mutex> lock(queue_mtx);
+                    queue_cv.wait(lock, [this] { return !pending.empty() || !running; });
+                    if (pending.empty()) {
+                        return;
+                    }
+                    fd = pending.front();
+                    pending.pop_front();
+                }
+                std::string line;
+                if (read_line(fd, line)) {
+                    write_all(fd, handle(line));
+                }
+                ::close(fd);
+            }
+        }
+        static sockaddr_un address(const std::string &path) {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument("The socket path is too long.\n");
+            }
+            std::strcpy(addr.sun_path, path.c_str());
+            return addr;
+        }
+        // Makes way for the socket at addr. A daemon that still answers there is left alone, and only a socket that
+        // refuses connections, as one left behind by a daemon that was killed does, is removed.
+        void claim_socket_path(const sockaddr_un &addr) const {
+            struct stat info = {};
+            if (lstat(socket_path.c_str(), &info) == -1) {
+                return; // nothing there
+            }
+            if (!S_ISSOCK(info.st_mode)) {
+                throw std::invalid_argument("The daemon's socket path is taken by a file that is not a socket.\n");
+            }
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (probe == -1) {
+                throw std::invalid_argument("The daemon's socket could not be created.\n");
+            }
+            int err = connect(probe, (const sockaddr *) &addr, sizeof(addr)) == 0 ? 0 : errno;
+            ::close(probe);
+            if (err == 0) {
+                throw std::invalid_argument("A daemon is already listening on " + socket_path + ".\n");
+            }
+            if (err != ECONNREFUSED || unlink(socket_path.c_str()) == -1) {
+                throw std::invalid_argument("The daemon's socket could not be created: " +
+                                            std::string(strerror(err != ECONNREFUSED ? err : errno)) + "\n");
+            }
+        }
+    public:
+        Daemon(std::string socket, std::string dat, std::string constants, std::string graph_vars,
+               std::string single_params) : socket_path(std::move(socket)), dat_path(std::move(dat)),
+                                            constants_path(std::move(constants)),
+                                            graph_vars_path(std::move(graph_vars)),
+                                            single_path(std::move(single_params)) {}
+        Daemon(const Daemon &) = delete;
+        Daemon &operator=(const Daemon &) = delete;
+        // blocks until a "stop" request is received
+        void run(unsigned threads = 0) {
+            load_config();
+            load_store();
+            sockaddr_un addr = address(socket_path);
+            claim_socket_path(addr);
+            int fd_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd_listen == -1 || bind(fd_listen, (sockaddr *) &addr, sizeof(addr)) == -1 ||
+                listen(fd_listen, 64) == -1) {
+                if (fd_listen != -1) {
+                    ::close(fd_listen);
+                }
+                throw std::invalid_argument("The daemon's socket could not be created.\n");
+            }
+            listen_fd = fd_listen;
+            chmod(socket_path.c_str(), S_IRUSR | S_IWUSR);
+            signal(SIGPIPE, SIG_IGN); // a client hanging up early must not take the daemon down
+            running = true;
+            if (threads == 0) {
+                threads = std::max(2u, std::thread::hardware_concurrency());
+            }
+            for (unsigned i = 0; i < threads; ++i) {
+                workers.emplace_back(&Daemon::serve, this);
+            }
+            while (running) {
+                int fd = accept(fd_listen, nullptr, nullptr);
+                if (fd == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(queue_mtx);
+                pending.push_back(fd);
+                queue_cv.notify_one();
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mtx); // so that a stop() under way is done with the socket
+                running = false;
+                listen_fd = -1;
+            }
+            queue_cv.notify_all();
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+            workers.clear();
+            ::close(fd_listen);
+            unlink(socket_path.c_str());
+        }
+        void stop() {
+            std::lock_guard<std::mutex> lock(queue_mtx);
+            running = false;
+            int fd = listen_fd;
+            if (fd != -1) {
+                shutdown(fd, SHUT_RDWR); // wakes up accept()
+            }
+        }
+        // the thin client: sends one request and returns the reply, or an empty string if no daemon is running
+        static std::string request(const std::string &socket, const std::vector<std::string> &words) {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr = address(socket);
+            if (fd == -1 || connect(fd, (sockaddr *) &addr, sizeof(addr)) == -1) {
+                if (fd != -1) {
+                    ::close(fd);
+                }
+                return {};
+            }
+            std::string line;
+            for (size_t i = 0; i < words.size(); ++i) {
+                line.append(words[i]);
+                line.push_back(i + 1 == words.size() ? '\n' : '\t');
+            }
+            write_all(fd, line);
+            shutdown(fd, SHUT_WR);
+            std::string reply;
+            char buffer[4096];
+            ssize_t got;
+            while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+                reply.append(buffer, got);
+            }
+            ::close(fd);
+            return reply;
+        }
+    };
+}
+
+#endif
+#endif
@@ -0,0 +1,200 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILDAT_H
+#define OILDAT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace oil {
+
+    // Layout of a .dat file: a 24-byte header with a magic, the format version, the size of a run and the size of the
+    // .seg file that goes with the runs (see Archive), then the runs back to back. The header is what tells a store
+    // apart from the "legacy" layout before it, which had none and kept each run's name inline in 192 bytes. A legacy
+    // file is told apart by its contents, never by whether a .names file happens to be there, and is only ever
+    // converted by something that writes to the store (see Name_table::open()).
+    template <typename REC>
+    class Dat_file {
+    public:
+        enum layout {missing, empty, current, legacy, unknown};
+        static constexpr uint32_t version = 2;
+        typedef struct {
+            char name[32];
+            double values[20];
+        } legacy_record;
+        class OldFormatError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The .dat file was written by an older version of this program and is only converted when a "
+                       "run is written to it.";
+            }
+        };
+        class UnknownFormatError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The .dat file is corrupt or was not written by this program.";
+            }
+        };
+    private:
+        struct header {
+            char magic[8];
+            uint32_t version;
+            uint32_t record_bytes;
+            uint64_t archive_bytes; // of the .seg file when these runs were written; any more are not yet sealed
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'D', 'A', 'T', 'A'};
+        // the name of a legacy run: printable, then zero padded, as the old write_data() left it
+        static bool legacy_name(const char *name) {
+            size_t len = strnlen(name, 32);
+            if (len == 0 || len == 32) {
+                return false;
+            }
+            for (size_t i = 0; i < 32; ++i) {
+                auto c = (unsigned char) name[i];
+                if (i < len ? c < 0x20 || c == 0x7f : c != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static std::string read_all(const char *path) {
+            std::string bytes;
+            FILE *fp = fopen(path, "rb");
+            if (fp == nullptr) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            char chunk[65536];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+                bytes.append(chunk, got);
+            }
+            fclose(fp);
+            return bytes;
+        }
+    public:
+        static constexpr size_t header_bytes = sizeof(header);
+        static constexpr uint64_t any_archive = UINT64_MAX; // archive_bytes() of a file with no header yet
+        static bool write_header(FILE *fp, uint64_t archive_bytes = 0) {
+            header head{};
+            std::memcpy(head.magic, magic, sizeof(magic));
+            head.version = version;
+            head.record_bytes = sizeof(REC);
+            head.archive_bytes = archive_bytes;
+            return fwrite(&head, sizeof(head), 1, fp) == 1;
+        }
+        static layout layout_of(const char *path) {
+            struct stat info = {};
+            if (stat(path, &info) == -1) {
+                return missing;
+            }
+            if (info.st_size == 0) {
+                return empty;
+            }
+            auto size = (size_t) info.st_size;
+            header head{};
+            FILE *fp = fopen(path, "rb");
+            if (fp == nullptr) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            size_t got = fread(&head, 1, sizeof(head), fp);
+            fclose(fp);
+            if (got >= sizeof(magic) && std::memcmp(head.magic, magic, sizeof(magic)) == 0) {
+                bool ok = got == sizeof(head) && head.version == version && head.record_bytes == sizeof(REC) &&
+                          (size - sizeof(head)) % sizeof(REC) == 0;
+                return ok ? current : unknown;
+            }
+            std::string bytes = read_all(path);
+            if (size % sizeof(legacy_record) == 0) {
+                bool names = true;
+                for (size_t at = 0; at < size && names; at += sizeof(legacy_record)) {
+                    names = legacy_name(bytes.data() + at + offsetof(legacy_record, name));
+                }
+                if (names) {
+                    return legacy;
+                }
+            }
+            return unknown;
+        }
+        // throws unless path is missing, empty or in the current layout
+        static void check(const char *path) {
+            layout found = layout_of(path);
+            if (found == legacy) {
+                throw OldFormatError();
+            }
+            if (found == unknown) {
+                throw UnknownFormatError();
+            }
+        }
+        // the bytes of the .seg file that belong with path, any_archive if it is missing or empty
+        static uint64_t archive_bytes(const char *path) {
+            check(path);
+            header head{};
+            FILE *fp = fopen(path, "rb");
+            if (fp == nullptr) {
+                return any_archive;
+            }
+            bool got = fread(&head, sizeof(head), 1, fp) == 1;
+            fclose(fp);
+            return got ? head.archive_bytes : any_archive;
+        }
+        // the runs in the .dat file at path (not counting archived ones), 0 if there is none
+        static size_t count(const char *path) {
+            check(path);
+            struct stat info = {};
+            if (stat(path, &info) == -1 || (size_t) info.st_size < header_bytes) {
+                return 0;
+            }
+            return ((size_t) info.st_size - header_bytes) / sizeof(REC);
+        }
+        // path opened for reading at its first run, or nullptr if there is no file
+        static FILE *open_runs(const char *path) {
+            check(path);
+            FILE *fp = fopen(path, "rb");
+            if (fp != nullptr && fseek(fp, (long) header_bytes, SEEK_SET) != 0) { // an empty file reads as no runs
+                fclose(fp);
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            return fp;
+        }
+        // all of its runs
+        static std::vector<REC> read(const char *path) {
+            std::vector<REC> runs(count(path));
+            FILE *fp = open_runs(path);
+            if (fp == nullptr) {
+                return runs;
+            }
+            bool ok = fread(runs.data(), sizeof(REC), runs.size(), fp) == runs.size();
+            fclose(fp);
+            if (!ok) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            return runs;
+        }
+        // Replaces path with a header and n runs, by way of a temporary file, so that it is either all there or not at
+        // all. The header keeps the archive_bytes of the file it replaces unless they are given.
+        static bool write(const char *path, const REC *runs, size_t n, uint64_t archive = any_archive) {
+            if (archive == any_archive) {
+                archive = layout_of(path) == current ? archive_bytes(path) : 0;
+            }
+            std::string tmp_path = std::string(path) + ".writing";
+            FILE *fp = fopen(tmp_path.c_str(), "wb");
+            bool ok = fp != nullptr && write_header(fp, archive) && (n == 0 || fwrite(runs, sizeof(REC), n, fp) == n);
+            ok = fp != nullptr && fclose(fp) == 0 && ok;
+#ifdef _WIN32
+            std::remove(path);
+#endif
+            if (!ok || std::rename(tmp_path.c_str(), path) != 0) {
+                std::remove(tmp_path.c_str());
+                return false;
+            }
+            return true;
+        }
+    };
+}
+#endif
@@ -0,0 +1,216 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILDIALECT_H
+#define OILDIALECT_H
+
+#include <cstring>
+#include <cmath>
+#include <charconv>
+#include <string>
+#include <vector>
+#include "oilio.h"
+
+namespace oil::io {
+
+    // Layout of the data lines of a CSV capture. Each layout is its own type, so that parse_capture() is compiled
+    // separately for each one and finds its two fields without looking at the layout at run time.
+    template <char DELIMITER, int TIME_COLUMN, int VALUE_COLUMN, bool INDEXED>
+    struct dialect {
+        static_assert(TIME_COLUMN < VALUE_COLUMN, "The time must come before the voltage.");
+        static constexpr char delimiter = DELIMITER;
+        static constexpr int time_column = TIME_COLUMN;
+        static constexpr int value_column = VALUE_COLUMN;
+        static constexpr bool indexed = INDEXED; // the time column holds the sample number, to be divided by freq
+    };
+
+    typedef dialect<',', 0, 2, true> index_csv; // sample number, CH1, CH2 (CH2 is analysed)
+    typedef dialect<',', 0, 1, false> time_csv; // time in s, voltage
+    typedef dialect<';', 0, 1, false> semicolon_csv;
+    typedef dialect<'\t', 0, 1, false> tab_csv;
+    typedef dialect<',', 3, 4, false> tek_csv; // three columns of settings (empty on most lines), time, voltage
+
+    enum class dialect_id {unknown, index_csv, time_csv, semicolon_csv, tab_csv, tek_csv};
+
+    struct detected_dialect {
+        dialect_id id = dialect_id::unknown;
+        size_t header_lines = 0;
+    };
+
+    // reads a number in the formats that scopes write (e.g. "12", "-0.04", "1.2E-03") with leading spaces allowed
+    inline const char *read_number(const char *first, const char *last, double &value) {
+        while (first != last && (*first == ' ' || *first == '+')) {
+            ++first;
+        }
+        std::from_chars_result res = std::from_chars(first, last, value);
+        return res.ec == std::errc() ? res.ptr : nullptr;
+    }
+
+    inline bool field_ends(const char *ptr, char delimiter) {
+        while (*ptr == ' ') {
+            ++ptr;
+        }
+        return *ptr == delimiter || *ptr == '\0' || *ptr == '\r' || *ptr == '\n';
+    }
+
+    inline bool blank(const char *line) {
+        return line[std::strspn(line, " \t\r\n")] == '\0';
+    }
+
+    template <int N, char DELIMITER>
+    inline const char *skip_fields(const char *ptr) {
+        if constexpr (N == 0) {
+            return ptr;
+        }
+        else {
+            ptr = std::strchr(ptr, DELIMITER);
+            return ptr == nullptr ? nullptr : skip_fields<N - 1, DELIMITER>(ptr + 1);
+        }
+    }
+
+    template <typename DIALECT>
+    inline bool parse_line(const char *line, double freq, double &time, double &value) {
+        constexpr char delim = DIALECT::delimiter;
+        const char *ptr = skip_fields<DIALECT::time_column, delim>(line);
+        const char *end = ptr == nullptr ? nullptr : read_number(ptr, ptr + std::strlen(ptr), time);
+        if (end == nullptr || !field_ends(end, delim)) {
+            return false;
+        }
+        ptr = skip_fields<DIALECT::value_column - DIALECT::time_column, delim>(end);
+        end = ptr == nullptr ? nullptr : read_number(ptr, ptr + std::strlen(ptr), value);
+        if (end == nullptr || !field_ends(end, delim)) {
+            return false;
+        }
+        if constexpr (DIALECT::indexed) {
+            time /= freq;
+        }
+        return true;
+    }
+
+    // Parses every line after the header: first those already read into head, then the rest of the reader. Returns
+    // false at the first line that does not fit the dialect.
+    template <typename DIALECT, typename TIMES, typename VOLTS>
+    bool parse_capture(const std::vector<std::string> &head, size_t header_lines, Capture_reader &reader, double freq,
+                       TIMES &times, VOLTS &values) {
+        typedef typename VOLTS::value_type sample; // the voltages may be kept in less precision than the times
+        double time, value;
+        for (size_t i = header_lines; i < head.size(); ++i) {
+            if (!parse_line<DIALECT>(head[i].c_str(), freq, time, value)) {
+                if (blank(head[i].c_str())) {
+                    continue;
+                }
+                return false;
+            }
+            times.push_back(time);
+            values.push_back((sample) value);
+        }
+        char buffer[512];
+        for (size_t i = head.size(); i < header_lines && reader.gets(buffer, sizeof(buffer)) != nullptr; ++i) {}
+        while (reader.gets(buffer, sizeof(buffer)) != nullptr) {
+            if (!parse_line<DIALECT>(buffer, freq, time, value)) {
+                if (blank(buffer)) { // e.g. a trailing empty line
+                    continue;
+                }
+                return false;
+            }
+            times.push_back(time);
+            values.push_back((sample) value);
+        }
+        return true;
+    }
+
+    // moves the end of the header back over lines that, though not data lines as a whole, hold data in the dialect's
+    // columns (Tektronix scopes put their settings in the first columns of the first data lines)
+    template <typename DIALECT>
+    inline size_t extend_back(const std::vector<std::string> &head, size_t first) {
+        double time, value;
+        while (first > 0 && parse_line<DIALECT>(head[first - 1].c_str(), 1, time, value)) {
+            --first;
+        }
+        return first;
+    }
+
+    // Columns holding numbers in a data line, i.e. one in which every non-empty field is a number. Returns false for
+    // header lines.
+    inline bool data_columns(const std::string &line, char delimiter, std::vector<int> &columns,
+                             std::vector<double> &numbers) {
+        columns.clear();
+        numbers.clear();
+        const char *ptr = line.c_str();
+        for (int col = 0; ; ++col) {
+            const char *end = std::strchr(ptr, delimiter);
+            if (end == nullptr) {
+                end = ptr + std::strlen(ptr);
+            }
+            const char *last = end;
+            while (last != ptr && (last[-1] == '\r' || last[-1] == '\n' || last[-1] == ' ')) {
+                --last;
+            }
+            const char *first = ptr;
+            while (first != last && *first == ' ') {
+                ++first;
+            }
+            if (first != last) {
+                double number;
+                if (read_number(first, last, number) != last) {
+                    return false;
+                }
+                columns.push_back(col);
+                numbers.push_back(number);
+            }
+            if (*end == '\0') {
+                break;
+            }
+            ptr = end + 1;
+        }
+        return columns.size() >= 2;
+    }
+
+    // Works out the dialect from the first lines of a capture: the header ends at the first data line that the next
+    // few data lines agree with, and the delimiter and the columns of those lines decide the rest.
+    inline detected_dialect detect_dialect(const std::vector<std::string> &head) {
+        static constexpr size_t confirm = 3;
+        std::vector<int> columns, next_columns;
+        std::vector<double> numbers, next_numbers;
+        for (char delimiter : {',', ';', '\t'}) {
+            for (size_t i = 0; i < head.size(); ++i) {
+                if (!data_columns(head[i], delimiter, columns, numbers)) {
+                    continue;
+                }
+                bool consistent = true, counting = numbers[0] == std::floor(numbers[0]);
+                double previous = numbers[0];
+                for (size_t j = i + 1; j < head.size() && j <= i + confirm && consistent; ++j) {
+                    consistent = data_columns(head[j], delimiter, next_columns, next_numbers) &&
+                                 next_columns == columns;
+                    counting = counting && consistent && next_numbers[0] == previous + 1;
+                    previous = consistent ? next_numbers[0] : previous;
+                }
+                if (!consistent) {
+                    continue;
+                }
+                detected_dialect found;
+                found.header_lines = i;
+                if (delimiter == ';' && columns[0] == 0 && columns[1] == 1) {
+                    found.id = dialect_id::semicolon_csv;
+                }
+                else if (delimiter == '\t' && columns[0] == 0 && columns[1] == 1) {
+                    found.id = dialect_id::tab_csv;
+                }
+                else if (delimiter == ',' && columns[0] == 3 && columns[1] == 4) {
+                    found.id = dialect_id::tek_csv;
+                    found.header_lines = extend_back<tek_csv>(head, i);
+                }
+                else if (delimiter == ',' && columns.size() >= 3 && columns[0] == 0 && columns[2] == 2 && counting) {
+                    found.id = dialect_id::index_csv;
+                }
+                else if (delimiter == ',' && columns[0] == 0 && columns[1] == 1) {
+                    found.id = dialect_id::time_csv;
+                }
+                return found;
+            }
+        }
+        return {};
+    }
+}
+#endif
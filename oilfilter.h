@@ -0,0 +1,313 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILFILTER_H
+#define OILFILTER_H
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace oil {
+
+    enum class filter_kind {none, automatic, moving_average, fir, iir, polyphase};
+
+    // Low-pass stage run on the voltages between reading a capture and looking for its maxima. The cutoff is in Hz and
+    // is compared with the sample rate: "automatic" uses no filter at or above Nyquist, a FIR filter down to a tenth of
+    // the sample rate, and a decimating polyphase FIR below that, where a plain FIR would need too many taps. The FIR
+    // filters and the moving average are centred, so they do not shift the maxima in time; the IIR filter (fourth
+    // order Butterworth) is causal, which delays every maximum by about the same amount and so leaves T unchanged.
+    class Prefilter {
+    private:
+        static constexpr size_t block = 4096; // outputs per pass over the scratch buffer
+        static constexpr size_t max_taps = 4097;
+        filter_kind kind = filter_kind::none;
+        double cutoff = 0;
+        static double dot(const double *a, const double *b, size_t n) {
+            size_t i = 0;
+            double total = 0;
+#if defined(__AVX__)
+            __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+            for (; i + 8 <= n; i += 8) {
+                acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+                acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+            }
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+            total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+            __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+            total = lanes[0] + lanes[1];
+#endif
+            for (; i < n; ++i) {
+                total += a[i]*b[i];
+            }
+            return total;
+        }
+        // as above with twice the lanes, for float samples
+        static float dot(const float *a, const float *b, size_t n) {
+            size_t i = 0;
+            float total = 0;
+#if defined(__AVX__)
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+            for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+            }
+            float lanes[8];
+            _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+            total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+#elif defined(__SSE2__)
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+            for (; i + 8 <= n; i += 8) {
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+            total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+            for (; i < n; ++i) {
+                total += a[i]*b[i];
+            }
+            return total;
+        }
+        // Blackman-windowed sinc with unit DC gain; fc is the cutoff as a fraction of the sample rate
+        static std::vector<double> design_lowpass(double fc) {
+            auto taps = (size_t) std::ceil(5.5/fc);
+            taps = std::min(taps | 1, max_taps); // odd, so that the delay is a whole number of samples
+            std::vector<double> h(taps);
+            double mid = (double) (taps - 1)/2, sum = 0;
+            for (size_t k = 0; k < taps; ++k) {
+                double t = (double) k - mid;
+                double sinc = t == 0 ? 2*fc : std::sin(2*M_PI*fc*t)/(M_PI*t);
+                double window = taps == 1 ? 1 : 0.42 - 0.5*std::cos(2*M_PI*k/(taps - 1)) +
+                                                0.08*std::cos(4*M_PI*k/(taps - 1));
+                h[k] = sinc*window;
+                sum += h[k];
+            }
+            for (double &tap : h) {
+                tap /= sum;
+            }
+            return h;
+        }
+        // Streams values through a scratch buffer a block at a time and overwrites them in place with the outputs,
+        // which are values.size()/step long (rounded up). Output m is kernel(window) over the inputs
+        // [m*step - delay, m*step - delay + width), the ends being padded with the first and last input. The scratch
+        // buffer holds the type of the values, so that float samples are filtered in float.
+        template <typename SAMPLES, typename KERNEL>
+        static size_t stream(SAMPLES &values, size_t width, size_t step, KERNEL kernel) {
+            typedef typename SAMPLES::value_type sample;
+            size_t n = values.size();
+            if (n == 0) {
+                return 0;
+            }
+            auto delay = (long long) (width - 1)/2;
+            sample first = values.front(), last = values.back();
+            size_t out_n = (n + step - 1)/step;
+            std::vector<sample> scratch((block - 1)*step + width);
+            std::vector<sample> out(block);
+            auto rd = values.begin();
+            long long next_read = 0; // index of the input *rd
+            auto fetch = [&](long long index) { // index only ever increases
+                if (index < 0) {
+                    return first;
+                }
+                if (index >= (long long) n) {
+                    return last;
+                }
+                for (; next_read < index; ++next_read) {
+                    ++rd;
+                }
+                ++next_read;
+                return *rd++;
+            };
+            auto wr = values.begin();
+            long long scratch_start = -delay;
+            size_t have = 0;
+            for (size_t m0 = 0; m0 < out_n; m0 += block) {
+                size_t count = std::min(block, out_n - m0);
+                long long start = (long long) (m0*step) - delay;
+                size_t len = (count - 1)*step + width;
+                auto drop = (size_t) (start - scratch_start);
+                if (drop < have) {
+                    std::memmove(scratch.data(), scratch.data() + drop, (have - drop)*sizeof(sample));
+                    have -= drop;
+                }
+                else {
+                    have = 0;
+                }
+                scratch_start = start;
+                for (; have < len; ++have) {
+                    scratch[have] = fetch(start + (long long) have);
+                }
+                kernel(scratch.data(), count, out.data());
+                for (size_t i = 0; i < count; ++i, ++wr) { // never ahead of the inputs still to be read
+                    *wr = out[i];
+                }
+            }
+            values.resize(out_n);
+            return out_n;
+        }
+        template <typename SAMPLES>
+        static void fir(SAMPLES &values, const std::vector<double> &h, size_t step) {
+            typedef typename SAMPLES::value_type sample;
+            std::vector<sample> taps(h.begin(), h.end());
+            stream(values, h.size(), step, [&taps, step](const sample *x, size_t count, sample *y) {
+                for (size_t i = 0; i < count; ++i) {
+                    y[i] = dot(taps.data(), x + i*step, taps.size()); // symmetric, so no need to reverse them
+                }
+            });
+        }
+        template <typename SAMPLES>
+        static void moving_average(SAMPLES &values, size_t width) {
+            typedef typename SAMPLES::value_type sample;
+            stream(values, width, 1, [width](const sample *x, size_t count, sample *y) {
+                double sum = 0; // in double whatever the samples are
+                for (size_t k = 0; k < width; ++k) { // summed afresh every block so that rounding cannot build up
+                    sum += x[k];
+                }
+                y[0] = (sample) (sum/(double) width);
+                for (size_t i = 1; i < count; ++i) {
+                    sum += (double) x[i + width - 1] - x[i - 1];
+                    y[i] = (sample) (sum/(double) width);
+                }
+            });
+        }
+        template <typename SAMPLES>
+        static void butterworth(SAMPLES &values, double fc) {
+            if (values.empty()) {
+                return;
+            }
+            const double qs[2] = {0.54119610, 1.30656296}; // fourth order as two biquads
+            double w0 = 2*M_PI*fc, cos_w0 = std::cos(w0);
+            double b[2][3], a[2][3], z[2][2];
+            for (int s = 0; s < 2; ++s) {
+                double alpha = std::sin(w0)/(2*qs[s]), a0 = 1 + alpha;
+                b[s][0] = b[s][2] = (1 - cos_w0)/2/a0;
+                b[s][1] = (1 - cos_w0)/a0;
+                a[s][1] = -2*cos_w0/a0;
+                a[s][2] = (1 - alpha)/a0;
+                z[s][0] = (1 - b[s][0])*values.front(); // start as if the first voltage had always been there
+                z[s][1] = (b[s][2] - a[s][2])*values.front();
+            }
+            for (auto &value : values) { // the state is kept in double, as the poles are close to the unit circle
+                double x = value;
+                for (int s = 0; s < 2; ++s) {
+                    double y = b[s][0]*x + z[s][0];
+                    z[s][0] = b[s][1]*x - a[s][1]*y + z[s][1];
+                    z[s][1] = b[s][2]*x - a[s][2]*y;
+                    x = y;
+                }
+                value = (typename SAMPLES::value_type) x;
+            }
+        }
+    public:
+        Prefilter() = default;
+        Prefilter(filter_kind filter, double cutoff_hz) : kind(filter), cutoff(cutoff_hz) {
+            if (filter != filter_kind::none && !(cutoff_hz > 0)) {
+                throw std::invalid_argument("The filter cutoff must be a positive frequency.\n");
+            }
+        }
+        static filter_kind kind_of(const std::string &name) {
+            if (name == "auto") {
+                return filter_kind::automatic;
+            }
+            if (name == "ma") {
+                return filter_kind::moving_average;
+            }
+            if (name == "fir") {
+                return filter_kind::fir;
+            }
+            if (name == "iir") {
+                return filter_kind::iir;
+            }
+            if (name == "poly") {
+                return filter_kind::polyphase;
+            }
+            if (name == "none") {
+                return filter_kind::none;
+            }
+            throw std::invalid_argument("The filter must be one of auto, ma, fir, iir, poly or none.\n");
+        }
+        static const char *name_of(filter_kind filter) {
+            switch (filter) {
+                case filter_kind::automatic:
+                    return "auto";
+                case filter_kind::moving_average:
+                    return "ma";
+                case filter_kind::fir:
+                    return "fir";
+                case filter_kind::iir:
+                    return "iir";
+                case filter_kind::polyphase:
+                    return "poly";
+                default:
+                    return "none";
+            }
+        }
+        // the filter actually run at a sample rate of freq
+        [[nodiscard]] filter_kind resolve(double freq) const {
+            if (kind == filter_kind::none || cutoff >= freq/2) {
+                return filter_kind::none;
+            }
+            if (kind != filter_kind::automatic) {
+                return kind;
+            }
+            return cutoff >= freq/10 ? filter_kind::fir : filter_kind::polyphase;
+        }
+        // the times are only touched by the polyphase filter, which keeps every decimation()-th one
+        [[nodiscard]] size_t decimation(double freq) const {
+            if (resolve(freq) != filter_kind::polyphase) {
+                return 1;
+            }
+            // 20 samples per cycle at the cutoff, so that the maxima times are not coarsened much
+            return std::max<size_t>(2, (size_t) (freq/(20*cutoff)));
+        }
+        // the times are double, the values double or float
+        template <typename TIMES, typename VOLTS>
+        void apply(TIMES &times, VOLTS &values, double freq) const {
+            double fc = cutoff/freq;
+            switch (resolve(freq)) {
+                case filter_kind::moving_average:
+                    moving_average(values, std::max<size_t>(1, (size_t) std::lround(0.443/fc))); // -3 dB at cutoff
+                    break;
+                case filter_kind::fir:
+                    fir(values, design_lowpass(fc), 1);
+                    break;
+                case filter_kind::iir:
+                    butterworth(values, fc);
+                    break;
+                case filter_kind::polyphase: {
+                    size_t step = decimation(freq);
+                    fir(values, design_lowpass(fc), step); // only the outputs that are kept get computed
+                    for (size_t m = 1; m < values.size(); ++m) {
+                        times[m] = times[m*step];
+                    }
+                    times.resize(values.size());
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    };
+}
+#endif
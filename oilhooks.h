@@ -0,0 +1,140 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILHOOKS_H
+#define OILHOOKS_H
+
+// Allocator hooks for the memory profile of oilprofile.h. They replace malloc() and friends, and the global operator
+// new and delete, so this header must be included by one translation unit of a program only (Oil.cpp), and only does
+// anything when the program is built with OIL_PROFILE_ALLOCATIONS defined, e.g. -DOIL_PROFILE_ALLOCATIONS. The hooks
+// hand every call on to glibc's own allocator, sizing blocks with malloc_usable_size(), so they need glibc; elsewhere
+// the profile has the stage timings and RSS but no allocation counts.
+
+#include <cstddef> // for __GLIBC__
+
+#if defined(OIL_PROFILE_ALLOCATIONS) && defined(__GLIBC__)
+
+#include <cerrno>
+#include <new>
+#include <malloc.h>
+
+#include "oilprofile.h"
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *ptr);
+
+    void *malloc(size_t size) {
+        void *ptr = __libc_malloc(size);
+        if (ptr != nullptr) {
+            oil::prof::hooked.store(true, std::memory_order_relaxed);
+            oil::prof::note_allocation(ptr, malloc_usable_size(ptr));
+        }
+        return ptr;
+    }
+
+    void *calloc(size_t count, size_t size) {
+        void *ptr = __libc_calloc(count, size);
+        if (ptr != nullptr) {
+            oil::prof::note_allocation(ptr, malloc_usable_size(ptr));
+        }
+        return ptr;
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        size_t old = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+        // before the block can be freed, so that another thread cannot be handed the same address in between
+        bool counted = ptr != nullptr && oil::prof::note_free(ptr, old);
+        void *moved = __libc_realloc(ptr, size);
+        if (moved != nullptr) {
+            oil::prof::note_allocation(moved, malloc_usable_size(moved));
+        }
+        else if (size != 0 && counted) { // a failed realloc() leaves the old block alone
+            oil::prof::note_allocation(ptr, old);
+        }
+        return moved;
+    }
+
+    void free(void *ptr) {
+        if (ptr != nullptr) {
+            oil::prof::note_free(ptr, malloc_usable_size(ptr));
+            __libc_free(ptr);
+        }
+    }
+
+    void *memalign(size_t alignment, size_t size) {
+        void *ptr = __libc_memalign(alignment, size);
+        if (ptr != nullptr) {
+            oil::prof::note_allocation(ptr, malloc_usable_size(ptr));
+        }
+        return ptr;
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size) {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void **out, size_t alignment, size_t size) {
+        if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+            return EINVAL;
+        }
+        void *ptr = memalign(alignment, size);
+        if (ptr == nullptr) {
+            return ENOMEM;
+        }
+        *out = ptr;
+        return 0;
+    }
+}
+
+// operator new and delete go through the hooks above rather than relying on the C++ runtime to call malloc()
+void *operator new(size_t size) {
+    void *ptr = malloc(size != 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size != 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+#endif
+#endif
@@ -0,0 +1,687 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILIO_H
+#define OILIO_H
+
+// Compressed captures (.csv.gz/.csv.zst) are decompressed in-process if compiled with -DOIL_USE_ZLIB (link with -lz)
+// and/or -DOIL_USE_ZSTD (link with -lzstd), and otherwise by piping them through the gzip/zstd executables.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef OIL_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OIL_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <csignal>
+extern char **environ;
+#endif
+
+namespace oil {
+
+    namespace io {
+
+        enum class compression {none, gzip, zstd};
+
+        inline bool ends_with(const std::string &str, const char *suffix) {
+            size_t len = std::strlen(suffix);
+            return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+        }
+
+        inline bool is_capture_path(const std::string &path) {
+            return ends_with(path, ".csv") || ends_with(path, ".csv.gz") || ends_with(path, ".csv.zst") ||
+                   ends_with(path, ".expv");
+        }
+
+        inline std::string strip_capture_ext(std::string path) {
+            for (const char *suffix : {".gz", ".zst", ".csv", ".expv"}) {
+                if (ends_with(path, suffix)) {
+                    path.erase(path.size() - std::strlen(suffix));
+                }
+            }
+            return path;
+        }
+
+        // file name without its directory and capture extension(s), e.g. "/a/b/run1.csv.gz" -> "run1"
+        inline std::string capture_stem(const std::string &path) {
+#ifndef _WIN32
+            std::string::size_type slash_pos = path.rfind('/');
+#else
+            std::string::size_type slash_pos = path.rfind('\\');
+#endif
+            return strip_capture_ext(path.substr(slash_pos == std::string::npos ? 0 : slash_pos + 1));
+        }
+
+        // stdin ("-"), or a FIFO or other file that can only be read once, front to back
+        inline bool is_stream(const char *path) {
+            if (std::strcmp(path, "-") == 0) {
+                return true;
+            }
+#ifndef _WIN32
+            struct stat info = {};
+            return stat(path, &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode) ||
+                                              S_ISSOCK(info.st_mode));
+#else
+            return false;
+#endif
+        }
+
+        // the magic number takes precedence over the extension
+        inline compression detect_compression(const char *path, const unsigned char *magic, size_t got) {
+            if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+                return compression::gzip;
+            }
+            if (got >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+                return compression::zstd;
+            }
+            std::string path_str(path);
+            if (ends_with(path_str, ".gz")) {
+                return compression::gzip;
+            }
+            if (ends_with(path_str, ".zst")) {
+                return compression::zstd;
+            }
+            return compression::none;
+        }
+
+        inline compression detect_compression(const char *path) {
+            unsigned char magic[4] = {0, 0, 0, 0};
+            size_t got = 0;
+            FILE *fp = fopen(path, "rb");
+            if (fp != nullptr) {
+                got = fread(magic, 1, 4, fp);
+                fclose(fp);
+            }
+            return detect_compression(path, magic, got);
+        }
+
+        // Reads a capture line by line with fgets() semantics. Compressed captures are decompressed on a separate
+        // thread into a small ring of chunks, so decompression overlaps with the parsing done by the caller and
+        // nothing is written to disk.
+        class Capture_reader {
+        private:
+            class DecompressionError : public std::exception {
+                [[nodiscard]] const char *what() const noexcept override {
+                    return "The compressed capture is corrupt or could not be decompressed.";
+                }
+            };
+            static constexpr size_t chunk_size = 1 << 20;
+            static constexpr size_t num_chunks = 4;
+            struct chunk {
+                std::vector<char> data;
+                size_t size = 0;
+            };
+            compression comp = compression::none;
+            FILE *plain = nullptr;
+            bool borrowed = false; // plain is stdin, which is not ours to close
+            const char *mem = nullptr; // plain capture already read into memory, e.g. by a Prefetcher
+            size_t mem_size = 0;
+            size_t mem_pos = 0;
+            chunk chunks[num_chunks];
+            size_t head = 0; // next chunk to be read by the parser
+            size_t filled = 0; // chunks ready for the parser
+            size_t pos = 0; // position within chunks[head]
+            bool holding = false; // whether the parser holds chunks[head]
+            bool eof = false;
+            bool failed = false;
+            bool stop = false;
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::thread producer;
+#ifndef _WIN32
+            pid_t child = -1;
+#endif
+            // fills chunks until source() returns 0 (end of stream) or -1 (error)
+            template <typename SOURCE>
+            void produce(SOURCE source) {
+                size_t tail = 0;
+                while (true) {
+                    {
+                        std::unique_lock<std::mutex> lock(mtx);
+                        cv.wait(lock, [this] { return stop || filled < num_chunks; });
+                        if (stop) {
+                            return;
+                        }
+                    }
+                    chunk &ch = chunks[tail];
+                    ch.data.resize(chunk_size);
+                    long got = 0;
+                    size_t total = 0;
+                    while (total < chunk_size && (got = source(ch.data.data() + total, chunk_size - total)) > 0) {
+                        total += (size_t) got;
+                    }
+                    ch.size = total;
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (total > 0) {
+                        ++filled;
+                        tail = (tail + 1) % num_chunks;
+                    }
+                    if (got <= 0) {
+                        eof = true;
+                        failed = got < 0;
+                        cv.notify_all();
+                        return;
+                    }
+                    cv.notify_all();
+                }
+            }
+            void start_decompression(const char *path) {
+                switch (comp) {
+#ifdef OIL_USE_ZLIB
+                    case compression::gzip: {
+                        gzFile gz = gzopen(path, "rb");
+                        if (gz == nullptr) {
+                            throw std::invalid_argument("Error opening file.\n");
+                        }
+                        gzbuffer(gz, 1 << 18);
+                        producer = std::thread([this, gz] {
+                            produce([gz](char *buf, size_t len) -> long {
+                                int got = gzread(gz, buf, (unsigned) len);
+                                int err = Z_OK;
+                                if (got == 0) {
+                                    gzerror(gz, &err); // truncated captures end with Z_BUF_ERROR rather than -1
+                                }
+                                return err == Z_OK ? got : -1;
+                            });
+                            gzclose(gz);
+                        });
+                        return;
+                    }
+#endif
+#ifdef OIL_USE_ZSTD
+                    case compression::zstd: {
+                        FILE *fp = fopen(path, "rb");
+                        if (fp == nullptr) {
+                            throw std::invalid_argument("Error opening file.\n");
+                        }
+                        producer = std::thread([this, fp] {
+                            ZSTD_DStream *ds = ZSTD_createDStream();
+                            ZSTD_initDStream(ds);
+                            std::vector<char> in_buf(ZSTD_DStreamInSize());
+                            ZSTD_inBuffer in = {in_buf.data(), 0, 0};
+                            bool at_eof = false;
+                            size_t hint = 0; // from the last call that did anything: 0 once a frame is complete
+                            produce([&](char *buf, size_t len) -> long {
+                                ZSTD_outBuffer out = {buf, len, 0};
+                                while (out.pos == 0) {
+                                    if (in.pos == in.size && !at_eof) {
+                                        in.size = fread(in_buf.data(), 1, in_buf.size(), fp);
+                                        in.pos = 0;
+                                        at_eof = in.size == 0;
+                                    }
+                                    // at the end of the file the decoder may still hold output, so it is called with
+                                    // no input until it gives none; a frame that is still open then was truncated
+                                    size_t was = in.pos;
+                                    size_t ret = ZSTD_decompressStream(ds, &out, &in);
+                                    if (ZSTD_isError(ret)) {
+                                        return -1;
+                                    }
+                                    if (in.pos != was || out.pos != 0) {
+                                        hint = ret;
+                                    }
+                                    else if (at_eof) {
+                                        return hint == 0 ? 0 : -1;
+                                    }
+                                }
+                                return (long) out.pos;
+                            });
+                            ZSTD_freeDStream(ds);
+                            fclose(fp);
+                        });
+                        return;
+                    }
+#endif
+                    default: {
+#ifndef _WIN32
+                        // no in-process decompressor: pipe the capture through gzip -dc/zstd -dc instead
+                        const char *prog = comp == compression::gzip ? "gzip" : "zstd";
+                        int fds[2];
+                        if (pipe(fds) == -1) {
+                            throw std::invalid_argument("Error opening file.\n");
+                        }
+                        posix_spawn_file_actions_t actions;
+                        posix_spawn_file_actions_init(&actions);
+                        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+                        posix_spawn_file_actions_addclose(&actions, fds[0]);
+                        posix_spawn_file_actions_addclose(&actions, fds[1]);
+                        char *args[] = {(char *) prog, (char *) "-dc", (char *) "--", (char *) path, nullptr};
+                        int spawned = posix_spawnp(&child, prog, &actions, nullptr, args, environ);
+                        posix_spawn_file_actions_destroy(&actions);
+                        ::close(fds[1]);
+                        if (spawned != 0) {
+                            ::close(fds[0]);
+                            child = -1;
+                            throw std::invalid_argument("No decompressor available for the capture provided.\n");
+                        }
+                        int fd = fds[0];
+                        producer = std::thread([this, fd] {
+                            produce([this, fd](char *buf, size_t len) -> long {
+                                long got = (long) read(fd, buf, len);
+                                if (got == 0) { // a truncated or corrupt capture only shows in the exit status
+                                    int status;
+                                    waitpid(child, &status, 0);
+                                    child = -1;
+                                    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+                                }
+                                return got;
+                            });
+                            ::close(fd);
+                        });
+#else
+                        throw std::invalid_argument("Compressed captures are not supported on this platform.\n");
+#endif
+                    }
+                }
+            }
+            bool next_chunk() {
+                std::unique_lock<std::mutex> lock(mtx);
+                if (holding) {
+                    holding = false;
+                    head = (head + 1) % num_chunks;
+                    --filled;
+                    cv.notify_all();
+                }
+                cv.wait(lock, [this] { return filled > 0 || eof; });
+                if (filled == 0) {
+                    if (failed) {
+                        throw DecompressionError();
+                    }
+                    return false;
+                }
+                holding = true;
+                pos = 0;
+                return true;
+            }
+        public:
+            Capture_reader() = default;
+            explicit Capture_reader(const char *path) {
+                open(path);
+            }
+            Capture_reader(const Capture_reader &) = delete;
+            Capture_reader &operator=(const Capture_reader &) = delete;
+            void open(const char *path) {
+                close();
+                comp = detect_compression(path);
+                if (comp == compression::none) {
+                    plain = fopen(path, "r");
+                    if (plain == nullptr) {
+                        throw std::invalid_argument("Error opening file.\n");
+                    }
+                    return;
+                }
+                head = filled = pos = 0;
+                holding = eof = failed = stop = false;
+                start_decompression(path);
+            }
+            // Reads a stream (see is_stream()) as a plain capture. Nothing is read ahead of the parser to look for a
+            // compression magic number, as that could not be put back, so compressed streams are not recognised.
+            void open_stream(const char *path) {
+                close();
+                comp = compression::none;
+                if (std::strcmp(path, "-") == 0) {
+                    plain = stdin;
+                    borrowed = true;
+                    return;
+                }
+                plain = fopen(path, "r"); // waits for a writer if path is a FIFO
+                if (plain == nullptr) {
+                    throw std::invalid_argument("Error opening file.\n");
+                }
+            }
+            // parses the bytes of a plain capture instead of reading path, which must outlive this reader; compressed
+            // captures are still read from path
+            void open(const char *path, const char *bytes, size_t size) {
+                close();
+                if (detect_compression(path, (const unsigned char *) bytes, std::min<size_t>(size, 4)) !=
+                    compression::none) {
+                    open(path);
+                    return;
+                }
+                comp = compression::none;
+                mem = bytes;
+                mem_size = size;
+                mem_pos = 0;
+            }
+            [[nodiscard]] compression type() const {
+                return comp;
+            }
+            char *gets(char *buffer, int size) {
+                if (plain != nullptr) {
+                    return fgets(buffer, size, plain);
+                }
+                if (mem != nullptr) {
+                    if (mem_pos == mem_size || size < 2) {
+                        return nullptr;
+                    }
+                    size_t avail = std::min(mem_size - mem_pos, (size_t) (size - 1));
+                    const char *start = mem + mem_pos;
+                    const char *nl = (const char *) std::memchr(start, '\n', avail);
+                    size_t take = nl != nullptr ? (size_t) (nl - start) + 1 : avail;
+                    std::memcpy(buffer, start, take);
+                    buffer[take] = '\0';
+                    mem_pos += take;
+                    return buffer;
+                }
+                int len = 0;
+                while (len < size - 1) {
+                    if (!holding || pos == chunks[head].size) {
+                        if (!next_chunk()) {
+                            break;
+                        }
+                    }
+                    const chunk &ch = chunks[head];
+                    size_t avail = std::min(ch.size - pos, (size_t) (size - 1 - len));
+                    const char *start = ch.data.data() + pos;
+                    const char *nl = (const char *) std::memchr(start, '\n', avail);
+                    size_t take = nl != nullptr ? (size_t) (nl - start) + 1 : avail;
+                    std::memcpy(buffer + len, start, take);
+                    len += (int) take;
+                    pos += take;
+                    if (nl != nullptr) {
+                        break;
+                    }
+                }
+                if (len == 0) {
+                    return nullptr;
+                }
+                buffer[len] = '\0';
+                return buffer;
+            }
+            void close() {
+                if (plain != nullptr && !borrowed) {
+                    fclose(plain);
+                }
+                plain = nullptr;
+                borrowed = false;
+                mem = nullptr;
+                if (producer.joinable()) {
+                    {
+                        std::lock_guard<std::mutex> lock(mtx);
+                        stop = true;
+                    }
+                    cv.notify_all();
+                    producer.join();
+                }
+#ifndef _WIN32
+                if (child > 0) { // the parser stopped before the end of the capture
+                    kill(child, SIGTERM);
+                    waitpid(child, nullptr, 0);
+                    child = -1;
+                }
+#endif
+            }
+            ~Capture_reader() {
+                close();
+            }
+        };
+
+        // Compact binary capture (".expv"), made once from a CSV capture by convert_capture(): a fixed header, one
+        // {scale, offset} pair per channel, then each channel's samples packed one after the other as float32 or
+        // int16 (value = raw*scale + offset). Channel i is CSV column i + 2, so get_T() analyses channel 1.
+        enum class sample_format : uint32_t {float32 = 0, int16 = 1};
+
+        struct capture_header {
+            char magic[8];
+            uint32_t version;
+            sample_format format;
+            double sample_rate;
+            uint64_t first_index; // sample i was taken at (first_index + i)/sample_rate
+            uint64_t num_samples;
+            uint32_t num_channels;
+            uint32_t reserved;
+        };
+
+        struct channel_scale {
+            double scale;
+            double offset;
+        };
+
+        constexpr char capture_magic[8] = {'E', 'X', 'P', 'V', 'C', 'A', 'P', '1'};
+
+        inline bool is_binary_capture(const char *path) {
+            char magic[8];
+            FILE *fp = fopen(path, "rb");
+            if (fp == nullptr) {
+                return false;
+            }
+            bool is_bin = fread(magic, 1, 8, fp) == 8 && std::memcmp(magic, capture_magic, 8) == 0;
+            fclose(fp);
+            return is_bin;
+        }
+
+        class Binary_capture {
+        private:
+            class CaptureFormatError : public std::exception {
+                [[nodiscard]] const char *what() const noexcept override {
+                    return "The binary capture is truncated or was not written by this program.";
+                }
+            };
+            const char *base = nullptr;
+            size_t length = 0;
+            const capture_header *hdr = nullptr;
+            const channel_scale *scales = nullptr;
+            const char *samples = nullptr;
+            [[nodiscard]] size_t sample_size() const {
+                return hdr->format == sample_format::int16 ? sizeof(int16_t) : sizeof(float);
+            }
+        public:
+            Binary_capture() = default;
+            explicit Binary_capture(const char *path) {
+                open(path);
+            }
+            Binary_capture(const Binary_capture &) = delete;
+            Binary_capture &operator=(const Binary_capture &) = delete;
+            void open(const char *path) {
+                close();
+#ifndef _WIN32
+                int fd = ::open(path, O_RDONLY);
+                struct stat info = {};
+                if (fd == -1 || fstat(fd, &info) == -1) {
+                    if (fd != -1) {
+                        ::close(fd);
+                    }
+                    throw std::invalid_argument("Error opening file.\n");
+                }
+                length = (size_t) info.st_size;
+                void *mapped = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+                ::close(fd);
+                if (mapped == MAP_FAILED) {
+                    length = 0;
+                    throw CaptureFormatError();
+                }
+                madvise(mapped, length, MADV_SEQUENTIAL);
+                base = (const char *) mapped;
+#else
+                FILE *fp = fopen(path, "rb");
+                if (fp == nullptr) {
+                    throw std::invalid_argument("Error opening file.\n");
+                }
+                fseek(fp, 0, SEEK_END);
+                length = (size_t) ftell(fp);
+                fseek(fp, 0, SEEK_SET);
+                char *buffer = (char *) malloc(length);
+                length = fread(buffer, 1, length, fp);
+                fclose(fp);
+                base = buffer;
+#endif
+                hdr = (const capture_header *) base;
+                if (length < sizeof(capture_header) || std::memcmp(hdr->magic, capture_magic, 8) != 0 ||
+                    hdr->version != 1 || hdr->num_channels == 0 ||
+                    length < sizeof(capture_header) + hdr->num_channels*(sizeof(channel_scale) +
+                                                                           hdr->num_samples*sample_size())) {
+                    close();
+                    throw CaptureFormatError();
+                }
+                scales = (const channel_scale *) (base + sizeof(capture_header));
+                samples = (const char *) (scales + hdr->num_channels);
+            }
+            [[nodiscard]] const capture_header &header() const {
+                return *hdr;
+            }
+            [[nodiscard]] double time(uint64_t i) const {
+                return (double) (hdr->first_index + i) / hdr->sample_rate;
+            }
+            // calls func(time, value) for every sample of the channel
+            template <typename FUNC>
+            void for_each(uint32_t channel, FUNC func) const {
+                if (channel >= hdr->num_channels) {
+                    throw std::out_of_range("The binary capture does not have that many channels.");
+                }
+                const double scale = scales[channel].scale;
+                const double offset = scales[channel].offset;
+                const uint64_t n = hdr->num_samples;
+                const char *raw = samples + channel*n*sample_size();
+                if (hdr->format == sample_format::int16) {
+                    const auto *vals = (const int16_t *) raw;
+                    for (uint64_t i = 0; i < n; ++i) {
+                        func(time(i), vals[i]*scale + offset);
+                    }
+                }
+                else {
+                    const auto *vals = (const float *) raw;
+                    for (uint64_t i = 0; i < n; ++i) {
+                        func(time(i), vals[i]*scale + offset);
+                    }
+                }
+            }
+            void close() {
+                if (base != nullptr) {
+#ifndef _WIN32
+                    munmap((void *) base, length);
+#else
+                    free((void *) base);
+#endif
+                }
+                base = nullptr;
+                hdr = nullptr;
+                length = 0;
+            }
+            ~Binary_capture() {
+                close();
+            }
+        };
+
+        // Parses a CSV capture (plain or compressed) once and writes it out in the binary format. Returns the number
+        // of samples written.
+        inline uint64_t convert_capture(const char *csv_path, const char *out_path, double freq,
+                                        sample_format format = sample_format::float32, int skip_lines = 9) {
+            if (freq <= 0) {
+                throw std::invalid_argument("The sampling frequency must be positive.\n");
+            }
+            Capture_reader reader(csv_path);
+            std::vector<std::vector<float>> channels;
+            std::vector<double> ch_min, ch_max;
+            char buffer[512];
+            int count = 0;
+            uint64_t first_index = 0;
+            uint64_t num_samples = 0;
+            while (reader.gets(buffer, 512) != nullptr) {
+                if (count++ <= skip_lines) {
+                    continue;
+                }
+                char *end;
+                double index = strtod(buffer, &end);
+                if (end == buffer || *end != ',') {
+                    throw std::invalid_argument("Line " + std::to_string(count) + " of the capture is not valid.\n");
+                }
+                if (num_samples == 0) {
+                    first_index = (uint64_t) index;
+                }
+                else if ((uint64_t) index != first_index + num_samples) {
+                    throw std::invalid_argument("The capture's sample indices are not consecutive (line " +
+                                                std::to_string(count) + ").\n");
+                }
+                size_t ch = 0;
+                char *field = end + 1;
+                while (true) {
+                    double value = strtod(field, &end);
+                    if (end == field) {
+                        break;
+                    }
+                    if (num_samples == 0) {
+                        channels.emplace_back();
+                        ch_min.push_back(value);
+                        ch_max.push_back(value);
+                    }
+                    else if (ch >= channels.size()) {
+                        break;
+                    }
+                    channels[ch].push_back((float) value);
+                    ch_min[ch] = std::min(ch_min[ch], value);
+                    ch_max[ch] = std::max(ch_max[ch], value);
+                    ++ch;
+                    if (*end != ',') {
+                        break;
+                    }
+                    field = end + 1;
+                }
+                if (ch < 2 || ch != channels.size()) {
+                    throw std::invalid_argument("Line " + std::to_string(count) + " of the capture is not valid.\n");
+                }
+                ++num_samples;
+            }
+            reader.close();
+            capture_header hdr{};
+            std::memcpy(hdr.magic, capture_magic, 8);
+            hdr.version = 1;
+            hdr.format = format;
+            hdr.sample_rate = freq;
+            hdr.first_index = first_index;
+            hdr.num_samples = num_samples;
+            hdr.num_channels = (uint32_t) channels.size();
+            std::vector<channel_scale> scales(channels.size(), {1, 0});
+            if (format == sample_format::int16) {
+                for (size_t ch = 0; ch < channels.size(); ++ch) {
+                    scales[ch].offset = (ch_max[ch] + ch_min[ch]) / 2;
+                    scales[ch].scale = ch_max[ch] > ch_min[ch] ? (ch_max[ch] - ch_min[ch]) / 65534 : 1;
+                }
+            }
+            FILE *fp = fopen(out_path, "wb");
+            if (fp == nullptr) {
+                throw std::invalid_argument("The binary capture could not be written.\n");
+            }
+            fwrite(&hdr, sizeof(hdr), 1, fp);
+            fwrite(scales.data(), sizeof(channel_scale), scales.size(), fp);
+            std::vector<int16_t> packed;
+            for (size_t ch = 0; ch < channels.size(); ++ch) {
+                if (format == sample_format::int16) {
+                    packed.resize(num_samples);
+                    for (uint64_t i = 0; i < num_samples; ++i) {
+                        packed[i] = (int16_t) std::lround((channels[ch][i] - scales[ch].offset) / scales[ch].scale);
+                    }
+                    fwrite(packed.data(), sizeof(int16_t), num_samples, fp);
+                }
+                else {
+                    fwrite(channels[ch].data(), sizeof(float), num_samples, fp);
+                }
+            }
+            if (fclose(fp) != 0) {
+                throw std::invalid_argument("The binary capture could not be written.\n");
+            }
+            return num_samples;
+        }
+    }
+}
+#endif
@@ -0,0 +1,353 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILJOURNAL_H
+#define OILJOURNAL_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "oilnames.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    // Durable record of a batch of captures, so that a batch that was interrupted can be resumed where it stopped.
+    // The journal starts with the settings of the batch and every capture queued, and each capture then has its
+    // progress appended to it (parsed: T was found, analysed: the run was worked out, committed: it went through
+    // write_data(), or failed, with the reason), each entry synced to disk before the batch moves on. An analysed
+    // entry carries the run itself, so a resumed batch commits it without reading the capture again. A crash can
+    // only leave the last entry half written; it is dropped when the journal is next loaded.
+    template <typename REC>
+    class Journal {
+    public:
+        enum state : uint8_t {queued = 0, parsed = 1, analysed = 2, committed = 3, failed = 4};
+        struct job {
+            std::string path;
+            uint8_t state = queued;
+            std::string reason; // why it failed, or a note on how it was committed
+            REC result{}; // once analysed
+        };
+        // thrown when progress cannot be recorded, after which a batch must stop
+        class JournalWriteError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The batch journal could not be written.";
+            }
+        };
+    private:
+        class JournalFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The batch journal is corrupt or was not written by this program.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'J', 'R', 'N', '1'};
+        struct header {
+            char magic[8];
+            double freq;
+            char mode[4]; // "OW", "APP" or "DN", zero padded
+            uint8_t from_catalog;
+            uint8_t float_samples; // see Oil_run::use_float_samples(); zero padding in older journals
+            uint8_t pad[2];
+        };
+        struct entry_head {
+            uint32_t job;
+            uint8_t state;
+            uint8_t pad[3];
+            uint32_t bytes; // of the payload that follows
+            uint32_t check; // of the head up to here and the payload
+        };
+        std::string path;
+        header head{};
+        std::vector<job> jobs;
+        FILE *fp = nullptr; // open for appending once loaded
+        static uint32_t checksum(const entry_head &entry, const char *payload) {
+            uint32_t h = 2166136261u; // FNV-1a
+            auto mix = [&h](const char *bytes, size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    h = (h ^ (unsigned char) bytes[i])*16777619u;
+                }
+            };
+            mix((const char *) &entry, offsetof(entry_head, check));
+            mix(payload, entry.bytes);
+            return h;
+        }
+        static std::string encode(uint32_t index, uint8_t to, const char *payload, size_t bytes) {
+            entry_head entry{};
+            entry.job = index;
+            entry.state = to;
+            entry.bytes = (uint32_t) bytes;
+            entry.check = checksum(entry, payload);
+            std::string out((const char *) &entry, sizeof(entry));
+            out.append(payload, bytes);
+            return out;
+        }
+        static bool sync(FILE *file) {
+            if (fflush(file) != 0) {
+                return false;
+            }
+#ifndef _WIN32
+            return fsync(fileno(file)) == 0;
+#else
+            return true;
+#endif
+        }
+        void apply(const entry_head &entry, const char *payload) {
+            job &j = jobs.at(entry.job);
+            j.state = entry.state;
+            if (entry.state == analysed) {
+                if (entry.bytes != sizeof(REC)) {
+                    throw JournalFileError();
+                }
+                std::memcpy(&j.result, payload, sizeof(REC));
+            }
+            else if (entry.state == queued) {
+                j.reason.clear(); // queued again after failing
+            }
+            else if (entry.state != parsed) {
+                j.reason.assign(payload, entry.bytes);
+            }
+        }
+        void append(size_t index, uint8_t to, const char *payload, size_t bytes) {
+            if (fp == nullptr) {
+                throw JournalWriteError(); // none has been started or loaded
+            }
+            std::string out = encode((uint32_t) index, to, payload, bytes);
+            if (fwrite(out.data(), 1, out.size(), fp) != out.size() || !sync(fp)) {
+                throw JournalWriteError();
+            }
+            apply(*(const entry_head *) out.data(), out.data() + sizeof(entry_head));
+        }
+        void close() {
+            if (fp != nullptr) {
+                fclose(fp);
+                fp = nullptr;
+            }
+        }
+    public:
+        Journal() = default;
+        Journal(const Journal &) = delete;
+        Journal &operator=(const Journal &) = delete;
+        ~Journal() {
+            close();
+        }
+        static const char *name_of(uint8_t s) {
+            switch (s) {
+                case queued:
+                    return "queued";
+                case parsed:
+                    return "parsed";
+                case analysed:
+                    return "analysed";
+                case committed:
+                    return "committed";
+                default:
+                    return "failed";
+            }
+        }
+        // returns false if there is no journal at journal_path
+        bool load(const std::string &journal_path) {
+            close();
+            path = journal_path;
+            jobs.clear();
+            FILE *in = fopen(path.c_str(), "rb");
+            if (in == nullptr) {
+                return false;
+            }
+            std::string buffer;
+            char chunk[65536];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+                buffer.append(chunk, got);
+            }
+            fclose(in);
+            if (buffer.size() < sizeof(header) + sizeof(uint32_t) ||
+                std::memcmp(buffer.data(), magic, sizeof(magic)) != 0) {
+                throw JournalFileError();
+            }
+            std::memcpy(&head, buffer.data(), sizeof(header));
+            size_t at = sizeof(header);
+            uint32_t count;
+            std::memcpy(&count, buffer.data() + at, sizeof(count));
+            jobs.resize(count);
+            at += sizeof(count);
+            size_t good = at;
+            while (buffer.size() - at >= sizeof(entry_head)) {
+                entry_head entry{};
+                std::memcpy(&entry, buffer.data() + at, sizeof(entry));
+                if (buffer.size() - at - sizeof(entry) < entry.bytes ||
+                    checksum(entry, buffer.data() + at + sizeof(entry)) != entry.check) {
+                    break; // torn by a crash mid-write; everything before it stands
+                }
+                if (entry.job >= jobs.size() || entry.state > failed) {
+                    throw JournalFileError();
+                }
+                if (entry.state == queued && jobs[entry.job].path.empty()) {
+                    jobs[entry.job].path.assign(buffer.data() + at + sizeof(entry), entry.bytes);
+                }
+                else {
+                    apply(entry, buffer.data() + at + sizeof(entry));
+                }
+                at += sizeof(entry) + entry.bytes;
+                good = at;
+            }
+            for (const job &j : jobs) {
+                if (j.path.empty()) {
+                    throw JournalFileError(); // the queued entries are written with the header, so cannot be torn
+                }
+            }
+            if (good != buffer.size()) {
+                std::filesystem::resize_file(path, good);
+            }
+            fp = fopen(path.c_str(), "ab");
+            if (fp == nullptr) {
+                throw JournalWriteError();
+            }
+            return true;
+        }
+        // replaces any journal at journal_path with one that has every capture queued
+        void start(const std::string &journal_path, double freq, const std::string &mode, bool from_catalog,
+                   bool float_samples, const std::vector<std::string> &captures) {
+            close();
+            path = journal_path;
+            head = {};
+            std::memcpy(head.magic, magic, sizeof(magic));
+            head.freq = freq;
+            std::memcpy(head.mode, mode.data(), std::min(mode.size(), sizeof(head.mode))); // head is zeroed
+            head.from_catalog = from_catalog;
+            head.float_samples = float_samples;
+            std::string out((const char *) &head, sizeof(head));
+            auto count = (uint32_t) captures.size();
+            out.append((const char *) &count, sizeof(count));
+            jobs.assign(captures.size(), job());
+            for (size_t i = 0; i < captures.size(); ++i) {
+                out.append(encode((uint32_t) i, queued, captures[i].data(), captures[i].size()));
+                jobs[i].path = captures[i];
+            }
+            std::string tmp_path = path + ".tmp"; // a journal is either all there or not at all
+            FILE *tmp = fopen(tmp_path.c_str(), "wb");
+            bool ok = tmp != nullptr && fwrite(out.data(), 1, out.size(), tmp) == out.size() && sync(tmp);
+            ok = tmp != nullptr && fclose(tmp) == 0 && ok;
+#ifdef _WIN32
+            std::remove(path.c_str());
+#endif
+            if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                std::remove(tmp_path.c_str());
+                throw JournalWriteError();
+            }
+            fp = fopen(path.c_str(), "ab");
+            if (fp == nullptr) {
+                throw JournalWriteError();
+            }
+        }
+        void remove() {
+            close();
+            std::remove(path.c_str());
+            jobs.clear();
+        }
+        void mark_parsed(size_t index) {
+            append(index, parsed, nullptr, 0);
+        }
+        void mark_analysed(size_t index, const REC &result) {
+            append(index, analysed, (const char *) &result, sizeof(REC));
+        }
+        void mark_committed(size_t index, const std::string &note = "") {
+            append(index, committed, note.data(), note.size());
+        }
+        void mark_failed(size_t index, const std::string &reason) {
+            append(index, failed, reason.data(), reason.size());
+        }
+        // queues the failed captures again; returns how many there were
+        size_t requeue_failed() {
+            size_t requeued = 0;
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                if (jobs[i].state == failed) {
+                    append(i, queued, nullptr, 0);
+                    ++requeued;
+                }
+            }
+            return requeued;
+        }
+        [[nodiscard]] const std::vector<job> &all_jobs() const {
+            return jobs;
+        }
+        [[nodiscard]] size_t count(uint8_t s) const {
+            size_t n = 0;
+            for (const job &j : jobs) {
+                n += j.state == s;
+            }
+            return n;
+        }
+        // the jobs neither committed nor failed, in the order they were queued
+        [[nodiscard]] std::vector<size_t> pending() const {
+            std::vector<size_t> left;
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                if (jobs[i].state != committed && jobs[i].state != failed) {
+                    left.push_back(i);
+                }
+            }
+            return left;
+        }
+        [[nodiscard]] double frequency() const {
+            return head.freq;
+        }
+        [[nodiscard]] std::string mode() const {
+            return std::string(head.mode, strnlen(head.mode, sizeof(head.mode)));
+        }
+        [[nodiscard]] bool from_catalog() const {
+            return head.from_catalog != 0;
+        }
+        [[nodiscard]] bool float_samples() const {
+            return head.float_samples != 0;
+        }
+        // Whether the .dat file at dat_path already holds result under name, i.e. the batch was interrupted between
+        // writing the run and journalling that it had. Compares the values bit for bit, archived runs included.
+        static bool in_store(const char *dat_path, const std::string &name, const REC &result) {
+            Name_table names;
+            if (!names.load_for(dat_path)) {
+                return false;
+            }
+            uint32_t id = names.find(name);
+            if (id == Name_table::none) {
+                return false;
+            }
+            auto same = [id, &result](const REC &rec) {
+                return rec.name_id == id && std::memcmp(&rec.a, &result.a, sizeof(REC) - offsetof(REC, a)) == 0;
+            };
+            bool found = false;
+            Archive<REC>::for_each_segment(dat_path, [&found, &same](const std::vector<REC> &runs) {
+                for (const REC &rec : runs) {
+                    found = found || same(rec);
+                }
+            });
+            if (Dat_file<REC>::layout_of(dat_path) != Dat_file<REC>::current) {
+                return found; // writing the run would have converted the file
+            }
+            FILE *in = Dat_file<REC>::open_runs(dat_path);
+            if (in == nullptr) {
+                return found;
+            }
+            std::vector<REC> batch(4096);
+            size_t got;
+            while (!found && (got = fread(batch.data(), sizeof(REC), batch.size(), in)) > 0) {
+                for (size_t i = 0; i < got && !found; ++i) {
+                    found = same(batch[i]);
+                }
+            }
+            fclose(in);
+            return found;
+        }
+    };
+}
+#endif
@@ -0,0 +1,308 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILMERGE_H
+#define OILMERGE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "oilnames.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    // What to keep of the runs that share a name: the one from the most recently modified store, all of them, or what
+    // writing the stores one run at a time with write_data() would keep ("ow": the last one, "dn": the first one;
+    // "app" is the same as keeping them all). Runs carry no time of their own, so "newest-store" goes by the mtime
+    // of the .dat file: the run kept is from the store written to last, which need not be the newest run.
+    enum class merge_policy {newest_store, both, overwrite, do_nothing};
+
+    // Merges .dat files into one. The runs of every store are sorted by name in parallel (the stores are mapped, not
+    // read, and only references to their runs are sorted), and the merged store is then written in one sequential
+    // pass. Runs come out ordered by name, and runs of the same name in the order of the stores and of the runs in
+    // each store. Each store has its own name ids, so the ids of the merged runs are those of their names in the name
+    // file of the output. Archived runs are merged too (their stores are read rather than mapped); the output is
+    // written as one .dat file, and its oldest runs are sealed again if it had an archive.
+    template <typename REC>
+    class Merge {
+    private:
+        static constexpr size_t write_records = (1 << 20) / sizeof(REC);
+        struct store {
+            std::string path;
+            Name_table names;
+            const REC *runs = nullptr;
+            size_t count = 0;
+            int64_t modified = 0; // ns since the epoch
+            bool mapped = false;
+            size_t mapped_bytes = 0; // header included
+            std::vector<REC> copy; // if not mapped
+        };
+        struct ref {
+            uint64_t prefix; // the first 8 bytes of the name, big-endian, so most comparisons need no string compare
+            const REC *run;
+            const std::string *name;
+            uint32_t store;
+        };
+        static bool before(const ref &a, const ref &b) {
+            if (a.prefix != b.prefix) {
+                return a.prefix < b.prefix;
+            }
+            int cmp = a.name == b.name ? 0 : a.name->compare(*b.name);
+            if (cmp != 0) {
+                return cmp < 0;
+            }
+            if (a.store != b.store) {
+                return a.store < b.store;
+            }
+            return a.run < b.run; // same store, so the same array
+        }
+        static bool same_name(const ref &a, const ref &b) {
+            return a.prefix == b.prefix && (a.name == b.name || *a.name == *b.name);
+        }
+        static uint64_t prefix_of(const std::string &name) {
+            uint64_t prefix = 0;
+            size_t i = 0;
+            for (; i < 8 && i < name.size(); ++i) {
+                prefix = prefix << 8 | (unsigned char) name[i];
+            }
+            return prefix << 8*(8 - i);
+        }
+        static void open_store(store &st) {
+            struct stat info = {};
+            if (stat(st.path.c_str(), &info) == -1 || S_ISDIR(info.st_mode)) {
+                throw std::invalid_argument("No .dat file at " + st.path + ".\n");
+            }
+#ifdef __APPLE__
+            st.modified = (int64_t) info.st_mtimespec.tv_sec*1000000000 + info.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+            st.modified = (int64_t) info.st_mtim.tv_sec*1000000000 + info.st_mtim.tv_nsec;
+#else
+            st.modified = (int64_t) info.st_mtime*1000000000;
+#endif
+            st.names.template load<REC>(st.path.c_str()); // inputs are never converted, only read
+            st.count = Dat_file<REC>::count(st.path.c_str());
+            bool archived = Archive<REC>::exists(st.path.c_str());
+            if (st.count == 0 && !archived) {
+                return;
+            }
+#ifndef _WIN32
+            if (!archived) {
+                int fd = open(st.path.c_str(), O_RDONLY);
+                void *mem = fd == -1 ? MAP_FAILED : mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (fd != -1) {
+                    ::close(fd);
+                }
+                if (mem == MAP_FAILED) {
+                    throw std::invalid_argument("Error opening " + st.path + ".\n");
+                }
+                madvise(mem, info.st_size, MADV_SEQUENTIAL);
+                st.runs = (const REC *) ((const char *) mem + Dat_file<REC>::header_bytes);
+                st.mapped = true;
+                st.mapped_bytes = info.st_size;
+                return;
+            }
+#endif
+            st.copy = Archive<REC>::read(st.path.c_str()); // empty without an archive
+            size_t first = st.copy.size();
+            st.copy.resize(first + st.count);
+            FILE *fp = Dat_file<REC>::open_runs(st.path.c_str());
+            if (fp == nullptr || fread(st.copy.data() + first, sizeof(REC), st.count, fp) != st.count) {
+                if (fp != nullptr) {
+                    fclose(fp);
+                }
+                throw std::invalid_argument("Error opening " + st.path + ".\n");
+            }
+            fclose(fp);
+            st.runs = st.copy.data();
+            st.count = st.copy.size();
+        }
+        static void close_store(store &st) {
+#ifndef _WIN32
+            if (st.mapped) {
+                munmap((void *) ((const char *) st.runs - Dat_file<REC>::header_bytes), st.mapped_bytes);
+                st.mapped = false;
+            }
+#endif
+            st.runs = nullptr;
+        }
+        // sorts each of threads ranges on its own thread, then merges pairs of ranges, also in parallel
+        static void parallel_sort(std::vector<ref> &refs, unsigned threads) {
+            size_t n = refs.size();
+            threads = (unsigned) std::max<size_t>(1, std::min<size_t>(threads, n / 4096 + 1));
+            std::vector<size_t> bounds;
+            for (unsigned i = 0; i <= threads; ++i) {
+                bounds.push_back(n*i/threads);
+            }
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < threads; ++i) {
+                workers.emplace_back([&refs, &bounds, i]() {
+                    std::sort(refs.begin() + (long) bounds[i], refs.begin() + (long) bounds[i + 1], before);
+                });
+            }
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+            std::vector<ref> other(n);
+            std::vector<ref> *from = &refs, *to = &other;
+            while (bounds.size() > 2) {
+                std::vector<size_t> merged_bounds;
+                workers.clear();
+                for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+                    merged_bounds.push_back(bounds[i]);
+                    size_t first = bounds[i], mid = bounds[i + 1], last = i + 2 < bounds.size() ? bounds[i + 2] : mid;
+                    workers.emplace_back([from, to, first, mid, last]() {
+                        std::merge(from->begin() + (long) first, from->begin() + (long) mid,
+                                   from->begin() + (long) mid, from->begin() + (long) last,
+                                   to->begin() + (long) first, before);
+                    });
+                }
+                merged_bounds.push_back(n);
+                for (std::thread &worker : workers) {
+                    worker.join();
+                }
+                bounds.swap(merged_bounds);
+                std::swap(from, to);
+            }
+            if (from != &refs) {
+                refs.swap(other);
+            }
+        }
+    public:
+        struct merge_result {
+            size_t read = 0;
+            size_t written = 0;
+        };
+        static merge_policy policy_of(const std::string &name) {
+            if (name == "newest-store") {
+                return merge_policy::newest_store;
+            }
+            if (name == "both" || name == "app") {
+                return merge_policy::both;
+            }
+            if (name == "ow") {
+                return merge_policy::overwrite;
+            }
+            if (name == "dn") {
+                return merge_policy::do_nothing;
+            }
+            throw std::invalid_argument("The merge policy must be one of newest-store, both, ow, app or dn.\n");
+        }
+        // out_path may be one of the inputs: the merged store is written next to it and then renamed over it
+        static merge_result merge(const std::vector<std::string> &in_paths, const char *out_path,
+                                  merge_policy policy, unsigned threads = 0) {
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            std::vector<store> stores(in_paths.size());
+            merge_result res;
+            try {
+                for (size_t i = 0; i < stores.size(); ++i) {
+                    stores[i].path = in_paths[i];
+                    open_store(stores[i]);
+                    res.read += stores[i].count;
+                }
+                std::vector<ref> refs(res.read);
+                size_t at = 0;
+                for (uint32_t s = 0; s < stores.size(); ++s) {
+                    for (size_t i = 0; i < stores[s].count; ++i, ++at) {
+                        const std::string &name = stores[s].names.name(stores[s].runs[i].name_id);
+                        refs[at] = {prefix_of(name), stores[s].runs + i, &name, s};
+                    }
+                }
+                parallel_sort(refs, threads);
+                Name_table out_names; // appended to, so the ids of the runs in out_path stay valid until it is replaced
+                out_names.open<REC>(out_path);
+                std::string tmp_path = std::string(out_path) + ".merging";
+                FILE *fp = fopen(tmp_path.c_str(), "wb");
+                if (fp == nullptr || !Dat_file<REC>::write_header(fp, 0)) { // any old archive is left behind
+                    if (fp != nullptr) {
+                        fclose(fp);
+                    }
+                    throw std::invalid_argument("The merged store could not be written.\n");
+                }
+                std::vector<REC> out;
+                out.reserve(write_records);
+                bool ok = true;
+                auto put = [&out, &ok, fp, &res, &out_names](const ref &r) {
+                    out.push_back(*r.run);
+                    out.back().name_id = out_names.intern(*r.name);
+                    ++res.written;
+                    if (out.size() == write_records) {
+                        ok = ok && fwrite(out.data(), sizeof(REC), out.size(), fp) == out.size();
+                        out.clear();
+                    }
+                };
+                for (size_t first = 0, last; first < refs.size(); first = last) {
+                    for (last = first + 1; last < refs.size() && same_name(refs[first], refs[last]); ++last) {}
+                    switch (policy) {
+                        case merge_policy::both:
+                            for (size_t i = first; i < last; ++i) {
+                                put(refs[i]);
+                            }
+                            break;
+                        case merge_policy::do_nothing:
+                            put(refs[first]);
+                            break;
+                        case merge_policy::overwrite:
+                            put(refs[last - 1]);
+                            break;
+                        case merge_policy::newest_store: {
+                            size_t best = first; // later runs win ties, as with "ow"
+                            for (size_t i = first + 1; i < last; ++i) {
+                                if (stores[refs[i].store].modified >= stores[refs[best].store].modified) {
+                                    best = i;
+                                }
+                            }
+                            put(refs[best]);
+                            break;
+                        }
+                    }
+                }
+                ok = ok && fwrite(out.data(), sizeof(REC), out.size(), fp) == out.size();
+                ok = fclose(fp) == 0 && ok;
+                if (ok) {
+                    out_names.save();
+                }
+#ifdef _WIN32
+                for (store &st : stores) { // Windows will not rename over a file that is still open
+                    close_store(st);
+                }
+                std::remove(out_path);
+#endif
+                if (!ok || std::rename(tmp_path.c_str(), out_path) != 0) {
+                    std::remove(tmp_path.c_str());
+                    throw std::invalid_argument("The merged store could not be written.\n");
+                }
+                if (Archive<REC>::exists(out_path)) { // its runs are all in the new .dat file now
+                    std::remove(Archive<REC>::sidecar_path(out_path).c_str());
+                    Archive<REC>::seal(out_path, Archive<REC>::segment_runs);
+                }
+            }
+            catch (...) {
+                for (store &st : stores) {
+                    close_store(st);
+                }
+                throw;
+            }
+            for (store &st : stores) {
+                close_store(st);
+            }
+            return res;
+        }
+    };
+}
+#endif
@@ -0,0 +1,225 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILNAMES_H
+#define OILNAMES_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "oildat.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    // The run names of a .dat file, kept in a ".names" file next to it so that each run only carries a 32-bit id and
+    // names can be of any length. Names are interned: every distinct name is stored once, and its id is its position
+    // in the file. The file is only ever appended to, so ids stay valid for as long as the .dat file does; names of
+    // runs that have been deleted or overwritten are left in it until the store is next merged.
+    class Name_table {
+    private:
+        class NameFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The run name file is corrupt or was not written by this program.";
+            }
+        };
+        class MissingNameFileError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The .dat file has runs but its run name file is missing.";
+            }
+        };
+        static constexpr char magic[8] = {'E', 'X', 'P', 'V', 'N', 'A', 'M', '1'};
+        std::deque<std::string> names; // by id; a deque so that the views in ids stay valid as names are added
+        std::unordered_map<std::string_view, uint32_t> ids;
+        size_t saved = 0; // names already in the file
+        std::string path;
+        // converts a .dat file of legacy runs, which carry their names inline, to the current layout: the names are
+        // saved first, so that a crash before the .dat file is replaced leaves a legacy store and a spare name file
+        template <typename REC>
+        void upgrade(const char *dat_path) {
+            typedef typename Dat_file<REC>::legacy_record legacy_record;
+            static_assert(sizeof(REC) == offsetof(REC, a) + sizeof(legacy_record::values),
+                          "The run values must follow the name id.");
+            struct stat info = {};
+            if (stat(dat_path, &info) == -1) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            std::vector<legacy_record> old(info.st_size / sizeof(legacy_record));
+            FILE *fp = fopen(dat_path, "rb");
+            if (fp == nullptr || fread(old.data(), sizeof(legacy_record), old.size(), fp) != old.size()) {
+                if (fp != nullptr) {
+                    fclose(fp);
+                }
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            fclose(fp);
+            clear();
+            std::vector<REC> converted(old.size());
+            for (size_t i = 0; i < old.size(); ++i) {
+                std::memset(&converted[i], 0, sizeof(REC));
+                converted[i].name_id = intern(std::string_view(old[i].name, strnlen(old[i].name, 32)));
+                std::memcpy(&converted[i].a, old[i].values, sizeof(legacy_record::values));
+            }
+            save(dat_path);
+            if (!Dat_file<REC>::write(dat_path, converted.data(), converted.size(), Archive<REC>::bytes(dat_path))) {
+                throw std::invalid_argument("The .dat file could not be converted to use a run name file.\n");
+            }
+        }
+    public:
+        static constexpr uint32_t none = UINT32_MAX;
+        Name_table() = default;
+        Name_table(const Name_table &) = delete;
+        Name_table &operator=(const Name_table &) = delete;
+        Name_table(Name_table &&) = default;
+        Name_table &operator=(Name_table &&) = default;
+        static std::string sidecar_path(const char *dat_path) {
+            std::string names_path(dat_path);
+            if (names_path.size() >= 4 && names_path.compare(names_path.size() - 4, 4, ".dat") == 0) {
+                names_path.erase(names_path.size() - 4);
+            }
+            names_path.append(".names");
+            return names_path;
+        }
+        [[nodiscard]] size_t size() const {
+            return names.size();
+        }
+        void clear() {
+            ids.clear();
+            names.clear();
+            saved = 0;
+        }
+        // returns false (and leaves this object untouched) if there is no name file for the .dat file
+        bool load_for(const char *dat_path) {
+            std::string names_path = sidecar_path(dat_path);
+            FILE *fp = fopen(names_path.c_str(), "rb");
+            if (fp == nullptr) {
+                return false;
+            }
+            std::string buffer;
+            char chunk[65536];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+                buffer.append(chunk, got);
+            }
+            fclose(fp);
+            if (buffer.size() < sizeof(magic) || std::memcmp(buffer.data(), magic, sizeof(magic)) != 0) {
+                throw NameFileError();
+            }
+            Name_table read;
+            for (size_t at = sizeof(magic); at < buffer.size();) {
+                uint32_t len;
+                if (buffer.size() - at < sizeof(len)) {
+                    throw NameFileError();
+                }
+                std::memcpy(&len, buffer.data() + at, sizeof(len));
+                at += sizeof(len);
+                if (buffer.size() - at < len) {
+                    throw NameFileError();
+                }
+                if (read.intern(std::string_view(buffer.data() + at, len)) != read.size() - 1) {
+                    throw NameFileError(); // a name twice
+                }
+                at += len;
+            }
+            read.saved = read.size();
+            read.path = names_path;
+            *this = std::move(read);
+            return true;
+        }
+        // Loads the names of a .dat file that is about to be written to, first converting the file if it was written by
+        // an older version of this program (see Dat_file); a store with no runs yet gets an empty table.
+        template <typename REC>
+        void open(const char *dat_path) {
+            switch (Dat_file<REC>::layout_of(dat_path)) {
+                case Dat_file<REC>::legacy:
+                    upgrade<REC>(dat_path);
+                    return;
+                case Dat_file<REC>::empty:
+                    if (!Dat_file<REC>::write(dat_path, nullptr, 0, Archive<REC>::bytes(dat_path))) {
+                        throw std::invalid_argument("The .dat file could not be written.\n");
+                    }
+                    break;
+                default:
+                    break;
+            }
+            Archive<REC>::recover(dat_path);
+            load<REC>(dat_path);
+        }
+        // loads the names of a .dat file for reading it, which must be in the current layout
+        template <typename REC>
+        void load(const char *dat_path) {
+            Dat_file<REC>::check(dat_path);
+            if (!load_for(dat_path)) {
+                if (Dat_file<REC>::count(dat_path) > 0 || Archive<REC>::exists(dat_path)) {
+                    throw MissingNameFileError();
+                }
+                clear();
+                path = sidecar_path(dat_path);
+            }
+        }
+        // appends the names added since the table was loaded or last saved
+        void save(const char *dat_path = nullptr) {
+            if (dat_path != nullptr) {
+                path = sidecar_path(dat_path);
+            }
+            if (path.empty()) {
+                throw std::invalid_argument("No .dat file has been associated with these run names.\n");
+            }
+            if (saved == names.size() && saved != 0) {
+                return;
+            }
+            FILE *fp = fopen(path.c_str(), saved == 0 ? "wb" : "ab");
+            if (fp == nullptr) {
+                throw std::invalid_argument("The run name file could not be written.\n");
+            }
+            std::string out;
+            if (saved == 0) {
+                out.append(magic, sizeof(magic));
+            }
+            for (size_t i = saved; i < names.size(); ++i) {
+                auto len = (uint32_t) names[i].size();
+                out.append((const char *) &len, sizeof(len));
+                out.append(names[i]);
+            }
+            bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+            if (fclose(fp) != 0 || !ok) {
+                throw std::invalid_argument("The run name file could not be written.\n");
+            }
+            saved = names.size();
+        }
+        [[nodiscard]] uint32_t find(std::string_view name) const {
+            auto it = ids.find(name);
+            return it == ids.end() ? none : it->second;
+        }
+        // the id of name, adding it to the table if it is not there yet
+        uint32_t intern(std::string_view name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            if (names.size() == none) {
+                throw std::length_error("The run name file is full.\n");
+            }
+            auto id = (uint32_t) names.size();
+            names.emplace_back(name);
+            ids.emplace(names.back(), id);
+            return id;
+        }
+        // empty for an id the table does not hold
+        [[nodiscard]] const std::string &name(uint32_t id) const {
+            static const std::string unknown;
+            return id < names.size() ? names[id] : unknown;
+        }
+    };
+}
+#endif
@@ -0,0 +1,187 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILPEAKS_H
+#define OILPEAKS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace oil {
+
+    // Read-only view of a contiguous array, for handing out the columns of a Peak_table without copying them.
+    template <typename T>
+    class Span {
+    private:
+        const T *ptr = nullptr;
+        size_t len = 0;
+    public:
+        Span() = default;
+        Span(const T *first, size_t count) : ptr(first), len(count) {}
+        [[nodiscard]] const T *data() const {
+            return ptr;
+        }
+        [[nodiscard]] size_t size() const {
+            return len;
+        }
+        [[nodiscard]] bool empty() const {
+            return len == 0;
+        }
+        const T *begin() const {
+            return ptr;
+        }
+        const T *end() const {
+            return ptr + len;
+        }
+        const T &operator[](size_t i) const {
+            return ptr[i];
+        }
+    };
+
+    // The maxima found in one capture, one column per quantity. A peak is recorded at the sample where the voltage
+    // falls back below the mean, which is the time get_T() has always used; width is how long the voltage was above
+    // the mean before that, and prominence is the height of the maximum above the higher of the minima either side.
+    class Peak_table {
+    private:
+        std::vector<uint64_t> index_col;
+        std::vector<double> time_col;
+        std::vector<double> amplitude_col;
+        std::vector<double> width_col;
+        std::vector<double> prominence_col;
+        std::vector<double> trough_col; // lowest voltage between each peak and the one before it
+        static constexpr char binary_magic[8] = {'E', 'X', 'P', 'V', 'P', 'K', 'S', '1'};
+        class FileWritingFailedError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "The peak table could not be written. Please ensure you have provided a valid path.";
+            }
+        };
+        template <typename T>
+        static bool write_column(FILE *fp, const std::vector<T> &col) {
+            return col.empty() || fwrite(col.data(), sizeof(T), col.size(), fp) == col.size();
+        }
+    public:
+        void clear() { // keeps the capacity, so that the next capture of the same size does not allocate
+            index_col.clear();
+            time_col.clear();
+            amplitude_col.clear();
+            width_col.clear();
+            prominence_col.clear();
+            trough_col.clear();
+        }
+        void reserve(size_t n) {
+            index_col.reserve(n);
+            time_col.reserve(n);
+            amplitude_col.reserve(n);
+            width_col.reserve(n);
+            prominence_col.reserve(n);
+            trough_col.reserve(n);
+        }
+        // trough is the lowest voltage since the last peak, used for the prominences by finish()
+        void add(uint64_t sample_index, double time, double amplitude, double width, double trough) {
+            index_col.push_back(sample_index);
+            time_col.push_back(time);
+            amplitude_col.push_back(amplitude);
+            width_col.push_back(width);
+            trough_col.push_back(trough);
+        }
+        // removes the first n peaks
+        void drop_front(size_t n) {
+            n = std::min(n, size());
+            index_col.erase(index_col.begin(), index_col.begin() + (long) n);
+            time_col.erase(time_col.begin(), time_col.begin() + (long) n);
+            amplitude_col.erase(amplitude_col.begin(), amplitude_col.begin() + (long) n);
+            width_col.erase(width_col.begin(), width_col.begin() + (long) n);
+            trough_col.erase(trough_col.begin(), trough_col.begin() + (long) n);
+        }
+        // works out the prominences, given the lowest voltage after the last peak
+        void finish(double trough_after) {
+            size_t n = size();
+            prominence_col.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                double after = i + 1 < n ? trough_col[i + 1] : trough_after;
+                prominence_col[i] = amplitude_col[i] - std::max(trough_col[i], after);
+            }
+        }
+        [[nodiscard]] size_t size() const {
+            return time_col.size();
+        }
+        [[nodiscard]] bool empty() const {
+            return time_col.empty();
+        }
+        [[nodiscard]] Span<uint64_t> indices() const {
+            return {index_col.data(), index_col.size()};
+        }
+        [[nodiscard]] Span<double> times() const {
+            return {time_col.data(), time_col.size()};
+        }
+        [[nodiscard]] Span<double> amplitudes() const {
+            return {amplitude_col.data(), amplitude_col.size()};
+        }
+        [[nodiscard]] Span<double> widths() const {
+            return {width_col.data(), width_col.size()};
+        }
+        [[nodiscard]] Span<double> prominences() const {
+            return {prominence_col.data(), prominence_col.size()};
+        }
+        // "index,time,amplitude,width,prominence" lines, with the shortest digits that read back to the same doubles
+        void write_csv(const char *path) const {
+            FILE *fp = fopen(path, "w");
+            if (fp == nullptr) {
+                throw FileWritingFailedError();
+            }
+            std::string out = "index,time,amplitude,width,prominence\n";
+            out.reserve(out.size() + size()*96);
+            char buffer[32];
+            auto put = [&out, &buffer](double value, char end) {
+                out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+                out.push_back(end);
+            };
+            for (size_t i = 0; i < size(); ++i) {
+                out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), index_col[i]).ptr);
+                out.push_back(',');
+                put(time_col[i], ',');
+                put(amplitude_col[i], ',');
+                put(width_col[i], ',');
+                put(prominence_col[i], '\n');
+            }
+            bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+            if (fclose(fp) != 0 || !ok) {
+                throw FileWritingFailedError();
+            }
+        }
+        // the magic, a uint64_t peak count, then each column in turn (indices as uint64_t, the rest as doubles), all
+        // in native byte order
+        void write_binary(const char *path) const {
+            FILE *fp = fopen(path, "wb");
+            if (fp == nullptr) {
+                throw FileWritingFailedError();
+            }
+            uint64_t count = size();
+            bool ok = fwrite(binary_magic, sizeof(binary_magic), 1, fp) == 1 &&
+                      fwrite(&count, sizeof(count), 1, fp) == 1 && write_column(fp, index_col) &&
+                      write_column(fp, time_col) && write_column(fp, amplitude_col) &&
+                      write_column(fp, width_col) && write_column(fp, prominence_col);
+            if (fclose(fp) != 0 || !ok) {
+                throw FileWritingFailedError();
+            }
+        }
+        // CSV for a .csv path, binary otherwise
+        void write(const char *path) const {
+            size_t len = std::strlen(path);
+            if (len >= 4 && std::strcmp(path + len - 4, ".csv") == 0) {
+                write_csv(path);
+            }
+            else {
+                write_binary(path);
+            }
+        }
+    };
+}
+#endif
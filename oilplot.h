@@ -0,0 +1,347 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILPLOT_H
+#define OILPLOT_H
+
+// PNGs are written with uncompressed deflate blocks unless compiled with -DOIL_USE_ZLIB (link with -lz).
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef OIL_USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace oil {
+
+    // Renders a capture as a PNG or SVG. The samples are decimated to one min/max pair per pixel column in a single
+    // pass, so the cost of drawing does not depend on the number of samples, and the detected maxima are overlaid.
+    class Waveform_plot {
+    private:
+        enum colour : uint8_t {background = 0, trace = 1, marker = 2, axis = 3};
+        static constexpr int left = 80, right = 30, top = 50, bottom = 60;
+        int width;
+        int height;
+        int cols;
+        std::vector<float> col_min;
+        std::vector<float> col_max;
+        double t0 = 0, t1 = 1;
+        double v0 = 0, v1 = 1;
+        std::vector<std::pair<double, double>> peaks;
+        std::string title;
+        std::vector<uint8_t> pixels; // palette indices
+        [[nodiscard]] double x_of(double t) const {
+            return left + (t - t0) / (t1 - t0)*(cols - 1);
+        }
+        [[nodiscard]] double y_of(double v) const {
+            return top + (v1 - v) / (v1 - v0)*(height - top - bottom - 1);
+        }
+        void put(int x, int y, colour c) {
+            if (x >= 0 && x < width && y >= 0 && y < height) {
+                pixels[(size_t) y*width + x] = c;
+            }
+        }
+        void vline(int x, int y_a, int y_b, colour c) {
+            if (y_a > y_b) {
+                std::swap(y_a, y_b);
+            }
+            for (int y = y_a; y <= y_b; ++y) {
+                put(x, y, c);
+            }
+        }
+        void hline(int x_a, int x_b, int y, colour c) {
+            for (int x = x_a; x <= x_b; ++x) {
+                put(x, y, c);
+            }
+        }
+        static std::vector<double> ticks(double lo, double hi) {
+            double raw = (hi - lo) / 5;
+            double mag = std::pow(10, std::floor(std::log10(raw)));
+            double step = raw / mag >= 5 ? 5*mag : raw / mag >= 2 ? 2*mag : mag;
+            std::vector<double> at;
+            for (double tick = std::ceil(lo / step)*step; tick <= hi + step*1e-9; tick += step) {
+                at.push_back(std::fabs(tick) < step*1e-9 ? 0 : tick);
+            }
+            return at;
+        }
+        void rasterise() {
+            pixels.assign((size_t) width*height, background);
+            int plot_bottom = height - bottom - 1;
+            int plot_right = left + cols - 1;
+            hline(left - 1, plot_right + 1, top - 1, axis);
+            hline(left - 1, plot_right + 1, plot_bottom + 1, axis);
+            vline(left - 1, top - 1, plot_bottom + 1, axis);
+            vline(plot_right + 1, top - 1, plot_bottom + 1, axis);
+            for (double t : ticks(t0, t1)) {
+                vline((int) std::lround(x_of(t)), plot_bottom + 1, plot_bottom + 7, axis);
+            }
+            for (double v : ticks(v0, v1)) {
+                hline(left - 7, left - 1, (int) std::lround(y_of(v)), axis);
+            }
+            int prev_lo = 0, prev_hi = 0;
+            bool have_prev = false;
+            for (int c = 0; c < cols; ++c) {
+                if (col_min[c] > col_max[c]) { // no sample fell in this column
+                    continue;
+                }
+                int lo = (int) std::lround(y_of(col_max[c]));
+                int hi = (int) std::lround(y_of(col_min[c]));
+                if (have_prev) { // join up with the previous column
+                    lo = std::min(lo, prev_hi);
+                    hi = std::max(hi, prev_lo);
+                }
+                vline(left + c, lo, hi, trace);
+                prev_lo = (int) std::lround(y_of(col_max[c]));
+                prev_hi = (int) std::lround(y_of(col_min[c]));
+                have_prev = true;
+            }
+            for (const std::pair<double, double> &peak : peaks) {
+                int x = (int) std::lround(x_of(peak.first));
+                int y = (int) std::lround(y_of(peak.second));
+                for (int d = -4; d <= 4; ++d) {
+                    put(x + d, y + d, marker);
+                    put(x + d, y - d, marker);
+                    put(x + d + 1, y + d, marker);
+                    put(x + d + 1, y - d, marker);
+                }
+            }
+        }
+        static uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0) {
+            static const std::array<uint32_t, 256> table = [] {
+                std::array<uint32_t, 256> made{};
+                for (uint32_t n = 0; n < 256; ++n) {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) {
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    }
+                    made[n] = c;
+                }
+                return made;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i < len; ++i) {
+                crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+        static void put_be32(std::vector<uint8_t> &out, uint32_t value) {
+            out.push_back(value >> 24);
+            out.push_back(value >> 16);
+            out.push_back(value >> 8);
+            out.push_back(value);
+        }
+        static void chunk(FILE *fp, const char *type, const std::vector<uint8_t> &data) {
+            std::vector<uint8_t> head;
+            put_be32(head, (uint32_t) data.size());
+            head.insert(head.end(), type, type + 4);
+            uint32_t crc = crc32(head.data() + 4, 4);
+            crc = crc32(data.data(), data.size(), crc);
+            std::vector<uint8_t> tail;
+            put_be32(tail, crc);
+            fwrite(head.data(), 1, head.size(), fp);
+            fwrite(data.data(), 1, data.size(), fp);
+            fwrite(tail.data(), 1, tail.size(), fp);
+        }
+        static std::vector<uint8_t> zlib_stream(const std::vector<uint8_t> &raw) {
+#ifdef OIL_USE_ZLIB
+            uLongf len = compressBound(raw.size());
+            std::vector<uint8_t> out(len);
+            if (compress2(out.data(), &len, raw.data(), raw.size(), 6) != Z_OK) { // e.g. Z_MEM_ERROR
+                throw std::invalid_argument("The plot could not be compressed.\n");
+            }
+            out.resize(len);
+            return out;
+#else
+            std::vector<uint8_t> out = {0x78, 0x01};
+            size_t done = 0;
+            do { // stored blocks of at most 65535 bytes
+                size_t len = std::min<size_t>(65535, raw.size() - done);
+                out.push_back(done + len == raw.size());
+                out.push_back(len & 0xff);
+                out.push_back(len >> 8);
+                out.push_back(~len & 0xff);
+                out.push_back((~len >> 8) & 0xff);
+                out.insert(out.end(), raw.begin() + (long) done, raw.begin() + (long) (done + len));
+                done += len;
+            } while (done < raw.size());
+            uint32_t a = 1, b = 0;
+            for (uint8_t byte : raw) {
+                a = (a + byte) % 65521;
+                b = (b + a) % 65521;
+            }
+            put_be32(out, (b << 16) | a);
+            return out;
+#endif
+        }
+        static std::string number(double value) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%g", value);
+            return {buf};
+        }
+        static std::string escape(const std::string &text) {
+            std::string out;
+            for (char ch : text) {
+                switch (ch) {
+                    case '&': out.append("&amp;"); break;
+                    case '<': out.append("&lt;"); break;
+                    case '>': out.append("&gt;"); break;
+                    default: out.push_back(ch);
+                }
+            }
+            return out;
+        }
+    public:
+        explicit Waveform_plot(int width_px = 1600, int height_px = 900) : width(width_px), height(height_px) {
+            if (width <= left + right + 10 || height <= top + bottom + 10) {
+                throw std::invalid_argument("The plot is too small.\n");
+            }
+            cols = width - left - right;
+            col_min.assign(cols, std::numeric_limits<float>::max());
+            col_max.assign(cols, std::numeric_limits<float>::lowest());
+        }
+        template <typename TIMES, typename VOLTS>
+        void set_samples(const TIMES &times, const VOLTS &volts) {
+            size_t n = std::min(times.size(), volts.size());
+            col_min.assign(cols, std::numeric_limits<float>::max());
+            col_max.assign(cols, std::numeric_limits<float>::lowest());
+            if (n == 0) {
+                return;
+            }
+            t0 = *times.begin();
+            t1 = *std::prev(times.end());
+            if (t1 <= t0) {
+                t1 = t0 + 1;
+            }
+            double scale = (cols - 1) / (t1 - t0);
+            double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+            auto t_it = times.begin();
+            auto v_it = volts.begin();
+            for (size_t i = 0; i < n; ++i, ++t_it, ++v_it) {
+                auto c = (int) ((*t_it - t0)*scale);
+                c = std::clamp(c, 0, cols - 1);
+                auto v = (float) *v_it;
+                col_min[c] = std::min(col_min[c], v);
+                col_max[c] = std::max(col_max[c], v);
+                lo = std::min(lo, (double) *v_it);
+                hi = std::max(hi, (double) *v_it);
+            }
+            double pad = hi > lo ? (hi - lo)*0.05 : 1;
+            v0 = lo - pad;
+            v1 = hi + pad;
+        }
+        template <typename TIMES, typename VOLTS>
+        void set_maxima(const TIMES &times, const VOLTS &volts) {
+            peaks.clear();
+            auto v_it = volts.begin();
+            for (auto t_it = times.begin(); t_it != times.end() && v_it != volts.end(); ++t_it, ++v_it) {
+                peaks.emplace_back(*t_it, *v_it);
+            }
+        }
+        void set_title(const std::string &plot_title) {
+            title = plot_title;
+        }
+        void save_png(const char *path) {
+            rasterise();
+            size_t row_bytes = (width + 3) / 4;
+            std::vector<uint8_t> raw((row_bytes + 1)*height, 0);
+            for (int y = 0; y < height; ++y) {
+                uint8_t *row = raw.data() + y*(row_bytes + 1) + 1; // filter byte 0 precedes each row
+                const uint8_t *src = pixels.data() + (size_t) y*width;
+                for (int x = 0; x < width; ++x) {
+                    row[x >> 2] |= src[x] << (6 - 2*(x & 3));
+                }
+            }
+            std::vector<uint8_t> idat = zlib_stream(raw); // before the file is opened, as it can throw
+            FILE *fp = fopen(path, "wb");
+            if (fp == nullptr) {
+                throw std::invalid_argument("The plot could not be written.\n");
+            }
+            const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            fwrite(signature, 1, 8, fp);
+            std::vector<uint8_t> ihdr;
+            put_be32(ihdr, width);
+            put_be32(ihdr, height);
+            ihdr.insert(ihdr.end(), {2, 3, 0, 0, 0}); // 2-bit palette
+            chunk(fp, "IHDR", ihdr);
+            chunk(fp, "PLTE", {255, 255, 255, 31, 119, 180, 214, 39, 40, 90, 90, 90});
+            chunk(fp, "IDAT", idat);
+            chunk(fp, "IEND", {});
+            if (fclose(fp) != 0) {
+                throw std::invalid_argument("The plot could not be written.\n");
+            }
+        }
+        void save_svg(const char *path) const {
+            std::string svg;
+            svg.reserve(64*cols + 128*peaks.size() + 4096);
+            svg.append("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" + std::to_string(width) + "\" height=\"" +
+                       std::to_string(height) + "\" font-family=\"sans-serif\" font-size=\"13\">\n"
+                       "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n");
+            int plot_bottom = height - bottom - 1;
+            svg.append("<rect x=\"" + std::to_string(left - 1) + "\" y=\"" + std::to_string(top - 1) + "\" width=\"" +
+                       std::to_string(cols + 1) + "\" height=\"" + std::to_string(plot_bottom - top + 2) +
+                       "\" fill=\"none\" stroke=\"#5a5a5a\"/>\n");
+            for (double t : ticks(t0, t1)) {
+                std::string x = number(x_of(t));
+                svg.append("<line x1=\"" + x + "\" y1=\"" + std::to_string(plot_bottom + 1) + "\" x2=\"" + x +
+                           "\" y2=\"" + std::to_string(plot_bottom + 7) + "\" stroke=\"#5a5a5a\"/>" +
+                           "<text x=\"" + x + "\" y=\"" + std::to_string(plot_bottom + 22) +
+                           "\" text-anchor=\"middle\">" + number(t) + "</text>\n");
+            }
+            for (double v : ticks(v0, v1)) {
+                std::string y = number(y_of(v));
+                svg.append("<line x1=\"" + std::to_string(left - 7) + "\" y1=\"" + y + "\" x2=\"" +
+                           std::to_string(left - 1) + "\" y2=\"" + y + "\" stroke=\"#5a5a5a\"/>" +
+                           "<text x=\"" + std::to_string(left - 10) + "\" y=\"" + y +
+                           "\" text-anchor=\"end\" dominant-baseline=\"middle\">" + number(v) + "</text>\n");
+            }
+            svg.append("<text x=\"" + number(left + cols / 2.0) + "\" y=\"" + std::to_string(height - 15) +
+                       "\" text-anchor=\"middle\">Time (s)</text>\n<text transform=\"translate(20," +
+                       number(top + (plot_bottom - top) / 2.0) + ") rotate(-90)\" text-anchor=\"middle\">"
+                       "Voltage (V)</text>\n<text x=\"" + number(left + cols / 2.0) + "\" y=\"" +
+                       std::to_string(top - 18) + "\" text-anchor=\"middle\" font-size=\"16\">" + escape(title) +
+                       "</text>\n");
+            svg.append("<polyline fill=\"none\" stroke=\"#1f77b4\" stroke-width=\"1\" points=\"");
+            char buf[64];
+            for (int c = 0; c < cols; ++c) {
+                if (col_min[c] > col_max[c]) {
+                    continue;
+                }
+                snprintf(buf, sizeof(buf), "%d,%.1f %d,%.1f ", left + c, y_of(col_max[c]), left + c,
+                         y_of(col_min[c]));
+                svg.append(buf);
+            }
+            svg.append("\"/>\n<g fill=\"none\" stroke=\"#d62728\">\n");
+            for (const std::pair<double, double> &peak : peaks) {
+                snprintf(buf, sizeof(buf), "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"4\"/>\n", x_of(peak.first),
+                         y_of(peak.second));
+                svg.append(buf);
+            }
+            svg.append("</g>\n</svg>\n");
+            FILE *fp = fopen(path, "wb");
+            if (fp == nullptr || fwrite(svg.data(), 1, svg.size(), fp) != svg.size() || fclose(fp) != 0) {
+                throw std::invalid_argument("The plot could not be written.\n");
+            }
+        }
+        // the format is chosen from the extension
+        void save(const char *path) {
+            std::string p(path);
+            if (p.size() >= 4 && p.compare(p.size() - 4, 4, ".svg") == 0) {
+                save_svg(path);
+            }
+            else {
+                save_png(path);
+            }
+        }
+    };
+}
+#endif
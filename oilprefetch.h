@@ -0,0 +1,232 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILPREFETCH_H
+#define OILPREFETCH_H
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef OIL_USE_URING // link with -luring
+#include <liburing.h>
+#endif
+
+namespace oil::io {
+
+    // Reads a list of captures ahead of the one being analysed, keeping up to depth files in flight, so that the next
+    // capture is already in memory by the time get_T() gets to it. The reads are queued with io_uring if the program
+    // was built with OIL_USE_URING and the kernel allows it, and done by a few reader threads otherwise.
+    class Prefetcher {
+    public:
+        struct capture {
+            std::string path;
+            std::vector<char> bytes;
+            int error = 0; // errno of the failed read, in which case bytes is empty
+        };
+    private:
+        std::vector<std::string> paths;
+        size_t depth;
+        size_t consumed = 0; // captures handed out by next()
+        size_t issued = 0; // captures whose reads have been started
+        std::map<size_t, capture> ready;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<std::thread> readers;
+        bool stop = false;
+        static int read_whole(const std::string &path, std::vector<char> &bytes) {
+            FILE *fp = fopen(path.c_str(), "rb");
+            if (fp == nullptr) {
+                return errno;
+            }
+            struct stat info = {};
+            if (fstat(fileno(fp), &info) == -1) {
+                int err = errno;
+                fclose(fp);
+                return err;
+            }
+            bytes.resize(info.st_size);
+            size_t got = fread(bytes.data(), 1, bytes.size(), fp);
+            int err = ferror(fp) ? EIO : 0;
+            fclose(fp);
+            bytes.resize(got);
+            return err;
+        }
+        void read_ahead() {
+            while (true) {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [this] { return stop || (issued < paths.size() && issued < consumed + depth); });
+                    if (stop) {
+                        return;
+                    }
+                    i = issued++;
+                }
+                capture cap;
+                cap.path = paths[i];
+                cap.error = read_whole(cap.path, cap.bytes);
+                std::lock_guard<std::mutex> lock(mtx);
+                ready.emplace(i, std::move(cap));
+                cv.notify_all();
+            }
+        }
+#ifdef OIL_USE_URING
+        static constexpr size_t max_read = 1 << 30;
+        struct in_flight {
+            int fd = -1;
+            size_t done = 0;
+            capture cap;
+        };
+        io_uring ring{};
+        bool uring = false;
+        std::map<size_t, in_flight> flying;
+        void submit_read(size_t i) {
+            in_flight &f = flying[i];
+            io_uring_sqe *sqe;
+            while ((sqe = io_uring_get_sqe(&ring)) == nullptr) {
+                io_uring_submit(&ring);
+            }
+            size_t len = std::min(max_read, f.cap.bytes.size() - f.done);
+            io_uring_prep_read(sqe, f.fd, f.cap.bytes.data() + f.done, (unsigned) len, f.done);
+            io_uring_sqe_set_data(sqe, (void *) (uintptr_t) i);
+        }
+        void finish(size_t i, int error) {
+            in_flight &f = flying[i];
+            if (f.fd != -1) {
+                ::close(f.fd);
+            }
+            f.cap.error = error;
+            if (error != 0) {
+                f.cap.bytes.clear();
+            }
+            ready.emplace(i, std::move(f.cap));
+            flying.erase(i);
+        }
+        // starts the reads of every capture allowed in flight, each in as few requests as the kernel will take
+        void top_up() {
+            while (issued < paths.size() && issued < consumed + depth) {
+                size_t i = issued++;
+                in_flight &f = flying[i];
+                f.cap.path = paths[i];
+                f.fd = open(f.cap.path.c_str(), O_RDONLY);
+                struct stat info = {};
+                if (f.fd == -1 || fstat(f.fd, &info) == -1) {
+                    finish(i, errno);
+                    continue;
+                }
+                f.cap.bytes.resize(info.st_size);
+                if (info.st_size == 0) {
+                    finish(i, 0);
+                    continue;
+                }
+                submit_read(i);
+            }
+            io_uring_submit(&ring);
+        }
+        bool reap() {
+            io_uring_cqe *cqe;
+            int err;
+            while ((err = io_uring_wait_cqe(&ring, &cqe)) == -EINTR) {}
+            if (err != 0) {
+                return false;
+            }
+            size_t i = (size_t) (uintptr_t) io_uring_cqe_get_data(cqe);
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            in_flight &f = flying[i];
+            if (res < 0) {
+                finish(i, -res);
+            }
+            else if (res == 0 || (f.done += (size_t) res) == f.cap.bytes.size()) {
+                f.cap.bytes.resize(f.done); // the file shrank under us if res == 0
+                finish(i, 0);
+            }
+            else { // short read
+                submit_read(i);
+                io_uring_submit(&ring);
+            }
+            return true;
+        }
+#endif
+    public:
+        explicit Prefetcher(std::vector<std::string> captures, size_t ahead = 4)
+                : paths(std::move(captures)), depth(std::max<size_t>(ahead, 1)) {
+#ifdef OIL_USE_URING
+            if (io_uring_queue_init((unsigned) depth, &ring, 0) == 0) {
+                uring = true;
+                top_up();
+                return;
+            }
+#endif
+            size_t num_readers = std::min<size_t>(depth, 4); // more only helps on very high latency shares
+            for (size_t i = 0; i < num_readers; ++i) {
+                readers.emplace_back(&Prefetcher::read_ahead, this);
+            }
+        }
+        Prefetcher(const Prefetcher &) = delete;
+        Prefetcher &operator=(const Prefetcher &) = delete;
+        [[nodiscard]] size_t size() const {
+            return paths.size();
+        }
+        // blocks until the next capture in the list has been read, and returns false once they have all been handed out
+        bool next(capture &cap) {
+            if (consumed == paths.size()) {
+                return false;
+            }
+#ifdef OIL_USE_URING
+            if (uring) {
+                while (ready.count(consumed) == 0) {
+                    if (!reap()) { // the ring is unusable, so read this one the ordinary way
+                        capture &cap_r = ready[consumed];
+                        cap_r.path = paths[consumed];
+                        cap_r.error = read_whole(cap_r.path, cap_r.bytes);
+                    }
+                }
+                cap = std::move(ready[consumed]);
+                ready.erase(consumed++);
+                top_up();
+                return true;
+            }
+#endif
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return ready.count(consumed) != 0; });
+            cap = std::move(ready[consumed]);
+            ready.erase(consumed++);
+            cv.notify_all();
+            return true;
+        }
+        ~Prefetcher() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stop = true;
+            }
+            cv.notify_all();
+            for (std::thread &reader : readers) {
+                reader.join();
+            }
+#ifdef OIL_USE_URING
+            if (uring) {
+                while (!flying.empty() && reap()) {} // the kernel may still be writing into the buffers
+                io_uring_queue_exit(&ring);
+            }
+#endif
+        }
+    };
+}
+#endif
@@ -26,7 +26,24 @@
 #include <regex>
 #include <map>
 #include <utility>
+#include <algorithm>
 #include <cstring>
+#include <type_traits>
+
+#include "oilstats.h"
+#include "oilcalib.h"
+#include "oilio.h"
+#include "oildialect.h"
+#include "oilplot.h"
+#include "oilreport.h"
+#include "oilagg.h"
+#include "oilnames.h"
+#include "oilarchive.h"
+#include "oilarena.h"
+#include "oilfilter.h"
+#include "oilbaseline.h"
+#include "oilpeaks.h"
+#include "oilprofile.h"
 
 #ifndef _WIN32
 #include <pwd.h>
@@ -41,6 +58,8 @@ constexpr double g = 9.80665;
 
 namespace oil {
 
+    class Sweep;
+
     class Oil_run {
     private:
         class FileFormatError : public std::exception {
@@ -79,9 +98,19 @@ namespace oil {
                 return "The file could not be read. Please ensure you have provided a valid path.";
             }
         };
+        class NoConfidenceIntervalError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "No confidence interval found. Please call get_T() with a non-zero number of bootstrap resamples.";
+            }
+        };
         class NoMapError : public std::exception {
             [[nodiscard]] const char *what() const noexcept override {
-                return "No map of max. V at times t found. Please call the get_T() function.";
+                return "No maxima found. Please call the get_T() function.";
+            }
+        };
+        class TooFewMaximaError : public std::exception {
+            [[nodiscard]] const char *what() const noexcept override {
+                return "Fewer than two maxima were found in the capture, so it has no time period.";
             }
         };
         class NoSingleRunParameters : public std::exception {
@@ -91,13 +120,13 @@ namespace oil {
         };
         class NoNameError : public std::exception {
             [[nodiscard]] const char *what() const noexcept override {
-                return "No name was found. Please name this object either using object[0] to access \"name\", or using the "
-                       "set_name() function.";
+                return "No name was found. Please name this object using the set_name() function.";
             }
         };
-        class LongNameError : public std::exception {
+        class ArchivedRunError : public std::exception {
             [[nodiscard]] const char *what() const noexcept override {
-                return "Length of the name cannot be above 31 characters (excluding the NULL character).";
+                return "Archived runs cannot be deleted or overwritten. Please restore the archive "
+                       "(\"archive restore\") first.";
             }
         };
         class InvalidModeError : public std::exception {
@@ -122,10 +151,28 @@ namespace oil {
         bool have_T = false;
         bool have_Vt = false;
         bool single_param_read = false;
+        bool have_T_CI = false;
         double c = 0;
         double c_err = 0;
-        size_t max_name_size = 32;
-        std::multimap<double, double> V_t;
+        Peak_table peaks;
+        double T_CI[2] = {0, 0};
+        double boot_confidence = 0.95;
+        size_t boot_block_len = 0; // 0 -> chosen from the number of intervals
+        typedef std::deque<double, Arena_allocator<double>> samples; // the times, always double
+        template <typename SAMPLE>
+        using volt_samples = std::deque<SAMPLE, Arena_allocator<SAMPLE>>;
+        bool single_precision = false; // see use_float_samples()
+        bool robust = false; // see use_robust_intervals()
+        stats::interval_result intervals; // of the last get_T() with robust intervals
+        Prefilter prefilter; // none unless set_prefilter() is called
+        baseline_kind baseline = baseline_kind::none; // see set_baseline()
+        double baseline_window = 0; // s
+        Arena *arena = nullptr; // see use_arena()
+        const char *capture_bytes = nullptr; // see use_capture_bytes()
+        size_t capture_size = 0;
+        bool keep = false; // see keep_samples()
+        std::vector<double> kept_times;
+        std::vector<double> kept_volts;
         static size_t check_path(const char *path) {
             struct stat def_test = {};
             if (stat(path, &def_test) == -1) {
@@ -145,23 +192,13 @@ namespace oil {
                 throw FileFormatError();
             }
         }
-        static void check_T_line(const char *line_c) {
-            std::regex rgx(R"(^[^,]{1,101},[^,]{1,101},\s{0,21}\d{1,41}(\.(\d{1,41}))?,.{0,101}\r?\n?$)");
-            if (!std::regex_match(line_c, rgx)) {
-                throw FileFormatError();
-            }
-        }
         void check_if_name_present() const {
-            if (std::strlen(run_data.name) == 0) {
+            if (name.empty()) {
                 throw NoNameError();
             }
         }
-        void check_name(const char *name) const {
-            if (std::strlen(name) > max_name_size - 1) {
-                throw LongNameError();
-            }
-        }
         static void read_path(const char *path, std::vector<double> &values, int num_lines) {
+            prof::Scope stage("parameters");
             std::ifstream file(path, std::fstream::in);
             if (!file.is_open() || !file.good()) {
                 throw std::invalid_argument("Error opening file.\n");
@@ -187,48 +224,327 @@ namespace oil {
             file.close();
             free(line_c_str);
         }
-        static double mean_avg(const std::deque<double> &values) {
-            double total = 0;
-            for (const double &value : values) {
-                total += value;
+        // binary captures (see oilio.h) carry their own sample rate, which takes precedence over freq, and have no
+        // header lines to skip
+        // bytes, if given, are the contents of the capture already read into memory
+        // the layout of CSV captures is recognised from their first lines (see oildialect.h), after the first
+        // skip_lines + 1 lines are skipped; a negative skip_lines skips none and leaves the whole header to be found
+        // returns true if the times are sample numbers divided by freq, rather than read from the capture
+        template <typename TIMES, typename VOLTS>
+        static bool read_capture(const char *path_c, int skip_lines, double freq, TIMES &all_times,
+                                 VOLTS &channel0, const char *bytes = nullptr, size_t size = 0) {
+            bool binary = bytes != nullptr ? size >= sizeof(io::capture_magic) &&
+                                             std::memcmp(bytes, io::capture_magic, sizeof(io::capture_magic)) == 0
+                                           : io::is_binary_capture(path_c);
+            if (binary) { // mapped from the file, which the read into memory has left in the page cache
+                io::Binary_capture bin(path_c);
+                bin.for_each(1, [&all_times, &channel0](double time, double voltage) {
+                    all_times.push_back(time);
+                    channel0.push_back((typename VOLTS::value_type) voltage);
+                });
+                return false;
+            }
+            io::Capture_reader reader; // plain, .gz or .zst
+            if (bytes != nullptr) {
+                reader.open(path_c, bytes, size);
             }
-            return total / (double) values.size();
+            else {
+                reader.open(path_c);
+            }
+            bool indexed = parse_csv(reader, skip_lines, freq, all_times, channel0);
+            reader.close();
+            return indexed;
+        }
+        // Reads a stream (stdin or a FIFO, see io::is_stream()), which must be a plain CSV capture, as it comes in, so
+        // that the capture never has to be written to disk.
+        template <typename TIMES, typename VOLTS>
+        static bool read_stream(const char *path_c, int skip_lines, double freq, TIMES &all_times, VOLTS &channel0) {
+            io::Capture_reader reader;
+            reader.open_stream(path_c);
+            bool indexed = parse_csv(reader, skip_lines, freq, all_times, channel0);
+            reader.close();
+            return indexed;
         }
-        static double SD(const std::deque<double> &values) {
-            std::deque<double> squares;
-            for (const double &val : values) {
-                squares.push_back(val*val);
+        // the CSV part of read_capture(), also used for streams
+        template <typename TIMES, typename VOLTS>
+        static bool parse_csv(io::Capture_reader &reader, int skip_lines, double freq, TIMES &all_times,
+                              VOLTS &channel0) {
+            char buffer[512];
+            for (int i = 0; i <= skip_lines && reader.gets(buffer, sizeof(buffer)) != nullptr; ++i) {
+                // skip_lines + 1 lines, as they were always counted
+            }
+            std::vector<std::string> head; // enough lines to recognise the dialect by
+            while (head.size() < 64 && reader.gets(buffer, sizeof(buffer)) != nullptr) {
+                head.emplace_back(buffer);
+            }
+            io::detected_dialect dialect = io::detect_dialect(head);
+            bool parsed = false;
+            switch (dialect.id) {
+                case io::dialect_id::index_csv:
+                    parsed = io::parse_capture<io::index_csv>(head, dialect.header_lines, reader, freq, all_times,
+                                                              channel0);
+                    break;
+                case io::dialect_id::time_csv:
+                    parsed = io::parse_capture<io::time_csv>(head, dialect.header_lines, reader, freq, all_times,
+                                                             channel0);
+                    break;
+                case io::dialect_id::semicolon_csv:
+                    parsed = io::parse_capture<io::semicolon_csv>(head, dialect.header_lines, reader, freq, all_times,
+                                                                  channel0);
+                    break;
+                case io::dialect_id::tab_csv:
+                    parsed = io::parse_capture<io::tab_csv>(head, dialect.header_lines, reader, freq, all_times,
+                                                            channel0);
+                    break;
+                case io::dialect_id::tek_csv:
+                    parsed = io::parse_capture<io::tek_csv>(head, dialect.header_lines, reader, freq, all_times,
+                                                            channel0);
+                    break;
+                default:
+                    break;
+            }
+            if (!parsed) {
+                throw FileFormatError();
             }
-            double mean = mean_avg(values);
-            return sqrt(mean_avg(squares) - mean*mean);
+            return dialect.id == io::dialect_id::index_csv;
         }
-        static double *avg_time_diff(const std::deque<double> &times) {
-            std::deque<double> diffs;
-            auto end = times.end();
-            for (auto prev_it = times.cbegin(), it = prev_it + 1; it != end; ++prev_it, ++it) {
-                diffs.push_back(*it - *prev_it);
+        // Float samples (see use_float_samples()) are summed pairwise, which keeps the rounding error of the float
+        // sums down to a few units in the last place.
+        template <typename CONTAINER>
+        static double mean_avg(const CONTAINER &values) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(*values.begin())>, float>) {
+                return stats::pairwise_sum<float>(values.begin(), values.size(), [](float value) {
+                    return value;
+                }) / (double) values.size();
             }
+            else {
+                double total = 0;
+                for (const double &value : values) {
+                    total += value;
+                }
+                return total / (double) values.size();
+            }
+        }
+        template <typename CONTAINER>
+        static double SD(const CONTAINER &values) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(*values.begin())>, float>) {
+                auto mean = (float) mean_avg(values); // then the squared deviations, as E[x^2] - E[x]^2 would cancel
+                return sqrt(stats::pairwise_sum<float>(values.begin(), values.size(), [mean](float value) {
+                    return (value - mean)*(value - mean);
+                }) / (double) values.size());
+            }
+            else {
+                stats::welford spread;
+                for (double value : values) {
+                    spread.add(value);
+                }
+                return sqrt(spread.variance());
+            }
+        }
+        template <typename CONTAINER>
+        static double *avg_time_diff(const CONTAINER &times) {
             double total_diff = 0;
-            for (const double &diff : diffs) {
+            stats::welford spread;
+            auto end = times.end();
+            for (auto prev_it = times.begin(), it = prev_it + 1; it != end; ++prev_it, ++it) {
+                double diff = *it - *prev_it;
                 total_diff += diff;
+                spread.add(diff);
             }
             double *retval = (double *) malloc(2*sizeof(double));
             *retval = total_diff / (double) (times.size() - 1); // mean
-            *(retval + 1) = SD(diffs); // standard deviation
+            *(retval + 1) = sqrt(spread.variance()); // standard deviation
             return retval;
         }
-        static int discard_beg(const std::deque<double> &full, int first_max_position) {
+        // avg_time_diff() with missed and doubled maxima corrected for and outliers left out, see
+        // stats::robust_intervals()
+        template <typename CONTAINER>
+        double *robust_time_diff(const CONTAINER &times) {
+            intervals = stats::robust_intervals(times);
+            if (intervals.used == 0) {
+                throw TooFewMaximaError();
+            }
+            double *retval = (double *) malloc(2*sizeof(double));
+            *retval = intervals.mean;
+            *(retval + 1) = intervals.sd;
+            return retval;
+        }
+        template <typename CONTAINER>
+        static int discard_beg(const CONTAINER &full, int first_max_position) {
             auto start_beg = full.begin();
             auto end_beg = start_beg + first_max_position;
             auto start_rest = end_beg + 1;
             auto end_rest = full.end();
-            std::deque<double> beg(start_beg, std::next(end_beg));
-            std::deque<double> rest(start_rest, std::next(end_rest));
+            CONTAINER beg(start_beg, std::next(end_beg), full.get_allocator());
+            CONTAINER rest(start_rest, end_rest, full.get_allocator());
             if (mean_avg(beg) < mean_avg(rest)) {
                 return 0;
             }
             return 1;
         }
+        // Fills peaks with the maxima of channel0: the highest voltage each time it goes above the mean and then back
+        // below it, as the loop in get_T() that this replaced did. With hysteresis > 0, it must instead go above
+        // mean + hysteresis*SD and back below mean - hysteresis*SD, so that noise around the mean does not split one
+        // maximum into several. With a baseline, the mean is instead the rolling baseline over window samples around
+        // each sample (see Baseline), worked out in the same pass, so that the threshold follows a capture that drifts.
+        template <typename TIMES, typename VOLTS>
+        static void find_peaks(const TIMES &all_times, const VOLTS &channel0, double hysteresis, Peak_table &peaks,
+                               baseline_kind baseline = baseline_kind::none, size_t window = 0) {
+            double mean_v = mean_avg(channel0);
+            double band = hysteresis > 0 ? hysteresis*SD(channel0) : 0;
+            double high = mean_v + band, low_v = mean_v - band;
+            Baseline rolling(baseline, window);
+            size_t pushed = 0;
+            auto old_volt = [&channel0](uint64_t i) {
+                return (double) channel0[i];
+            };
+            double big = -std::numeric_limits<double>::infinity(); // highest voltage since it went above the mean
+            double low = std::numeric_limits<double>::max(); // lowest voltage since the last maximum
+            double rise = all_times.empty() ? 0 : all_times.front(); // when the voltage last went above the mean
+            bool above = false; // and has not gone back below it, so big is a maximum still being climbed
+            peaks.clear();
+            int count_v = 0;
+            bool first_time = true;
+            int first_max_pos = 0;
+            for (double voltage : channel0) {
+                if (rolling.active()) {
+                    for (; pushed < channel0.size() && pushed < rolling.needed(count_v); ++pushed) {
+                        rolling.push(channel0[pushed]);
+                    }
+                    double level = rolling.at(count_v, old_volt);
+                    high = level + band;
+                    low_v = level - band;
+                }
+                low = std::min(low, voltage);
+                if (voltage > big && voltage > high) {
+                    big = voltage;
+                }
+                if (voltage > high && !above) {
+                    rise = all_times[count_v];
+                    above = true;
+                }
+                if (voltage < low_v) {
+                    if (above) {
+                        peaks.add(count_v, all_times[count_v], big, all_times[count_v] - rise, low);
+                        big = -std::numeric_limits<double>::infinity();
+                        low = voltage;
+                        if (first_time) {
+                            first_max_pos = count_v;
+                            first_time = false;
+                        }
+                    }
+                    above = false;
+                }
+                count_v++;
+            }
+            if (!peaks.empty() && discard_beg(channel0, first_max_pos)) {
+                peaks.drop_front(1);
+            }
+            peaks.drop_front(2);
+            peaks.finish(low);
+        }
+        // get_T() with the voltages kept as SAMPLE
+        template <typename SAMPLE>
+        double *find_T(const char *path_c, int skip_lines, double freq, const char *write_path_c,
+                       size_t bootstrap_resamples) {
+            bool plot = false; // a .png or .svg write path gets a rendered plot instead of a CSV of the samples
+            if (write_path_c != nullptr) {
+                std::string write_path(write_path_c);
+                plot = io::ends_with(write_path, ".png") || io::ends_with(write_path, ".svg");
+            }
+            std::string path(path_c);
+            if (arena != nullptr) {
+                arena->reset(); // nothing from the last capture is still in use
+            }
+            samples all_times{Arena_allocator<double>(arena)};
+            volt_samples<SAMPLE> channel0{Arena_allocator<SAMPLE>(arena)};
+            const char *bytes = capture_bytes;
+            capture_bytes = nullptr;
+            {
+                prof::Scope stage("parse");
+                if (io::is_stream(path_c)) {
+                    read_stream(path_c, skip_lines, freq, all_times, channel0);
+                }
+                else {
+                    read_capture(path_c, skip_lines, freq, all_times, channel0, bytes, capture_size);
+                }
+            }
+            if (write_path_c != nullptr && !plot) {
+                prof::Scope stage("write samples");
+                FILE *toWrite = fopen(write_path_c, "w+");
+                if (toWrite == nullptr) {
+                    throw FileWritingFailedError();
+                }
+                int count_w = 0;
+                std::string writing;
+                for (const double &time: all_times) {
+                    writing = std::to_string(time) + "," + std::to_string(channel0[count_w]) + "\n";
+                    fputs(writing.c_str(), toWrite);
+                    count_w++;
+                }
+                fclose(toWrite);
+            }
+            double rate = 0; // taken from the times, as binary captures carry their own
+            if (all_times.size() > 1) {
+                prof::Scope stage("filter");
+                rate = (double) (all_times.size() - 1)/(all_times.back() - all_times.front());
+                prefilter.apply(all_times, channel0, rate);
+            }
+            if (keep) {
+                kept_times.assign(all_times.begin(), all_times.end());
+                kept_volts.assign(channel0.begin(), channel0.end());
+            }
+            size_t window = 0;
+            if (baseline != baseline_kind::none) {
+                window = std::max<size_t>(2, std::lround(baseline_window*rate));
+            }
+            {
+                prof::Scope stage("peaks");
+                find_peaks(all_times, channel0, 0, peaks, baseline, window);
+            }
+            have_Vt = true;
+            if (plot) {
+                prof::Scope stage("plot");
+                Waveform_plot figure;
+                figure.set_samples(all_times, channel0);
+                figure.set_maxima(peaks.times(), peaks.amplitudes());
+                figure.set_title("Data for " + name);
+                figure.save(write_path_c);
+            }
+            if (peaks.size() < 2) {
+                throw TooFewMaximaError();
+            }
+            double *both;
+            {
+                prof::Scope stage("intervals");
+                both = robust ? robust_time_diff(peaks.times()) : avg_time_diff(peaks.times());
+            }
+            run_data.T = *both;
+            run_data.T_err = *(both + 1);
+            have_T = true;
+            have_T_CI = false;
+            if (bootstrap_resamples > 0) {
+                prof::Scope stage("bootstrap");
+                stats::bootstrap_result boot;
+                if (robust) { // resamples the corrected intervals, as times again so that they sum to the same
+                    std::vector<double> times(1, 0);
+                    for (double interval : intervals.kept) {
+                        times.push_back(times.back() + interval);
+                    }
+                    boot = stats::block_bootstrap(times, bootstrap_resamples, boot_confidence, boot_block_len);
+                }
+                else {
+                    boot = stats::block_bootstrap(peaks.times(), bootstrap_resamples, boot_confidence, boot_block_len);
+                }
+                T_CI[0] = boot.ci_low;
+                T_CI[1] = boot.ci_high;
+                have_T_CI = true;
+                both = (double *) realloc(both, 4*sizeof(double));
+                *(both + 2) = T_CI[0];
+                *(both + 3) = T_CI[1];
+            }
+            return both;
+        }
         static std::string string_upper(const char *str) {
             if (str == nullptr) {
                 return {};
@@ -240,7 +556,8 @@ namespace oil {
             return ret_string;
         }
         typedef struct {
-            char name[32];
+            uint32_t name_id; // in the Name_table of the .dat file the run was last written to
+            uint32_t reserved; // keeps the doubles 8-byte aligned
             double a;
             double a_err;
             double b;
@@ -263,19 +580,17 @@ namespace oil {
             double visc_err;
         } data;
         data run_data{};
+        std::string name;
     public:
-        Oil_run() {
-            std::memset(run_data.name, '\0', max_name_size);
-        }
+        typedef data record; // layout of one run in a .dat file
+        Oil_run() = default;
         explicit Oil_run(const std::string &constants_path) {
             check_path(constants_path);
             constants.append(constants_path);
-            std::memset(run_data.name, '\0', max_name_size);
         }
         explicit Oil_run(const char *constants_path) {
             check_path(constants_path);
             constants.append(constants_path);
-            std::memset(run_data.name, '\0', max_name_size);
         }
         void set_constants_path(const std::string &constants_path) {
             constants_read = false;
@@ -287,13 +602,14 @@ namespace oil {
             check_path(constants_path);
             constants.append(constants_path);
         }
-        void set_name(const char *name) {
-            check_name(name);
-            std::strcpy(run_data.name, name);
+        void set_name(const char *run_name) {
+            name = run_name;
         }
-        void set_name(const std::string &name) {
-            check_name(name.c_str());
-            std::strcpy(run_data.name, name.c_str());
+        void set_name(const std::string &run_name) {
+            name = run_name;
+        }
+        [[nodiscard]] const std::string &get_name() const {
+            return name;
         }
         void read_constants() {
             if (constants.empty()) {
@@ -355,88 +671,85 @@ namespace oil {
             run_data.sub_err = values[3];
             single_param_read = true;
         }
-        double *get_T(const char *path_c, int skip_lines, double freq, const char *write_path_c = nullptr) {
-            check_path(path_c);
-            if (write_path_c != nullptr) {
-                std::string write_path(write_path_c);
-            }
-            std::string path(path_c);
-            std::deque<double> all_times;
-            std::deque<double> channel0;
-            FILE *fp = fopen(path_c, "r");
-            char *buffer = (char *) malloc(512*sizeof(char));
-            int count = 0;
-            char comma[2] = ",";
-            while (fgets(buffer, 512, fp) != nullptr) {
-                if (count > skip_lines) {
-                    check_T_line(buffer);
-                    strtok(buffer, comma);
-                    double sample_time = strtod(buffer, nullptr) / freq;
-                    all_times.push_back(sample_time);
-                    strtok(nullptr, comma);
-                    char *num = strtok(nullptr, comma);
-                    double channel0_num = strtod(num, nullptr);
-                    channel0.push_back(channel0_num);
-                }
-                count++;
-            }
-            fclose(fp);
-            free(buffer);
-            if (write_path_c != nullptr) {
-                FILE *toWrite = fopen(write_path_c, "w+");
-                if (toWrite == nullptr) {
-                    throw FileWritingFailedError();
-                }
-                int count_w = 0;
-                std::string writing;
-                for (const double &time: all_times) {
-                    writing = std::to_string(time) + "," + std::to_string(channel0[count_w]) + "\n";
-                    fputs(writing.c_str(), toWrite);
-                    count_w++;
-                }
-                fclose(toWrite);
-            }
-            double mean_v = mean_avg(channel0);
-            double big = 0;
-            std::deque<double> maxima;
-            std::deque<double> maxima_times;
-            int count_v = 0;
-            bool first_time = true;
-            int first_max_pos;
-            for (const double &voltage : channel0) {
-                if (voltage > big && voltage > mean_v) {
-                    big = voltage;
-                }
-                if (voltage < mean_v) {
-                    if (big != 0 && big != voltage) {
-                        maxima.push_back(big);
-                        big = 0;
-                        maxima_times.push_back(all_times[count_v]);
-                        if (first_time) {
-                            first_max_pos = count_v;
-                            first_time = false;
-                        }
-                    }
-                }
-                count_v++;
+        // low-pass filters the voltages before get_T() looks for maxima, see Prefilter
+        void set_prefilter(filter_kind kind, double cutoff_hz) {
+            prefilter = Prefilter(kind, cutoff_hz);
+        }
+        // makes get_T() compare the voltages with a rolling baseline over window_s seconds rather than with the mean
+        // of the whole capture, see find_peaks()
+        void set_baseline(baseline_kind kind, double window_s) {
+            if (kind != baseline_kind::none && !(window_s > 0)) {
+                throw std::invalid_argument("The baseline window must be a positive time in s.\n");
+            }
+            baseline = kind;
+            baseline_window = window_s;
+        }
+        // get_T() draws its buffers from the arena, which it resets at the start of every call, so an arena must not be
+        // shared by two analyses running at the same time; nullptr goes back to the heap
+        void use_arena(Arena *buffers) {
+            arena = buffers;
+        }
+        // the next get_T() call parses these bytes (which must stay alive until then) rather than reading the capture
+        void use_capture_bytes(const char *bytes, size_t size) {
+            capture_bytes = bytes;
+            capture_size = size;
+        }
+        // Makes get_T() keep the voltages as float rather than double, which halves the memory the samples take and
+        // doubles the SIMD width of the filters; the ADCs of the scopes resolve far less than float does. The times
+        // stay double, and the means and SDs taken of the voltages are summed pairwise.
+        void use_float_samples(bool on = true) {
+            single_precision = on;
+        }
+        // Makes get_T() take T from the intervals between maxima robustly: one that spans two periods (a maximum was
+        // missed) counts once at half its length, two that make up one period (a maximum was counted twice) are
+        // joined, and outliers are left out rather than inflating T_err, and the bootstrap interval is taken of the
+        // corrected intervals too. See get_interval_summary() for what was done.
+        void use_robust_intervals(bool on = true) {
+            robust = on;
+        }
+        [[nodiscard]] const stats::interval_result &get_interval_summary() const {
+            return intervals;
+        }
+        // makes get_T() keep the (filtered) samples it analysed, for get_sample_times() and get_sample_volts()
+        void keep_samples(bool on = true) {
+            keep = on;
+            if (!on) {
+                kept_times = std::vector<double>();
+                kept_volts = std::vector<double>();
             }
-            if (discard_beg(channel0, first_max_pos)) {
-                maxima.erase(maxima.cbegin());
-                maxima_times.erase(maxima_times.cbegin());
+        }
+        [[nodiscard]] const std::vector<double> &get_sample_times() const {
+            return kept_times;
+        }
+        [[nodiscard]] const std::vector<double> &get_sample_volts() const {
+            return kept_volts;
+        }
+        void set_bootstrap_options(double confidence, size_t block_length = 0) {
+            if (confidence <= 0 || confidence >= 1) {
+                throw std::invalid_argument("The confidence level must lie strictly between 0 and 1.\n");
             }
-            maxima.pop_front(); maxima.pop_front();
-            maxima_times.pop_front(); maxima_times.pop_front();
-            int count_final = 0;
-            for (const double &volt : maxima) {
-                V_t.insert({maxima_times[count_final], volt});
-                count_final++;
+            boot_confidence = confidence;
+            boot_block_len = block_length;
+        }
+        // with bootstrap_resamples > 0 the returned array also holds the confidence interval for T:
+        // {T, T_err, low, high}
+        // path_c may also be "-" for stdin, or a FIFO, which are parsed as they are read (see read_stream())
+        double *get_T(const char *path_c, int skip_lines, double freq, const char *write_path_c = nullptr,
+                      size_t bootstrap_resamples = 0) {
+            if (!io::is_stream(path_c)) { // a stream has no size to check, and stdin no path
+                check_path(path_c);
+            }
+            return single_precision ? find_T<float>(path_c, skip_lines, freq, write_path_c, bootstrap_resamples)
+                                    : find_T<double>(path_c, skip_lines, freq, write_path_c, bootstrap_resamples);
+        }
+        double *get_T_CI() const {
+            if (!have_T_CI) {
+                throw NoConfidenceIntervalError();
             }
-            have_Vt = true;
-            double *both = avg_time_diff(maxima_times);
-            run_data.T = *both;
-            run_data.T_err = *(both + 1);
-            have_T = true;
-            return both;
+            auto *retval = (double *) malloc(2*sizeof(double));
+            *retval = T_CI[0];
+            *(retval + 1) = T_CI[1];
+            return retval;
         }
         double *calc_visc_from_T() {
             if (!have_T) {
@@ -455,22 +768,26 @@ namespace oil {
             *(retval + 1) = run_data.visc_err;
             return retval;
         }
-        std::multimap<double, double> get_max_V_t_map() const {
+        // the maxima found by the last get_T() call, valid until the next one
+        [[nodiscard]] const Peak_table &get_peaks() const {
             if (!have_Vt) {
                 throw NoMapError();
             }
-            return V_t;
+            return peaks;
         }
         void display_V_t_map() const {
             if (!have_Vt || !have_T) {
                 throw NoMapError();
             }
-            for (const std::pair<const double, double> &pair : V_t) {
-                std::cout << pair.second << " volts at time: " << pair.first << " s" << std::endl;
+            Span<double> times = peaks.times(), volts = peaks.amplitudes();
+            for (size_t i = 0; i < peaks.size(); ++i) {
+                std::cout << volts[i] << " volts at time: " << times[i] << " s\n";
             }
+            std::cout.flush();
         }
         int write_data(const char *path_c, const char *mode_c = "OW") {
             check_if_name_present();
+            prof::Scope stage("store");
             std::string path(path_c);
             std::string mode;
             mode = string_upper(mode_c);
@@ -480,17 +797,42 @@ namespace oil {
             if (mode != "OW" && mode != "APP" && mode != "DN") {
                 throw InvalidModeError();
             }
+            Name_table names;
+            names.open<data>(path_c); // before anything else reads the .dat file
+            Calibration cal;
+            bool calibrated = cal.load_for(path_c);
+            Aggregates agg;
+            agg.sync<data>(path_c);
+            bool named_before = names.find(name) != Name_table::none;
+            run_data.name_id = names.intern(name);
+            names.save(); // ahead of the run, so that no run in the file ever has an id the table lacks
             struct stat file = {};
             if (stat(path_c, &file) == -1) {
-                std::ofstream stream(path_c, std::fstream::out | std::fstream::trunc | std::fstream::binary);
-                if (!stream.good()) {
+                if (!Dat_file<data>::write(path_c, &run_data, 1, Archive<data>::bytes(path_c))) {
                     throw FileWritingFailedError();
                 }
-                stream.write((char *) &run_data, sizeof(data));
-                stream.close();
+                if (calibrated) { // stale sums left behind by a deleted .dat file
+                    cal.clear();
+                    cal.add(run_data, name);
+                    cal.save();
+                }
+                agg.clear();
+                agg.add(run_data, name, 0);
+                agg.save();
                 return 0;
             }
-            if (file.st_size == 0 || mode == "APP") {
+            size_t num_structs = Dat_file<data>::count(path_c);
+            // archived runs are read-only (see oilarchive.h), so "OW" of one fails rather than append a second run
+            if (mode != "APP" && named_before && Archive<data>::exists(path_c)) {
+                std::vector<uint32_t> archived = Archive<data>::name_ids(path_c);
+                if (std::find(archived.begin(), archived.end(), run_data.name_id) != archived.end()) {
+                    if (mode == "DN") {
+                        return 3;
+                    }
+                    throw ArchivedRunError();
+                }
+            }
+            if (num_structs == 0 || mode == "APP" || !named_before) { // no run in the file can have this name
                 perhaps:
                 std::ofstream stream(path_c, std::fstream::out | std::fstream::binary | std::fstream::app);
                 if (!stream.good()) {
@@ -498,42 +840,46 @@ namespace oil {
                 }
                 stream.write((char *) &run_data, sizeof(data));
                 stream.close();
+                if (calibrated && cal.add(run_data, name)) {
+                    cal.save();
+                }
+                agg.add(run_data, name, Archive<data>::count(path_c) + num_structs);
+                agg.save();
+                Archive<data>::seal_if_due(path_c, num_structs + 1);
                 return 1;
             }
-            std::ifstream stream(path_c, std::fstream::in | std::fstream::binary);
-            if (!stream.good()) {
-                throw FileWritingFailedError();
-            }
-            size_t file_size = file.st_size;
-            size_t num_structs = file_size / sizeof(data);
-            data *runs = (data *) malloc(file_size);
-            stream.read((char *) runs, (std::streamsize) file_size);
-            stream.close();
+            std::vector<data> runs = Dat_file<data>::read(path_c);
             size_t ow_count = 0;
-            data *ptr = runs;
+            uint64_t archived = Archive<data>::count(path_c);
+            data *ptr = runs.data();
             for (size_t i = 0; i < num_structs; ++i, ++ptr) {
-                if (std::strcmp(run_data.name, ptr->name) == 0) {
+                if (ptr->name_id == run_data.name_id) {
                     if (mode == "DN") {
                         return 3;
                     }
                     else if (mode == "OW") {
+                        if (calibrated) {
+                            cal.remove(*ptr, name);
+                            cal.add(run_data, name);
+                        }
+                        agg.remove(*ptr, name);
+                        agg.add(run_data, name, archived + i);
                         *ptr = run_data;
                         ow_count++;
                     }
                 }
             }
             if (ow_count > 0) {
-                std::ofstream stream_w(path_c, std::fstream::out | std::fstream::binary | std::fstream::trunc);
-                if (!stream.good()) {
+                if (!Dat_file<data>::write(path_c, runs.data(), runs.size())) {
                     throw FileWritingFailedError();
                 }
-                stream_w.write((char *) runs, (std::streamsize) file_size);
-                stream_w.close();
-                free(runs);
+                if (calibrated) {
+                    cal.save();
+                }
+                agg.save();
                 return 2;
             }
             else {
-                free(runs);
                 goto perhaps;
             }
         }
@@ -549,64 +895,95 @@ namespace oil {
             if (std::strcmp(end, ".dat") != 0) {
                 throw std::invalid_argument("A .dat file was not provided.\n");
             }
-            std::ifstream input(path, std::fstream::in | std::fstream::binary);
-            if (!input.good()) {
-                throw FileReadingFailedError();
+            Name_table names;
+            names.open<data>(path); // before anything else reads the .dat file
+            uint32_t id = names.find(run_name);
+            Aggregates agg;
+            agg.sync<data>(path); // before the file is rewritten
+            if (id == Name_table::none) {
+                return 0; // no run has ever had this name
+            }
+            std::vector<uint32_t> archived = Archive<data>::name_ids(path);
+            if (std::find(archived.begin(), archived.end(), id) != archived.end()) {
+                throw ArchivedRunError();
+            }
+            std::vector<data> runs = Dat_file<data>::read(path);
+            Calibration cal;
+            bool calibrated = cal.load_for(path);
+            agg.reset_latest();
+            uint64_t kept = archived.size();
+            size_t out = 0;
+            for (const data &run : runs) {
+                if (run.name_id != id) {
+                    agg.place(run, names.name(run.name_id), kept++);
+                    runs[out++] = run;
+                    continue;
+                }
+                if (calibrated) {
+                    cal.remove(run, run_name);
+                }
+                agg.remove(run, run_name);
             }
-            size_t num_structs = def_test.st_size / sizeof(data);
-            data *runs = (data *) malloc(def_test.st_size);
-            input.read((char *) runs, (std::streamsize) def_test.st_size);
-            input.close();
-            std::ofstream output(path, std::fstream::out | std::fstream::binary | std::fstream::trunc);
-            if (!output.good()) {
-                throw FileReadingFailedError();
+            if (!Dat_file<data>::write(path, runs.data(), out)) {
+                throw FileWritingFailedError();
             }
-            data *ptr = runs;
-            for (size_t i = 0; i < num_structs; i++, ++ptr) {
-                if (std::strcmp(run_name, ptr->name) != 0) {
-                    output.write((char *) ptr, sizeof(data));
-                }
+            if (calibrated) {
+                cal.save();
             }
-            output.close();
-            free(runs);
+            agg.save();
             return 0;
         }
+        // fits MT vs l to every run in the .dat file whose name starts with prefix, and keeps the fit (and the
+        // graph variables file, if one is given) up to date on every subsequent write_data()/delete_run() call on it
+        static Calibration calibrate(const char *dat_path, const char *prefix = "",
+                                     const char *graph_vars_path = nullptr) {
+            check_path(dat_path);
+            Calibration cal(prefix);
+            cal.rebuild<data>(dat_path);
+            cal.set_graph_vars_path(graph_vars_path);
+            cal.save();
+            if (graph_vars_path != nullptr && cal.write_graph_vars(graph_vars_path) != 0) {
+                throw FileWritingFailedError();
+            }
+            return cal;
+        }
         void load_from_dat(const char *dat_file_path) {
-            if (check_path(dat_file_path) != sizeof(data)) {
+            Name_table names;
+            names.load<data>(dat_file_path);
+            check_path(dat_file_path);
+            if (Dat_file<data>::count(dat_file_path) != 1) {
                 throw DataFileSizeError();
             }
-            std::ifstream in(dat_file_path);
-            in >> *this;
-            in.close();
+            FILE *fp = Dat_file<data>::open_runs(dat_file_path);
+            bool ok = fp != nullptr && fread(&run_data, sizeof(data), 1, fp) == 1;
+            if (fp != nullptr) {
+                fclose(fp);
+            }
+            if (!ok) {
+                throw FileReadingFailedError();
+            }
+            name = names.name(run_data.name_id);
         }
-        static int gen_text(const char *input_path_c, const char *output_path_c, bool open = true) {
+        static int gen_text(const char *input_path_c, const char *output_path_c, bool open = false,
+                            report_format format = report_format::text) {
             std::string input_path(input_path_c);
             if (input_path.rfind(".dat", input_path.size() - 4) == std::string::npos) {
                 throw std::invalid_argument("Data can only be read from a .dat file.");
             }
-            struct stat info = {};
-            stat(input_path_c, &info);
-            if (info.st_size == 0) {
+            Dat_file<data>::check(input_path_c);
+            if (Dat_file<data>::count(input_path_c) == 0 && Archive<data>::count(input_path_c) == 0) {
                 return 1;
             }
-            std::ifstream input_file(input_path_c, std::fstream::in | std::fstream::binary);
-            if (!input_file.good()) {
+            if (!std::ifstream(input_path_c, std::fstream::in | std::fstream::binary).good()) {
                 throw FileReadingFailedError();
             }
-            std::ofstream output_file(output_path_c, std::fstream::trunc | std::fstream::out);
-            if (!output_file.good()) {
-                throw FileWritingFailedError();
+            try {
+                Report<data>::write(input_path_c, output_path_c, format);
             }
-            size_t num_structs = info.st_size / sizeof(data);
-            oil::Oil_run run;
-            for (size_t i = 0; i < num_structs; i++) {
-                input_file >> run;
-                output_file << run;
-                output_file << "\n\n\n";
+            catch (const std::invalid_argument &) {
+                throw FileWritingFailedError();
             }
-            input_file.close();
-            output_file.close();
-            if (open) {
+            if (open) { // only ever launches a viewer when asked to
                 std::string command;
 #ifndef _WIN32
                 command.append("open ");
@@ -681,7 +1058,7 @@ namespace oil {
             else if (elem == "SUB" || elem == "SUBMERGENCE") {
                 return &run_data.submergence;
             }
-            else if (elem == "SUB_ERR" || "SUBMERGENCE_ERR") {
+            else if (elem == "SUB_ERR" || elem == "SUBMERGENCE_ERR") {
                 return &run_data.sub_err;
             }
             else if (elem == "V" || elem == "VISC" || elem == "VISCOSITY") {
@@ -695,25 +1072,26 @@ namespace oil {
                                         "the \"name\" member.");
             }
         }
-        char *operator[](const int &index) {
+        const char *operator[](const int &index) {
             if (index == 0) {
-                return run_data.name;
+                return name.c_str();
             }
             else {
                 throw std::out_of_range("You are indexing an element that does not exist.");
             }
         }
-        char *operator[](const int &&index) {
+        const char *operator[](const int &&index) {
             return (*this)[index];
         }
-        friend std::ostream &operator<<(std::ostream &out, const Oil_run &run);
-        friend Oil_run &operator>>(std::istream &in, Oil_run &run);
-        friend Oil_run &operator>>(const data &runData, Oil_run &run);
+        friend class Sweep;
+        friend inline std::ostream &operator<<(std::ostream &out, const Oil_run &run);
+        friend inline Oil_run &operator>>(std::istream &in, Oil_run &run);
+        friend inline Oil_run &operator>>(const data &runData, Oil_run &run);
     };
 
-    std::ostream &operator<<(std::ostream &out, const oil::Oil_run &run) {
+    inline std::ostream &operator<<(std::ostream &out, const oil::Oil_run &run) {
         return out
-                << "Name: " << run.run_data.name << "\n"
+                << "Name: " << run.name << "\n"
                 << "Outer cylinder radius = " << run.run_data.a << " +/- " << run.run_data.a_err << " m\n"
                 << "Inner cylinder radius = " << run.run_data.b << " +/- " << run.run_data.b_err << " m\n"
                 << "Drum diameter = " << run.run_data.drum << " +/- " << run.run_data.drum_err << " m\n"
@@ -727,13 +1105,13 @@ namespace oil {
                 << run.run_data.visc_err << Oil_run::visc_units();
     }
 
-    Oil_run &operator>>(std::istream &in, oil::Oil_run &run) {
+    inline Oil_run &operator>>(std::istream &in, oil::Oil_run &run) {
         in.read((char *) &run.run_data, sizeof(Oil_run::data));
         return run;
     }
 
-    Oil_run &operator>>(const Oil_run::data &runData, Oil_run &run) {
-        strcpy(run.run_data.name, runData.name);
+    inline Oil_run &operator>>(const Oil_run::data &runData, Oil_run &run) {
+        run.run_data.name_id = runData.name_id;
         run.run_data.a = runData.a; run.run_data.a_err = runData.a_err;
         run.run_data.b = runData.b; run.run_data.b_err = runData.b_err;
         run.run_data.drum = runData.drum; run.run_data.drum_err = runData.drum_err;
@@ -747,13 +1125,13 @@ namespace oil {
         return run;
     }
 
-    void string_upper(std::string &str) {
+    inline void string_upper(std::string &str) {
         for (char &ch : str) {
             ch = (char) std::toupper(ch);
         }
     }
 
-    void string_upper(char *str) {
+    inline void string_upper(char *str) {
         if (str == nullptr) {
             return;
         }
@@ -763,7 +1141,7 @@ namespace oil {
         }
     }
 
-    bool is_numeric(const char *str) {
+    inline bool is_numeric(const char *str) {
         if (str == nullptr) {
             return false;
         }
@@ -775,7 +1153,7 @@ namespace oil {
         return true;
     }
 
-    bool is_numeric(const std::string &str) {
+    inline bool is_numeric(const std::string &str) {
         if (str.empty()) {
             return false;
         }
@@ -787,17 +1165,17 @@ namespace oil {
         return true;
     }
 
-    void clear_cin() {
+    inline void clear_cin() {
         std::cin.clear();
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     }
 
     template <typename PATH>
-    PATH get_home_path() {
+    inline PATH get_home_path() {
         return {};
     }
 
-    template <> char *get_home_path<char *>() {
+    template <> inline char *get_home_path<char *>() {
 #ifdef _WIN32
         char *home_path_c = (char *) malloc(MAX_PATH);
         if (SHGetFolderPathA(NULL, CSIDL_PROFILE, NULL, SHGFP_TYPE_CURRENT, home_path_c) != S_OK) {
@@ -816,7 +1194,7 @@ namespace oil {
 #endif
     }
 
-    template <> std::string get_home_path<std::string>() {
+    template <> inline std::string get_home_path<std::string>() {
 #ifdef _WIN32
         char home_path_c[MAX_PATH];
         if (SHGetFolderPathA(NULL, CSIDL_PROFILE, NULL, SHGFP_TYPE_CURRENT, home_path_c) != S_OK) {
@@ -831,7 +1209,7 @@ namespace oil {
 #endif
     }
 
-    int check_path(const char *path_c, const char *def_path) {
+    inline int check_path(const char *path_c, const char *def_path) {
         struct stat def_test = {};
         mode_t mode;
         std::string path(path_c);
@@ -860,8 +1238,8 @@ namespace oil {
         }
         return 0;
     }
-    int generate_sample_texts(const char *constants_path, const char *graph_vars_path,
-                              const char *single_run_params_path) {
+    inline int generate_sample_texts(const char *constants_path, const char *graph_vars_path,
+                                     const char *single_run_params_path) {
         FILE *fp1 = fopen(constants_path, "w+");
         FILE *fp2 = fopen(graph_vars_path, "w+");
         FILE *fp3 = fopen(single_run_params_path, "w+");
@@ -888,7 +1266,7 @@ namespace oil {
         fprintf(fp1, const_w); fprintf(fp2, graph_w); fprintf(fp3, singleW); fclose(fp1); fclose(fp2); fclose(fp3);
         return 0;
     }
-    int del(const char *path) {
+    inline int del(const char *path) {
         struct stat test = {};
         if (stat(path, &test) == -1) {
             return 1;
@@ -902,10 +1280,10 @@ namespace oil {
         }
         return 0;
     }
-    int del(const std::string &path) {
+    inline int del(const std::string &path) {
         return del(path.c_str());
     }
-    int make_dir(const char *path) {
+    inline int make_dir(const char *path) {
         struct stat test = {};
         if (stat(path, &test) == -1) {
             int retval;
@@ -918,7 +1296,7 @@ namespace oil {
         }
         return 1;
     }
-    int make_dir(const std::string &path) {
+    inline int make_dir(const std::string &path) {
         return make_dir(path.c_str());
     }
 }
@@ -0,0 +1,322 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILPROFILE_H
+#define OILPROFILE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace oil::prof {
+
+    // Memory profile of the analysis, by stage of the pipeline (see Scope). Stage timings and the RSS are always
+    // available once start() is called; the allocation counts also need the allocator hooks of oilhooks.h, which a
+    // program only has if it was built with OIL_PROFILE_ALLOCATIONS defined. Only blocks allocated while profiling
+    // is on are counted, freeing included, so that freeing what was allocated before start() does not take the live
+    // heap below zero; the Arena's mapped blocks are counted as well. Everything here is safe to call from inside
+    // malloc(): it only touches atomics, a thread_local and fixed arrays.
+    constexpr int max_stages = 32;
+    constexpr size_t tracked_slots = 1 << 18; // of the table of blocks allocated while profiling
+    constexpr size_t max_probes = 64;
+    constexpr uintptr_t removed = 1; // a slot whose block was freed
+
+    struct stage_stats {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> nanoseconds{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> bytes{0}; // allocated
+        std::atomic<uint64_t> freed{0};
+        std::atomic<int64_t> peak_live{0}; // the most heap in use at once while the stage ran
+        std::atomic<uint64_t> peak_rss{0};
+    };
+
+    inline std::atomic<bool> active{false};
+    inline std::atomic<bool> hooked{false}; // set by the allocator hooks, once they see their first allocation
+    inline std::atomic<int64_t> live{0}; // heap in use, counted from start()
+    inline std::atomic<int64_t> peak_live{0};
+    inline std::atomic<uint64_t> peak_rss{0};
+    inline std::atomic<int> latest{0}; // the stage last entered on any thread, which RSS samples are put down to
+    inline stage_stats stages[max_stages]; // stage 0 is everything outside a Scope
+    inline std::mutex stage_lock; // only for adding stages
+    inline thread_local int current = 0;
+    inline std::atomic<uintptr_t> tracked[tracked_slots]; // open addressing, 0 for an empty slot
+    inline std::atomic<uint64_t> untracked{0}; // allocations left out because the table had no room near their slot
+
+    inline void raise(std::atomic<int64_t> &peak, int64_t value) {
+        int64_t seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    inline void raise(std::atomic<uint64_t> &peak, uint64_t value) {
+        uint64_t seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    inline size_t slot_of(const void *ptr) {
+        return (size_t) ((((uintptr_t) ptr >> 4)*0x9e3779b97f4a7c15ULL) >> 46) % tracked_slots;
+    }
+
+    // adds ptr to the table of blocks allocated while profiling, unless there is no room near its slot
+    inline bool track(const void *ptr) {
+        size_t slot = slot_of(ptr);
+        for (size_t i = 0; i < max_probes; ++i, slot = (slot + 1) % tracked_slots) {
+            uintptr_t seen = tracked[slot].load(std::memory_order_relaxed);
+            while ((seen == 0 || seen == removed) &&
+                   !tracked[slot].compare_exchange_weak(seen, (uintptr_t) ptr, std::memory_order_relaxed)) {}
+            if (seen == 0 || seen == removed) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // removes ptr from the table, returning whether it was there
+    inline bool untrack(const void *ptr) {
+        size_t slot = slot_of(ptr);
+        for (size_t i = 0; i < max_probes; ++i, slot = (slot + 1) % tracked_slots) {
+            uintptr_t seen = tracked[slot].load(std::memory_order_relaxed);
+            if (seen == 0) {
+                return false;
+            }
+            if (seen == (uintptr_t) ptr) {
+                return tracked[slot].compare_exchange_strong(seen, removed, std::memory_order_relaxed);
+            }
+        }
+        return false;
+    }
+
+    // called by the hooks, and by the Arena for the blocks it maps
+    inline void note_allocation(const void *ptr, size_t size) {
+        if (!active.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (!track(ptr)) {
+            untracked.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        stage_stats &stage = stages[current];
+        stage.allocations.fetch_add(1, std::memory_order_relaxed);
+        stage.bytes.fetch_add(size, std::memory_order_relaxed);
+        int64_t now = live.fetch_add((int64_t) size, std::memory_order_relaxed) + (int64_t) size;
+        raise(stage.peak_live, now);
+        raise(peak_live, now);
+    }
+
+    // returns whether the block was counted, i.e. was allocated while profiling
+    inline bool note_free(const void *ptr, size_t size) {
+        if (!active.load(std::memory_order_relaxed) || !untrack(ptr)) {
+            return false;
+        }
+        stage_stats &stage = stages[current];
+        stage.frees.fetch_add(1, std::memory_order_relaxed);
+        stage.freed.fetch_add(size, std::memory_order_relaxed);
+        live.fetch_sub((int64_t) size, std::memory_order_relaxed);
+        return true;
+    }
+
+    // resident set size in bytes, or 0 where it cannot be had; reads /proc without allocating
+    inline uint64_t rss_bytes() {
+#if defined(__linux__)
+        int fd = open("/proc/self/statm", O_RDONLY);
+        if (fd == -1) {
+            return 0;
+        }
+        char buffer[128];
+        ssize_t got = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (got <= 0) {
+            return 0;
+        }
+        buffer[got] = '\0';
+        const char *ptr = strchr(buffer, ' '); // past the total size, to the resident pages
+        if (ptr == nullptr) {
+            return 0;
+        }
+        uint64_t pages = strtoull(ptr + 1, nullptr, 10);
+        return pages*(uint64_t) sysconf(_SC_PAGESIZE);
+#else
+        return 0;
+#endif
+    }
+
+    inline void sample_rss() {
+        uint64_t rss = rss_bytes();
+        raise(stages[latest.load(std::memory_order_relaxed)].peak_rss, rss);
+        raise(peak_rss, rss);
+    }
+
+    // the stage called name (which must outlive the profile, e.g. a string literal), added if need be; stages past
+    // max_stages are put down to stage 0
+    inline int stage_id(const char *name) {
+        for (int i = 1; i < max_stages; ++i) {
+            const char *known = stages[i].name.load(std::memory_order_acquire);
+            if (known == nullptr) {
+                std::lock_guard<std::mutex> guard(stage_lock);
+                known = stages[i].name.load(std::memory_order_relaxed);
+                if (known == nullptr) {
+                    stages[i].name.store(name, std::memory_order_release);
+                    return i;
+                }
+            }
+            if (known == name || strcmp(known, name) == 0) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // clears the counts and starts profiling
+    inline void start() {
+        active.store(false);
+        for (stage_stats &stage : stages) {
+            stage.calls = 0;
+            stage.nanoseconds = 0;
+            stage.allocations = 0;
+            stage.frees = 0;
+            stage.bytes = 0;
+            stage.freed = 0;
+            stage.peak_live = 0;
+            stage.peak_rss = 0;
+        }
+        stages[0].name = "other";
+        for (std::atomic<uintptr_t> &slot : tracked) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+        untracked = 0;
+        live = 0;
+        peak_live = 0;
+        peak_rss = 0;
+        latest = 0;
+        sample_rss();
+        active.store(true);
+    }
+
+    inline void stop() {
+        sample_rss();
+        active.store(false);
+    }
+
+    // Puts what happens on this thread, until it goes out of scope, down to the stage called name. Scopes nest, the
+    // innermost one winning. Costs one atomic load when profiling is off.
+    class Scope {
+    private:
+        int stage = -1;
+        int outer = 0;
+        std::chrono::steady_clock::time_point began;
+    public:
+        explicit Scope(const char *name) {
+            if (!active.load(std::memory_order_relaxed)) {
+                return;
+            }
+            stage = stage_id(name);
+            outer = current;
+            current = stage;
+            latest.store(stage, std::memory_order_relaxed);
+            stages[stage].calls.fetch_add(1, std::memory_order_relaxed);
+            raise(stages[stage].peak_live, live.load(std::memory_order_relaxed));
+            sample_rss();
+            began = std::chrono::steady_clock::now();
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope() {
+            if (stage < 0) {
+                return;
+            }
+            auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - began);
+            stages[stage].nanoseconds.fetch_add((uint64_t) took.count(), std::memory_order_relaxed);
+            sample_rss();
+            current = outer;
+            latest.store(outer, std::memory_order_relaxed);
+        }
+    };
+
+    // Samples the RSS every interval on a thread of its own while it exists, putting each sample down to the stage
+    // last entered, so that a stage that builds and drops its buffers between two Scope boundaries is still caught.
+    class Rss_sampler {
+    private:
+        std::atomic<bool> stopping{false};
+        std::thread sampler;
+    public:
+        explicit Rss_sampler(std::chrono::milliseconds interval = std::chrono::milliseconds(5)) {
+            sampler = std::thread([this, interval]() {
+                while (!stopping.load(std::memory_order_relaxed)) {
+                    if (active.load(std::memory_order_relaxed)) {
+                        sample_rss();
+                    }
+                    std::this_thread::sleep_for(interval);
+                }
+            });
+        }
+        Rss_sampler(const Rss_sampler &) = delete;
+        Rss_sampler &operator=(const Rss_sampler &) = delete;
+        ~Rss_sampler() {
+            stopping = true;
+            sampler.join();
+        }
+    };
+
+    // One line per stage that ran or allocated, as a table or as CSV for the benchmark output. Bytes are bytes, not
+    // KiB, in the CSV.
+    inline void report(FILE *out, bool csv = false) {
+        bool counted = hooked.load();
+        if (csv) {
+            fputs("stage,calls,ms,allocations,frees,bytes,freed,peak_live,peak_rss\n", out);
+        }
+        else {
+            if (!counted) {
+                fputs("Allocations not counted: built without OIL_PROFILE_ALLOCATIONS.\n", out);
+            }
+            fprintf(out, "%-16s %7s %10s %12s %12s %12s %12s %12s\n", "stage", "calls", "ms", "allocations",
+                    "KiB", "net KiB", "peak KiB", "peak RSS KiB");
+        }
+        for (stage_stats &stage : stages) {
+            const char *name = stage.name.load();
+            if (name == nullptr || (stage.calls == 0 && stage.allocations == 0 && stage.frees == 0)) {
+                continue;
+            }
+            double ms = (double) stage.nanoseconds.load()/1e6;
+            if (csv) {
+                fprintf(out, "%s,%llu,%.3f,%llu,%llu,%llu,%llu,%lld,%llu\n", name,
+                        (unsigned long long) stage.calls.load(), ms, (unsigned long long) stage.allocations.load(),
+                        (unsigned long long) stage.frees.load(), (unsigned long long) stage.bytes.load(),
+                        (unsigned long long) stage.freed.load(), (long long) stage.peak_live.load(),
+                        (unsigned long long) stage.peak_rss.load());
+            }
+            else {
+                fprintf(out, "%-16s %7llu %10.3f %12llu %12.1f %12.1f %12.1f %12.1f\n", name,
+                        (unsigned long long) stage.calls.load(), ms, (unsigned long long) stage.allocations.load(),
+                        (double) stage.bytes.load()/1024,
+                        ((double) stage.bytes.load() - (double) stage.freed.load())/1024,
+                        (double) stage.peak_live.load()/1024, (double) stage.peak_rss.load()/1024);
+            }
+        }
+        if (csv) {
+            fprintf(out, "total,,,,,,,%lld,%llu\n", (long long) peak_live.load(), (unsigned long long) peak_rss.load());
+        }
+        else {
+            fprintf(out, "peak heap %.1f KiB, peak RSS %.1f KiB\n", (double) peak_live.load()/1024,
+                    (double) peak_rss.load()/1024);
+            if (untracked.load() > 0) {
+                fprintf(out, "%llu allocations not counted: too many blocks were live at once to track.\n",
+                        (unsigned long long) untracked.load());
+            }
+        }
+    }
+}
+#endif
@@ -0,0 +1,226 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILREPORT_H
+#define OILREPORT_H
+
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#include "oilnames.h"
+#include "oilarchive.h"
+
+namespace oil {
+
+    enum class report_format {text, csv, markdown};
+
+    // Formats the runs of a .dat file (archived ones first) as text (the same layout as operator<<), CSV or a Markdown
+    // table. Records are read in batches (a segment at a time from the archive), each batch is split into ranges
+    // formatted in parallel with std::to_chars, and the output is written unbuffered in 1 MiB writes.
+    template <typename REC>
+    class Report {
+    private:
+        static constexpr size_t batch_records = 1 << 16;
+        static constexpr size_t write_size = 1 << 20;
+        class Out {
+        public:
+            std::vector<char> buf;
+            size_t len = 0;
+            char *reserve(size_t n) {
+                if (len + n > buf.size()) {
+                    buf.resize(std::max(buf.size()*2, len + n + 4096));
+                }
+                return buf.data() + len;
+            }
+            void put(const char *str, size_t n) {
+                std::memcpy(reserve(n), str, n);
+                len += n;
+            }
+            template <size_t N>
+            void put(const char (&str)[N]) {
+                put(str, N - 1);
+            }
+            void put(char ch) {
+                *reserve(1) = ch;
+                ++len;
+            }
+            void put(double value) { // same digits as an ostream with its default precision of 6
+                char *first = reserve(32);
+                len += std::to_chars(first, first + 32, value, std::chars_format::general, 6).ptr - first;
+            }
+        };
+        static void name_csv(Out &out, const std::string &name) {
+            if (name.find_first_of(",\"\n") == std::string::npos) {
+                out.put(name.data(), name.size());
+                return;
+            }
+            out.put('"');
+            for (char ch : name) {
+                if (ch == '"') {
+                    out.put('"');
+                }
+                out.put(ch);
+            }
+            out.put('"');
+        }
+        static void format_text(Out &out, const REC &r, const std::string &name) {
+            out.put("Name: ");
+            out.put(name.data(), name.size());
+            out.put("\nOuter cylinder radius = "); out.put(r.a); out.put(" +/- "); out.put(r.a_err);
+            out.put(" m\nInner cylinder radius = "); out.put(r.b); out.put(" +/- "); out.put(r.b_err);
+            out.put(" m\nDrum diameter = "); out.put(r.drum); out.put(" +/- "); out.put(r.drum_err);
+            out.put(" m\nMT vs l slope = "); out.put(r.MT_v_l_slope); out.put(" +/- "); out.put(r.MT_v_l_slope_err);
+            out.put(" kg s m^-1\nMT vs l intercept = "); out.put(r.intercept); out.put(" +/- ");
+            out.put(r.intercept_err);
+            out.put(" kg s\nk correction factor = "); out.put(r.k); out.put(" +/- "); out.put(r.k_err);
+            out.put(" m\nMass on balances = "); out.put(r.mass); out.put(" +/- "); out.put(r.mass_err);
+            out.put(" kg\nTime period = "); out.put(r.T); out.put(" +/- "); out.put(r.T_err);
+            out.put(" s\nSubmergence = "); out.put(r.submergence); out.put(" +/- "); out.put(r.sub_err);
+            out.put(" m\nViscosity = "); out.put(r.viscosity); out.put(" +/- "); out.put(r.visc_err);
+            out.put(" kg m^-1 s^-1\n\n\n");
+        }
+        static void format_row(Out &out, const REC &r, const std::string &name, char sep) {
+            const double values[] = {r.a, r.a_err, r.b, r.b_err, r.drum, r.drum_err, r.MT_v_l_slope,
+                                     r.MT_v_l_slope_err, r.intercept, r.intercept_err, r.k, r.k_err, r.mass,
+                                     r.mass_err, r.T, r.T_err, r.submergence, r.sub_err, r.viscosity, r.visc_err};
+            if (sep == ',') {
+                name_csv(out, name);
+            }
+            else {
+                out.put("| ");
+                for (char ch : name) {
+                    if (ch == '|') {
+                        out.put('\\');
+                    }
+                    out.put(ch);
+                }
+            }
+            for (double value : values) {
+                if (sep == ',') {
+                    out.put(',');
+                }
+                else {
+                    out.put(" | ");
+                }
+                out.put(value);
+            }
+            if (sep != ',') {
+                out.put(" |");
+            }
+            out.put('\n');
+        }
+        static void format_range(Out &out, const REC *first, const REC *last, const Name_table &names,
+                                 report_format format) {
+            out.len = 0;
+            for (; first != last; ++first) {
+                const std::string &name = names.name(first->name_id);
+                switch (format) {
+                    case report_format::text: format_text(out, *first, name); break;
+                    case report_format::csv: format_row(out, *first, name, ','); break;
+                    case report_format::markdown: format_row(out, *first, name, '|'); break;
+                }
+            }
+        }
+        static void write_out(FILE *fp, const Out &out) {
+            for (size_t done = 0; done < out.len; done += write_size) {
+                size_t n = std::min(write_size, out.len - done);
+                if (fwrite(out.buf.data() + done, 1, n, fp) != n) {
+                    throw std::invalid_argument("The report could not be written.\n");
+                }
+            }
+        }
+    public:
+        static constexpr const char *columns = "name,a,a_err,b,b_err,drum,drum_err,MT_v_l_slope,MT_v_l_slope_err,"
+                                               "intercept,intercept_err,k,k_err,mass,mass_err,T,T_err,submergence,"
+                                               "sub_err,viscosity,visc_err";
+        // returns the number of runs written
+        static size_t write(const char *dat_path, const char *out_path, report_format format,
+                            unsigned threads = 0) {
+            Name_table names;
+            names.load<REC>(dat_path);
+            FILE *in = Dat_file<REC>::open_runs(dat_path);
+            if (in == nullptr) {
+                throw std::invalid_argument("Error opening file.\n");
+            }
+            FILE *fp = fopen(out_path, "wb");
+            if (fp == nullptr) {
+                fclose(in);
+                throw std::invalid_argument("The report could not be written.\n");
+            }
+            setvbuf(fp, nullptr, _IONBF, 0); // every fwrite() is one write() of up to 1 MiB
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            std::vector<REC> batch(batch_records);
+            std::vector<Out> outs(threads);
+            Out header;
+            if (format == report_format::csv) {
+                header.put(columns, std::strlen(columns));
+                header.put('\n');
+            }
+            else if (format == report_format::markdown) {
+                header.put("| ");
+                for (const char *ch = columns; *ch; ++ch) {
+                    if (*ch == ',') {
+                        header.put(" | ");
+                    }
+                    else {
+                        header.put(*ch);
+                    }
+                }
+                header.put(" |\n| --- |");
+                for (int i = 0; i < 20; ++i) {
+                    header.put(" ---: |");
+                }
+                header.put('\n');
+            }
+            size_t total = 0;
+            auto emit = [&outs, &names, &total, threads, format, fp](const REC *runs, size_t got) {
+                size_t used = std::min<size_t>(threads, (got + 1023) / 1024); // not worth a thread below ~1k
+                size_t per = (got + used - 1) / used;
+                std::vector<std::thread> workers;
+                for (size_t t = 1; t < used; ++t) {
+                    const REC *first = runs + std::min(got, t*per);
+                    const REC *last = runs + std::min(got, (t + 1)*per);
+                    workers.emplace_back(format_range, std::ref(outs[t]), first, last, std::cref(names), format);
+                }
+                format_range(outs[0], runs, runs + std::min(got, per), names, format);
+                for (std::thread &worker : workers) {
+                    worker.join();
+                }
+                for (size_t t = 0; t < used; ++t) {
+                    write_out(fp, outs[t]);
+                }
+                total += got;
+            };
+            try {
+                write_out(fp, header);
+                Archive<REC>::for_each_segment(dat_path, [&emit](const std::vector<REC> &runs) {
+                    emit(runs.data(), runs.size());
+                });
+                size_t got;
+                while ((got = fread(batch.data(), sizeof(REC), batch_records, in)) > 0) {
+                    emit(batch.data(), got);
+                }
+            }
+            catch (...) {
+                fclose(in);
+                fclose(fp);
+                throw;
+            }
+            fclose(in);
+            if (fclose(fp) != 0) {
+                throw std::invalid_argument("The report could not be written.\n");
+            }
+            return total;
+        }
+    };
+}
+#endif
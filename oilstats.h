@@ -0,0 +1,320 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILSTATS_H
+#define OILSTATS_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+namespace oil {
+
+    namespace stats {
+
+        // Sum of func over [first, first + n) by pairwise summation: runs of up to 128 are summed in eight interleaved
+        // lanes, and those sums are added up in a balanced tree, so that the rounding error grows with log n rather
+        // than with n. This is what keeps sums of float samples accurate.
+        template <typename T, typename ITER, typename FUNC>
+        T pairwise_sum(ITER first, size_t n, FUNC func) {
+            if (n <= 128) {
+                T lanes[8] = {};
+                size_t i = 0;
+                for (; i + 8 <= n; i += 8, first += 8) {
+                    for (int k = 0; k < 8; ++k) {
+                        lanes[k] += func(first[k]);
+                    }
+                }
+                T total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+                          ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+                for (; i < n; ++i, ++first) {
+                    total += func(*first);
+                }
+                return total;
+            }
+            size_t half = n/16*8; // a multiple of the lanes
+            return pairwise_sum<T>(first, half, func) + pairwise_sum<T>(first + (long) half, n - half, func);
+        }
+
+        // Running mean and variance by Welford's update, which does not cancel the way E[x^2] - E[x]^2 does
+        struct welford {
+            size_t n = 0;
+            double mean = 0;
+            double m2 = 0;
+            void add(double value) {
+                double delta = value - mean;
+                mean += delta / (double) ++n;
+                m2 += delta*(value - mean);
+            }
+            [[nodiscard]] double variance() const { // of the population, as Oil_run::SD() has always been
+                return n > 0 ? m2 / (double) n : 0;
+            }
+        };
+
+        // Median of values, which are reordered; nth_element() makes it linear in their number on average
+        inline double median(std::vector<double> &values) {
+            if (values.empty()) {
+                return 0;
+            }
+            size_t mid = values.size()/2;
+            std::nth_element(values.begin(), values.begin() + (long) mid, values.end());
+            double upper = values[mid];
+            if (values.size() % 2 == 1) {
+                return upper;
+            }
+            return (*std::max_element(values.begin(), values.begin() + (long) mid) + upper)/2;
+        }
+
+        struct interval_result {
+            double mean = 0;
+            double sd = 0;
+            size_t used = 0; // intervals the mean and SD are of
+            size_t split = 0; // intervals near a multiple of T (missed maxima), divided by that multiple
+            size_t joined = 0; // intervals short of T (extra maxima), joined to the next ones to make up one
+            size_t rejected = 0; // intervals left out, as outliers or as short ones that did not add up to T
+            std::vector<double> kept; // the used ones, in order, e.g. to bootstrap
+        };
+
+        // Mean and SD of the intervals between consecutive times, robust to a maximum that was missed or counted
+        // twice. T is first taken as the median interval; an interval within tolerance*T of a multiple k*T (k >= 2)
+        // is then divided by k and used once, as k equal copies would understate the SD and overstate the count.
+        // Short intervals are joined until they make up one within tolerance of T, and what is left further than
+        // cutoff robust SDs from the median is rejected. The robust SD is 1.4826 MAD, or 1.2533 times the mean
+        // absolute deviation if that is larger.
+        template <typename CONTAINER>
+        interval_result robust_intervals(const CONTAINER &times, double tolerance = 0.25, double cutoff = 5) {
+            interval_result result;
+            std::vector<double> diffs;
+            diffs.reserve(times.size());
+            for (size_t i = 1; i < times.size(); ++i) {
+                diffs.push_back(times[i] - times[i - 1]);
+            }
+            std::vector<double> fixed(diffs);
+            double period = median(fixed);
+            fixed.clear();
+            double carry = 0;
+            size_t pieces = 0;
+            for (double diff : diffs) {
+                if (pieces > 0 && (carry + diff)/period > 1 + tolerance) { // the short ones do not make up a T
+                    result.rejected += pieces;
+                    carry = 0;
+                    pieces = 0;
+                }
+                double ratio = (carry + diff)/period;
+                if (ratio < 1 - tolerance) {
+                    carry += diff;
+                    ++pieces;
+                }
+                else if (pieces > 0) {
+                    fixed.push_back(carry + diff);
+                    result.joined += pieces;
+                    carry = 0;
+                    pieces = 0;
+                }
+                else if (long k = std::lround(ratio); k >= 2 && std::fabs(ratio - (double) k) <= tolerance) {
+                    fixed.push_back(diff / (double) k);
+                    ++result.split;
+                }
+                else {
+                    fixed.push_back(diff);
+                }
+            }
+            result.rejected += pieces;
+            diffs.assign(fixed.begin(), fixed.end()); // diffs is scratch from here on
+            double centre = median(diffs);
+            double total_dev = 0;
+            for (double &value : diffs) {
+                value = std::fabs(value - centre);
+                total_dev += value;
+            }
+            double spread = 1.4826*median(diffs);
+            if (!diffs.empty()) { // the MAD is (all but) 0 when the times are quantised to a few sample periods
+                spread = std::max(spread, 1.2533*total_dev / (double) diffs.size());
+            }
+            welford kept;
+            for (double value : fixed) {
+                if (spread == 0 || std::fabs(value - centre) <= cutoff*spread) {
+                    kept.add(value);
+                    result.kept.push_back(value);
+                }
+                else {
+                    ++result.rejected;
+                }
+            }
+            result.mean = kept.mean;
+            result.sd = std::sqrt(kept.variance());
+            result.used = kept.n;
+            return result;
+        }
+
+        struct bootstrap_result {
+            double mean;
+            double std_err;
+            double ci_low;
+            double ci_high;
+        };
+
+        class Block_bootstrap {
+        private:
+            class TooFewIntervalsError : public std::exception {
+                [[nodiscard]] const char *what() const noexcept override {
+                    return "At least two time intervals are needed to bootstrap the time period.";
+                }
+            };
+            // xoshiro256**, one per worker thread so no state is shared between them
+            struct rng {
+                uint64_t s[4];
+                explicit rng(uint64_t seed) {
+                    for (uint64_t &word : s) { // seeded through splitmix64
+                        seed += 0x9e3779b97f4a7c15ULL;
+                        uint64_t z = seed;
+                        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+                        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+                        word = z ^ (z >> 31);
+                    }
+                }
+                static uint64_t rotl(uint64_t x, int k) {
+                    return (x << k) | (x >> (64 - k));
+                }
+                uint64_t next() {
+                    uint64_t result = rotl(s[1]*5, 7)*9;
+                    uint64_t t = s[1] << 17;
+                    s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+                    s[2] ^= t;
+                    s[3] = rotl(s[3], 45);
+                    return result;
+                }
+                uint32_t below(uint32_t bound) { // Lemire's multiply-shift, the slight bias is irrelevant here
+                    return (uint32_t) (((next() >> 32)*(uint64_t) bound) >> 32);
+                }
+            };
+            static constexpr size_t batch_size = 256; // block starts drawn (and sorted) at a time
+            std::vector<double> prefix; // prefix sums of the intervals, wrapped around by one block
+            std::vector<double> means; // one slot per resample, allocated once
+            size_t n = 0;
+            size_t block_len = 0;
+            void resample_range(size_t first, size_t last, uint64_t seed) {
+                rng gen(seed);
+                uint32_t starts[batch_size];
+                const size_t full_blocks = n / block_len;
+                const size_t remainder = n % block_len;
+                const double *P = prefix.data();
+                for (size_t r = first; r < last; ++r) {
+                    double total = 0;
+                    if (remainder != 0) { // the short block gets a start of its own, not the last one after sorting
+                        size_t start = gen.below((uint32_t) n);
+                        total += P[start + remainder] - P[start];
+                    }
+                    size_t done = 0;
+                    while (done < full_blocks) {
+                        size_t todo = std::min(batch_size, full_blocks - done);
+                        for (size_t i = 0; i < todo; ++i) {
+                            starts[i] = gen.below((uint32_t) n);
+                        }
+                        // the order the blocks are summed in does not matter, so walk the prefix sums forwards
+                        std::sort(starts, starts + todo);
+                        for (size_t i = 0; i < todo; ++i) {
+                            total += P[starts[i] + block_len] - P[starts[i]];
+                        }
+                        done += todo;
+                    }
+                    means[r] = total / (double) n;
+                }
+            }
+            static double quantile(std::vector<double> &values, double q) {
+                auto pos = (size_t) std::llround(q*(double) (values.size() - 1));
+                std::nth_element(values.begin(), values.begin() + (long) pos, values.end());
+                return values[pos];
+            }
+        public:
+            Block_bootstrap() = default;
+            template <typename CONTAINER>
+            explicit Block_bootstrap(const CONTAINER &times, size_t block_length = 0) {
+                set_times(times, block_length);
+            }
+            template <typename CONTAINER>
+            void set_times(const CONTAINER &times, size_t block_length = 0) {
+                if (times.size() < 3) {
+                    throw TooFewIntervalsError();
+                }
+                n = times.size() - 1;
+                // circular block bootstrap: block length defaults to the usual n^(1/3) rule
+                block_len = block_length ? block_length : (size_t) std::max(1.0, std::round(std::cbrt((double) n)));
+                block_len = std::min(block_len, n);
+                prefix.assign(n + block_len + 1, 0);
+                auto prev = times.begin();
+                auto it = std::next(prev);
+                for (size_t i = 0; i < n; ++i, ++prev, ++it) {
+                    prefix[i + 1] = prefix[i] + (*it - *prev);
+                }
+                for (size_t i = n; i < n + block_len; ++i) {
+                    prefix[i + 1] = prefix[i] + (prefix[i - n + 1] - prefix[i - n]);
+                }
+            }
+            [[nodiscard]] size_t block_length() const {
+                return block_len;
+            }
+            bootstrap_result run(size_t resamples, double confidence = 0.95, unsigned threads = 0,
+                                 uint64_t seed = 0x5eedULL) {
+                if (n == 0) {
+                    throw TooFewIntervalsError();
+                }
+                if (resamples < 2) {
+                    throw std::invalid_argument("At least two bootstrap resamples are needed.\n");
+                }
+                if (confidence <= 0 || confidence >= 1) {
+                    throw std::invalid_argument("The confidence level must lie strictly between 0 and 1.\n");
+                }
+                if (threads == 0) {
+                    threads = std::max(1u, std::thread::hardware_concurrency());
+                }
+                threads = (unsigned) std::min<size_t>(threads, resamples);
+                means.resize(resamples);
+                std::vector<std::thread> workers;
+                size_t per_thread = resamples / threads;
+                size_t first = 0;
+                for (unsigned t = 0; t < threads; ++t) {
+                    size_t last = (t == threads - 1) ? resamples : first + per_thread;
+                    if (t == threads - 1) {
+                        resample_range(first, last, seed + t); // the calling thread takes the last share
+                    }
+                    else {
+                        workers.emplace_back(&Block_bootstrap::resample_range, this, first, last, seed + t);
+                    }
+                    first = last;
+                }
+                for (std::thread &worker : workers) {
+                    worker.join();
+                }
+                bootstrap_result result{};
+                result.mean = (prefix[n] - prefix[0]) / (double) n;
+                double mean = 0;
+                double m2 = 0;
+                size_t count = 0;
+                for (const double &value : means) { // Welford
+                    double delta = value - mean;
+                    mean += delta / (double) ++count;
+                    m2 += delta*(value - mean);
+                }
+                result.std_err = std::sqrt(m2 / (double) (count - 1));
+                double alpha = (1 - confidence) / 2;
+                result.ci_low = quantile(means, alpha);
+                result.ci_high = quantile(means, 1 - alpha);
+                return result;
+            }
+        };
+
+        template <typename CONTAINER>
+        bootstrap_result block_bootstrap(const CONTAINER &times, size_t resamples, double confidence = 0.95,
+                                         size_t block_length = 0, unsigned threads = 0) {
+            Block_bootstrap boot(times, block_length);
+            return boot.run(resamples, confidence, threads);
+        }
+    }
+}
+#endif
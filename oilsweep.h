@@ -0,0 +1,204 @@
+//
+// Created by GregW on 18/10/2026.
+//
+
+#ifndef OILSWEEP_H
+#define OILSWEEP_H
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "oilproc.h"
+
+namespace oil {
+
+    // Runs the period detection of get_T() over a grid of settings, all on one capture that is read and parsed only
+    // once. The parsed samples are shared read-only between the worker threads, each of which filters and searches
+    // its own copy, so the settings can be compared without rereading the file or answering any prompts.
+    class Sweep {
+    public:
+        struct setting {
+            double freq = 0; // only changes the times of captures whose times are sample numbers
+            size_t skip = 0; // leading samples left out
+            filter_kind filter = filter_kind::none;
+            double cutoff = 0;
+            double hysteresis = 0; // see Oil_run::find_peaks()
+            baseline_kind baseline = baseline_kind::none;
+            double baseline_window = 0; // s
+        };
+        struct result {
+            setting config;
+            double T = 0;
+            double T_err = 0;
+            size_t maxima = 0;
+            std::string error; // empty if T was found
+        };
+    private:
+        std::vector<double> times;
+        std::vector<double> volts;
+        double parse_freq;
+        bool indexed; // the times are sample numbers divided by parse_freq
+        bool single_precision = false; // see use_float_samples()
+        template <typename SAMPLE>
+        void evaluate(const setting &config, result &res, std::vector<double> &t, std::vector<SAMPLE> &v,
+                      Peak_table &peaks) const {
+            res.config = config;
+            if (config.skip >= times.size()) {
+                res.error = "skip is beyond the end of the capture";
+                return;
+            }
+            t.assign(times.begin() + (long) config.skip, times.end());
+            v.assign(volts.begin() + (long) config.skip, volts.end());
+            if (indexed && config.freq != parse_freq) {
+                double scale = parse_freq/config.freq;
+                for (double &time : t) {
+                    time *= scale;
+                }
+            }
+            double rate = 0;
+            if (t.size() > 1) {
+                rate = (double) (t.size() - 1)/(t.back() - t.front());
+                Prefilter(config.filter, config.cutoff).apply(t, v, rate);
+            }
+            size_t window = 0; // in samples, as in Oil_run::find_T()
+            if (config.baseline != baseline_kind::none) {
+                window = std::max<size_t>(2, std::lround(config.baseline_window*rate));
+            }
+            Oil_run::find_peaks(t, v, config.hysteresis, peaks, config.baseline, window);
+            res.maxima = peaks.size();
+            if (peaks.size() < 2) {
+                res.error = "too few maxima";
+                return;
+            }
+            double *both = Oil_run::avg_time_diff(peaks.times());
+            res.T = both[0];
+            res.T_err = both[1];
+            free(both);
+        }
+    public:
+        Sweep(const char *capture_path, double freq) : parse_freq(freq) {
+            Oil_run::check_path(capture_path);
+            indexed = Oil_run::read_capture(capture_path, -1, freq, times, volts);
+        }
+        [[nodiscard]] size_t samples() const {
+            return times.size();
+        }
+        // filters and searches float copies of the voltages, as Oil_run::use_float_samples() does
+        void use_float_samples(bool on = true) {
+            single_precision = on;
+        }
+        // every combination of the given values, freqs varying slowest
+        static std::vector<setting> grid(const std::vector<double> &freqs, const std::vector<size_t> &skips,
+                                         const std::vector<std::pair<filter_kind, double>> &filters,
+                                         const std::vector<double> &hysteresis,
+                                         const std::vector<std::pair<baseline_kind, double>> &baselines = {
+                                                 {baseline_kind::none, 0}}) {
+            std::vector<setting> settings;
+            settings.reserve(freqs.size()*skips.size()*filters.size()*hysteresis.size()*baselines.size());
+            for (double freq : freqs) {
+                for (size_t skip : skips) {
+                    for (const std::pair<filter_kind, double> &filter : filters) {
+                        for (double hyst : hysteresis) {
+                            for (const std::pair<baseline_kind, double> &baseline : baselines) {
+                                settings.push_back({freq, skip, filter.first, filter.second, hyst, baseline.first,
+                                                    baseline.second});
+                            }
+                        }
+                    }
+                }
+            }
+            return settings;
+        }
+        std::vector<result> run(const std::vector<setting> &settings, unsigned threads = 0) const {
+            std::vector<result> results(settings.size());
+            if (threads == 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threads = (unsigned) std::min<size_t>(threads, settings.size());
+            std::atomic<size_t> next{0};
+            auto work = [&]() {
+                std::vector<double> t, v; // reused from one setting to the next
+                std::vector<float> v_float;
+                Peak_table peaks;
+                for (size_t i; (i = next.fetch_add(1)) < settings.size();) {
+                    try {
+                        if (single_precision) {
+                            evaluate(settings[i], results[i], t, v_float, peaks);
+                        }
+                        else {
+                            evaluate(settings[i], results[i], t, v, peaks);
+                        }
+                    }
+                    catch (const std::exception &exception) {
+                        results[i].config = settings[i];
+                        results[i].error = exception.what();
+                    }
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned i = 1; i < threads; ++i) {
+                workers.emplace_back(work);
+            }
+            work();
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+            return results;
+        }
+        // One line per setting. A setting is marked stable ('*', or 1 in the CSV) if its T is within its own T_err of
+        // the median T over all the settings that found one.
+        static void print(FILE *out, const std::vector<result> &results, bool csv = false) {
+            std::vector<double> found;
+            for (const result &res : results) {
+                if (res.error.empty()) {
+                    found.push_back(res.T);
+                }
+            }
+            double median = 0;
+            if (!found.empty()) {
+                std::sort(found.begin(), found.end());
+                size_t mid = found.size()/2;
+                median = found.size() % 2 ? found[mid] : (found[mid - 1] + found[mid])/2;
+            }
+            size_t stable_count = 0;
+            if (csv) {
+                fputs("freq,skip,filter,cutoff,hysteresis,baseline,window,T,T_err,maxima,stable,error\n", out);
+            }
+            else {
+                fprintf(out, "%10s %8s %6s %9s %6s %8s %7s %12s %12s %7s\n", "freq", "skip", "filter", "cutoff",
+                        "hyst", "baseline", "window", "T (s)", "T_err (s)", "maxima");
+            }
+            for (const result &res : results) {
+                const setting &c = res.config;
+                bool stable = res.error.empty() && std::fabs(res.T - median) <= res.T_err;
+                stable_count += stable;
+                const char *baseline = Baseline::name_of(c.baseline);
+                if (csv) {
+                    fprintf(out, "%g,%zu,%s,%g,%g,%s,%g,%.9g,%.9g,%zu,%d,%s\n", c.freq, c.skip,
+                            Prefilter::name_of(c.filter), c.cutoff, c.hysteresis, baseline, c.baseline_window, res.T,
+                            res.T_err, res.maxima, stable, res.error.c_str());
+                }
+                else if (res.error.empty()) {
+                    fprintf(out, "%10g %8zu %6s %9g %6g %8s %7g %12.6g %12.6g %7zu%s\n", c.freq, c.skip,
+                            Prefilter::name_of(c.filter), c.cutoff, c.hysteresis, baseline, c.baseline_window, res.T,
+                            res.T_err, res.maxima, stable ? " *" : "");
+                }
+                else {
+                    fprintf(out, "%10g %8zu %6s %9g %6g %8s %7g %12s %12s %7zu (%s)\n", c.freq, c.skip,
+                            Prefilter::name_of(c.filter), c.cutoff, c.hysteresis, baseline, c.baseline_window, "-",
+                            "-", res.maxima, res.error.c_str());
+                }
+            }
+            if (!csv && !found.empty()) {
+                fprintf(out, "\nMedian T = %.6g s; %zu of %zu settings within their T_err of it (*).\n", median,
+                        stable_count, results.size());
+            }
+        }
+    };
+}
+#endif